@@ -0,0 +1,460 @@
+/* Play an Animated Wallpaper from a Ring of Frames Decoded Ahead */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <gtk/gtk.h>
+
+#include "animation.h"
+#include "memory_usage.h"
+#include "utils.h"
+
+// Keeps a GIF frame with no delay from stalling the decoder
+#define ANIMATION_MIN_DELAY_MSEC 10
+
+
+static void start_worker(Animation *animation);
+static void stop_worker(Animation *animation);
+static gpointer decode_frames(gpointer data);
+static void decode_animation_file(Animation *animation);
+static void decode_frame_directory(Animation *animation);
+static GPtrArray *list_frame_paths(const gchar *directory);
+static gint compare_paths(gconstpointer a, gconstpointer b);
+static gboolean wait_for_space(Animation *animation);
+static void push_frame(Animation *animation, GdkPixbuf *pixbuf, gint64 duration);
+static cairo_surface_t *render_frame(GdkPixbuf *pixbuf, gint width, gint height);
+static void clear_frame(AnimationFrame *frame);
+static void start_playback(Animation *animation);
+static void stop_playback(Animation *animation);
+static void start_ticking(Animation *animation);
+static gboolean handle_frame_due(gpointer user_data);
+static gboolean handle_frame_ready(gpointer user_data);
+static gboolean handle_animation_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data);
+
+
+/* Create a paused animation. Nothing is decoded until a geometry is set. */
+Animation *initialize_animation(const gchar *source, gint max_fps, GtkWidget *widget)
+{
+    Animation *animation = malloc(sizeof(Animation));
+    if (animation == NULL) {
+        g_error("Could not allocate memory for Animation");
+    }
+    animation->source = g_strdup(source);
+    animation->widget = widget;
+    animation->min_frame_duration = G_USEC_PER_SEC / MAX(max_fps, 1);
+    animation->width = 0;
+    animation->height = 0;
+
+    g_mutex_init(&animation->lock);
+    g_cond_init(&animation->space_available);
+    animation->ring_start = 0;
+    animation->ring_count = 0;
+    animation->stopping = FALSE;
+    animation->decoded_all = FALSE;
+    animation->worker = NULL;
+    animation->waiting = FALSE;
+    animation->ready_id = 0;
+
+    animation->current.surface = NULL;
+    animation->current.duration = 0;
+    animation->current_end = 0;
+    animation->pause_reasons = 0;
+    animation->tick_id = 0;
+    animation->due_id = 0;
+    return animation;
+}
+
+void destroy_animation(Animation *animation)
+{
+    stop_playback(animation);
+    stop_worker(animation);
+    clear_frame(&animation->current);
+    g_mutex_clear(&animation->lock);
+    g_cond_clear(&animation->space_available);
+    g_free(animation->source);
+    free(animation);
+}
+
+/* Decode frames for a new geometry, dropping the ones decoded for the old */
+void animation_set_geometry(Animation *animation, gint width, gint height)
+{
+    if (width == animation->width && height == animation->height) {
+        return;
+    }
+    stop_playback(animation);
+    stop_worker(animation);
+    clear_frame(&animation->current);
+    animation->width = width;
+    animation->height = height;
+    start_worker(animation);
+    start_playback(animation);
+}
+
+/* Stop taking frames out of the ring. The worker stops once it is full. */
+void animation_pause(Animation *animation, AnimationPause reason)
+{
+    animation->pause_reasons |= (guint) reason;
+    stop_playback(animation);
+}
+
+void animation_resume(Animation *animation, AnimationPause reason)
+{
+    animation->pause_reasons &= ~(guint) reason;
+    if (animation->pause_reasons == 0 && animation->worker == NULL && animation->width > 0) {
+        // The frames were released while paused
+        start_worker(animation);
+    }
+    start_playback(animation);
+}
+
+/* Free every decoded frame while paused. Decoding starts over from the first
+ * frame once playback resumes.
+ */
+void animation_release_frames(Animation *animation)
+{
+    stop_playback(animation);
+    stop_worker(animation);
+    clear_frame(&animation->current);
+}
+
+/* The frame to draw, or NULL until the first one is decoded */
+cairo_surface_t *animation_get_frame(Animation *animation)
+{
+    return animation->current.surface;
+}
+
+
+static void start_worker(Animation *animation)
+{
+    animation->stopping = FALSE;
+    animation->decoded_all = FALSE;
+    animation->worker = g_thread_new("animation", &decode_frames, animation);
+}
+
+/* Stop & join the worker thread, & free every frame left in the ring */
+static void stop_worker(Animation *animation)
+{
+    if (animation->worker == NULL) {
+        return;
+    }
+    g_mutex_lock(&animation->lock);
+    animation->stopping = TRUE;
+    g_cond_signal(&animation->space_available);
+    g_mutex_unlock(&animation->lock);
+    g_thread_join(animation->worker);
+    animation->worker = NULL;
+
+    for (guint f = 0; f < animation->ring_count; f++) {
+        clear_frame(&animation->ring[(animation->ring_start + f) % ANIMATION_RING_SIZE]);
+    }
+    animation->ring_start = 0;
+    animation->ring_count = 0;
+}
+
+/* Runs on the worker thread, at a lower priority than the UI */
+static gpointer decode_frames(gpointer data)
+{
+    Animation *animation = (Animation *) data;
+    pid_t thread_id = (pid_t) syscall(SYS_gettid);
+    if (setpriority(PRIO_PROCESS, (id_t) thread_id, 10) != 0) {
+        g_message("Could not lower the animation thread's CPU priority");
+    }
+
+    if (g_file_test(animation->source, G_FILE_TEST_IS_DIR)) {
+        decode_frame_directory(animation);
+    } else {
+        decode_animation_file(animation);
+    }
+
+    g_mutex_lock(&animation->lock);
+    animation->decoded_all = TRUE;
+    g_mutex_unlock(&animation->lock);
+    return NULL;
+}
+
+/* Decode the frames of a GIF, APNG, or any other format GdkPixbuf animates,
+ * looping for as long as the image does.
+ */
+static void decode_animation_file(Animation *animation)
+{
+    GError *error = NULL;
+    GdkPixbufAnimation *image = gdk_pixbuf_animation_new_from_file(animation->source, &error);
+    if (image == NULL) {
+        g_warning("Could not load background-animation %s: %s",
+                  animation->source, error->message);
+        g_error_free(error);
+        return;
+    }
+    if (gdk_pixbuf_animation_is_static_image(image)) {
+        if (wait_for_space(animation)) {
+            push_frame(animation, gdk_pixbuf_animation_get_static_image(image), -1);
+        }
+        g_object_unref(image);
+        return;
+    }
+
+    // The iterator is advanced by each frame's delay rather than by the
+    // clock, so frames can be decoded before they are due
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GTimeVal frame_time = { 0, 0 };
+    GdkPixbufAnimationIter *iter = gdk_pixbuf_animation_get_iter(image, &frame_time);
+    gint64 skipped = 0;
+    while (TRUE) {
+        int delay = gdk_pixbuf_animation_iter_get_delay_time(iter);
+        if (delay < 0) {
+            // The last frame of an animation that does not loop forever
+            if (wait_for_space(animation)) {
+                push_frame(animation, gdk_pixbuf_animation_iter_get_pixbuf(iter), -1);
+            }
+            break;
+        }
+        delay = MAX(delay, ANIMATION_MIN_DELAY_MSEC);
+        gint64 duration = skipped + (gint64) delay * 1000;
+        if (duration < animation->min_frame_duration) {
+            // Over the frame rate cap, show the next frame for this one's time
+            skipped = duration;
+        } else {
+            if (!wait_for_space(animation)) {
+                break;
+            }
+            push_frame(animation, gdk_pixbuf_animation_iter_get_pixbuf(iter), duration);
+            skipped = 0;
+        }
+        g_time_val_add(&frame_time, (glong) delay * 1000);
+        gdk_pixbuf_animation_iter_advance(iter, &frame_time);
+    }
+    g_object_unref(iter);
+    G_GNUC_END_IGNORE_DEPRECATIONS
+    g_object_unref(image);
+}
+
+/* Decode a directory's images in name order, looping forever. Each frame is
+ * shown for one frame at the `background-animation-fps`.
+ */
+static void decode_frame_directory(Animation *animation)
+{
+    GPtrArray *paths = list_frame_paths(animation->source);
+    guint failed = 0;
+    for (guint p = 0; paths->len > 0 && failed < paths->len; p = (p + 1) % paths->len) {
+        if (!wait_for_space(animation)) {
+            break;
+        }
+        GError *error = NULL;
+        GdkPixbuf *pixbuf = load_image_to_cover(g_ptr_array_index(paths, p),
+                                                (guint) animation->width,
+                                                (guint) animation->height, &error);
+        if (pixbuf == NULL) {
+            g_warning("Could not load animation frame: %s", error->message);
+            g_error_free(error);
+            failed++;
+            continue;
+        }
+        failed = 0;
+        push_frame(animation, pixbuf, animation->min_frame_duration);
+        g_object_unref(pixbuf);
+    }
+    if (paths->len == 0) {
+        g_warning("No frames in background-animation %s", animation->source);
+    }
+    g_ptr_array_unref(paths);
+}
+
+static GPtrArray *list_frame_paths(const gchar *directory)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(&g_free);
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (dir != NULL) {
+        const gchar *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (name[0] != '.') {
+                g_ptr_array_add(paths, g_build_filename(directory, name, NULL));
+            }
+        }
+        g_dir_close(dir);
+    }
+    g_ptr_array_sort(paths, &compare_paths);
+    return paths;
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/* Block until the ring has room for a frame. Returns FALSE if the worker
+ * should stop instead.
+ *
+ * Only the worker adds frames, so the room is still there once the frame is
+ * rendered outside of the lock.
+ */
+static gboolean wait_for_space(Animation *animation)
+{
+    g_mutex_lock(&animation->lock);
+    while (animation->ring_count == ANIMATION_RING_SIZE && !animation->stopping) {
+        g_cond_wait(&animation->space_available, &animation->lock);
+    }
+    gboolean stopping = animation->stopping;
+    g_mutex_unlock(&animation->lock);
+    return !stopping;
+}
+
+static void push_frame(Animation *animation, GdkPixbuf *pixbuf, gint64 duration)
+{
+    AnimationFrame frame = {
+        render_frame(pixbuf, animation->width, animation->height), duration
+    };
+    g_mutex_lock(&animation->lock);
+    guint end = (animation->ring_start + animation->ring_count) % ANIMATION_RING_SIZE;
+    animation->ring[end] = frame;
+    animation->ring_count++;
+    if (animation->waiting) {
+        animation->waiting = FALSE;
+        animation->ready_id = g_idle_add(&handle_frame_ready, animation);
+    }
+    g_mutex_unlock(&animation->lock);
+}
+
+/* Scale an image to cover the geometry, centered, so drawing it is a copy */
+static cairo_surface_t *render_frame(GdkPixbuf *pixbuf, gint width, gint height)
+{
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    memory_usage_add_bytes(MEMORY_OWNER_ANIMATION, (gsize) cairo_image_surface_get_stride(surface) *
+                                                   (gsize) height);
+
+    gdouble image_width = gdk_pixbuf_get_width(pixbuf);
+    gdouble image_height = gdk_pixbuf_get_height(pixbuf);
+    gdouble scale = MAX(width / image_width, height / image_height);
+    cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, scale, scale);
+    gdk_cairo_set_source_pixbuf(cr, pixbuf, (width / scale - image_width) / 2,
+                                (height / scale - image_height) / 2);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    return surface;
+}
+
+static void clear_frame(AnimationFrame *frame)
+{
+    if (frame->surface == NULL) {
+        return;
+    }
+    memory_usage_remove_bytes(MEMORY_OWNER_ANIMATION,
+                              (gsize) cairo_image_surface_get_stride(frame->surface) *
+                              (gsize) cairo_image_surface_get_height(frame->surface));
+    cairo_surface_destroy(frame->surface);
+    frame->surface = NULL;
+}
+
+
+/* Start playing, unless playback is paused or the last frame is shown */
+static void start_playback(Animation *animation)
+{
+    if (animation->pause_reasons != 0 || animation->worker == NULL ||
+            (animation->current.surface != NULL && animation->current.duration < 0)) {
+        return;
+    }
+    g_mutex_lock(&animation->lock);
+    gboolean playing = animation->tick_id != 0 || animation->due_id != 0 ||
+                       animation->waiting || animation->ready_id != 0;
+    g_mutex_unlock(&animation->lock);
+    if (playing) {
+        return;
+    }
+    animation->current_end = 0;
+    start_ticking(animation);
+}
+
+static void stop_playback(Animation *animation)
+{
+    if (animation->tick_id != 0) {
+        gtk_widget_remove_tick_callback(animation->widget, animation->tick_id);
+        animation->tick_id = 0;
+    }
+    if (animation->due_id != 0) {
+        g_source_remove(animation->due_id);
+        animation->due_id = 0;
+    }
+    g_mutex_lock(&animation->lock);
+    animation->waiting = FALSE;
+    if (animation->ready_id != 0) {
+        g_source_remove(animation->ready_id);
+        animation->ready_id = 0;
+    }
+    g_mutex_unlock(&animation->lock);
+}
+
+static void start_ticking(Animation *animation)
+{
+    animation->tick_id = gtk_widget_add_tick_callback(
+        animation->widget, &handle_animation_tick, animation, NULL);
+}
+
+static gboolean handle_frame_due(gpointer user_data)
+{
+    Animation *animation = (Animation *) user_data;
+    animation->due_id = 0;
+    start_ticking(animation);
+    return G_SOURCE_REMOVE;
+}
+
+/* Runs once the worker pushed a frame playback was waiting for */
+static gboolean handle_frame_ready(gpointer user_data)
+{
+    Animation *animation = (Animation *) user_data;
+    g_mutex_lock(&animation->lock);
+    animation->ready_id = 0;
+    g_mutex_unlock(&animation->lock);
+    start_ticking(animation);
+    return G_SOURCE_REMOVE;
+}
+
+/* Show the next frame once the current one is due, & let the worker decode
+ * another into its place. The frame clock then stops until the next frame is
+ * due, or until the worker has one if it is behind.
+ */
+static gboolean handle_animation_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data)
+{
+    Animation *animation = (Animation *) user_data;
+    gint64 now = gdk_frame_clock_get_frame_time(clock);
+    if (animation->current_end != 0 && now < animation->current_end) {
+        // The timeout fired a little before the frame the next one is due on
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_mutex_lock(&animation->lock);
+    if (animation->ring_count == 0) {
+        // The worker is behind, keep showing the current frame until it
+        // pushes the next, unless there is none
+        animation->waiting = !animation->decoded_all;
+        g_mutex_unlock(&animation->lock);
+        animation->tick_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    AnimationFrame next = animation->ring[animation->ring_start];
+    animation->ring_start = (animation->ring_start + 1) % ANIMATION_RING_SIZE;
+    animation->ring_count--;
+    g_cond_signal(&animation->space_available);
+    g_mutex_unlock(&animation->lock);
+
+    clear_frame(&animation->current);
+    animation->current = next;
+    gtk_widget_queue_draw(widget);
+    animation->tick_id = 0;
+    if (next.duration < 0) {
+        return G_SOURCE_REMOVE;
+    }
+    // Keep to the animation's timing, unless it fell behind by a whole frame
+    if (animation->current_end == 0 || now - animation->current_end >= next.duration) {
+        animation->current_end = now + next.duration;
+    } else {
+        animation->current_end += next.duration;
+    }
+    // Frame times share g_get_monotonic_time's clock
+    gint64 delay = animation->current_end - g_get_monotonic_time();
+    animation->due_id = g_timeout_add((guint) ((MAX(delay, 0) + 999) / 1000), &handle_frame_due,
+                                      animation);
+    return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,74 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <gtk/gtk.h>
+
+// How many decoded frames are kept ahead of the one being shown
+#define ANIMATION_RING_SIZE 4
+
+
+/* Why playback is paused. It only runs while none of them apply. */
+typedef enum AnimationPause_ {
+    ANIMATION_PAUSE_LOGIN  = 1 << 0,
+    ANIMATION_PAUSE_HIDDEN = 1 << 1,
+    ANIMATION_PAUSE_IDLE   = 1 << 2,
+} AnimationPause;
+
+/* A frame scaled to cover the geometry, & how many microseconds to show it
+ * for. A negative duration shows it until playback is restarted.
+ */
+typedef struct AnimationFrame_ {
+    cairo_surface_t *surface;
+    gint64           duration;
+} AnimationFrame;
+
+/* An animated image, or a directory of frames, played on a widget.
+ *
+ * A worker thread decodes frames ahead into a ring of ANIMATION_RING_SIZE
+ * surfaces & waits while it is full. The widget's frame clock takes them out,
+ * at most `max_fps` times a second; frames that would be shown for less time
+ * are skipped by the worker instead of decoded.
+ *
+ * The frame clock only ticks to show a frame. In between, playback sleeps on
+ * a timeout until the next frame is due, or until the worker pushes one if it
+ * fell behind, so the main loop doesn't wake at the monitor's refresh rate.
+ */
+typedef struct Animation_ {
+    gchar          *source;
+    GtkWidget      *widget;
+    gint64          min_frame_duration;
+    gint            width;
+    gint            height;
+
+    // Shared with the worker thread, guarded by `lock`
+    GMutex          lock;
+    GCond           space_available;
+    AnimationFrame  ring[ANIMATION_RING_SIZE];
+    guint           ring_start;
+    guint           ring_count;
+    gboolean        stopping;
+    gboolean        decoded_all;
+    GThread        *worker;
+    // Set while playback waits for the worker, which then adds `ready_id`
+    gboolean        waiting;
+    guint           ready_id;
+
+    // The frame being shown, & the frame time to show the next one at
+    AnimationFrame  current;
+    gint64          current_end;
+    guint           pause_reasons;
+    guint           tick_id;
+    // A timeout to `current_end`, while the frame clock is not ticking
+    guint           due_id;
+} Animation;
+
+
+Animation *initialize_animation(const gchar *source, gint max_fps, GtkWidget *widget);
+void destroy_animation(Animation *animation);
+void animation_set_geometry(Animation *animation, gint width, gint height);
+void animation_pause(Animation *animation, AnimationPause reason);
+void animation_resume(Animation *animation, AnimationPause reason);
+void animation_release_frames(Animation *animation);
+cairo_surface_t *animation_get_frame(Animation *animation);
+
+#endif
@@ -1,5 +1,6 @@
 /* Application Initialization Things */
 #include <stdlib.h>
+#include <string.h>
 
 #include <gtk/gtk.h>
 #include <lightdm.h>
@@ -7,12 +8,28 @@
 #include "app.h"
 #include "callbacks.h"
 #include "config.h"
+#include "fonts.h"
+#include "resources.h"
+#include "utils.h"
 
-/* Initialize the Greeter & UI */
-App *initialize_app(int argc, char **argv)
+static void select_base_theme(void);
+static void attach_user_picker(gpointer user_data);
+static void handle_idle_changed(gboolean is_idle, gpointer user_data);
+
+
+/* Initialize the Greeter & UI
+ *
+ * The TypeAhead is created by the caller so it can start buffering keys
+ * before GTK is initialized.
+ */
+App *initialize_app(int argc, char **argv, TypeAhead *typeahead)
 {
     
     g_log_set_always_fatal(G_LOG_LEVEL_CRITICAL);
+    // The base theme may be compiled in, so this must be before gtk_init
+    greeter_register_resource();
+    select_base_theme();
+    fonts_use_private_config();
     gtk_init(&argc, &argv);
 
     // Allocate & Initialize
@@ -22,10 +39,20 @@ App *initialize_app(int argc, char **argv)
     }
 
     app->config = initialize_config();
-    app->current_user = app->config->login_user;
+    app->current_user = g_strdup(APP_LOGIN_USER(app));
     app->greeter = lightdm_greeter_new();
-    app->ui = initialize_ui(app->config);
+    app->session_ring = NULL;
+    app->session_prefetch = NULL;
+    app->typeahead = typeahead;
+    app->scheduler = initialize_scheduler();
+    app->wall_clock = initialize_wall_clock();
+    app->ui = initialize_ui(app->config, app->scheduler, app->wall_clock);
     app->state = APP_COVERED;
+    app->idle = NULL;
+    if (app->config->idle_timeout > 0) {
+        app->idle = initialize_idle_monitor((guint) app->config->idle_timeout,
+                                            &handle_idle_changed, app);
+    }
 
     // Connect Greeter & UI Signals
     g_signal_connect(app->greeter, "authentication-complete",
@@ -41,11 +68,7 @@ App *initialize_app(int argc, char **argv)
     // This was added to fix a bug where the background window would be focused
     // instead of the main window, preventing users from entering their password.
     // It's undocument & probably not necessary any more. Investigate & remove.
-    for (int m = 0; m < APP_MONITOR_COUNT(app); m++) {
-        g_signal_connect(GTK_WIDGET(APP_BACKGROUND_WINDOWS(app)[m]),
-                         "key-press-event",
-                         G_CALLBACK(handle_tab_key), app);
-    }
+    ui_connect_background_key_handler(app->ui, G_CALLBACK(handle_tab_key), app);
     g_signal_connect(GTK_WIDGET(APP_MAIN_WINDOW(app)), "key-press-event",
                      G_CALLBACK(handle_hotkeys), app);
                      
@@ -53,10 +76,16 @@ App *initialize_app(int argc, char **argv)
                      G_CALLBACK(handle_cover_uncover), app);
     g_signal_connect(GTK_WIDGET(APP_MAIN_WINDOW(app)), "button-press-event",
                      G_CALLBACK(handle_cover_uncover), app);
+    g_signal_connect(GTK_WIDGET(APP_PASSWORD_INPUT(app)), "focus-in-event",
+                     G_CALLBACK(handle_password_focus), app);
+    if (app->config->user_picker) {
+        scheduler_add(app->scheduler, "user-picker", SCHEDULER_PRIORITY_LOW,
+                      &attach_user_picker, app);
+    }
                      
-    // Update the current time every 15 seconds
+    // Update the current time at the start of every minute
     handle_time_update(app);
-    g_timeout_add_seconds(15, G_SOURCE_FUNC(handle_time_update), app);
+    wall_clock_add(app->wall_clock, "time", 1, &handle_time_update, app);
 
     return app;
 }
@@ -65,7 +94,65 @@ App *initialize_app(int argc, char **argv)
 /* Free any dynamically allocated memory */
 void destroy_app(App *app)
 {
+    if (app->session_prefetch != NULL) {
+        g_cancellable_cancel(app->session_prefetch);
+        g_object_unref(app->session_prefetch);
+    }
+    if (app->idle != NULL) {
+        destroy_idle_monitor(app->idle);
+    }
+    g_free(app->current_user);
     destroy_config(app->config);
-    free(app->ui);
+    destroy_scheduler(app->scheduler);
+    destroy_wall_clock(app->wall_clock);
+    destroy_typeahead(app->typeahead);
+    destroy_ui(app->ui);
     free(app);
 }
+
+
+/* Use the built-in minimal theme instead of the system's GTK theme if
+ * `base-theme` asks for it.
+ *
+ * GTK loads its theme while it is initialized, so the option is read from the
+ * config file directly, before the rest of the config.
+ */
+static void select_base_theme(void)
+{
+    gchar *base_theme = config_peek_string("greeter-theme", "base-theme");
+    if (base_theme == NULL) {
+        return;
+    }
+    remove_char(base_theme, '"');
+    remove_char(base_theme, '\'');
+    g_strstrip(base_theme);
+    if (strcmp(base_theme, "minimal") == 0) {
+        // GTK looks for a built-in theme of this name before any on disk
+        g_setenv("GTK_THEME", "Minimal", TRUE);
+    } else if (strcmp(base_theme, "system") != 0) {
+        g_warning("Invalid base-theme '%s' - falling back to 'system'", base_theme);
+    }
+    g_free(base_theme);
+}
+
+/* Stop all periodic work while nobody is at the screen. The UI is woken
+ * first, so the time is updated in the first redraw.
+ */
+static void handle_idle_changed(gboolean is_idle, gpointer user_data)
+{
+    App *app = (App *) user_data;
+    if (is_idle) {
+        wall_clock_pause(app->wall_clock);
+        ui_set_idle(app->ui, TRUE);
+    } else {
+        ui_set_idle(app->ui, FALSE);
+        wall_clock_resume(app->wall_clock);
+    }
+}
+
+/* Show the list of other users on the login page */
+static void attach_user_picker(gpointer user_data)
+{
+    App *app = (App *) user_data;
+    ui_attach_user_picker(app->ui, &handle_user_picked, app);
+}
@@ -5,7 +5,11 @@
 
 #include "config.h"
 #include "focus_ring.h"
+#include "idle.h"
+#include "scheduler.h"
+#include "typeahead.h"
 #include "ui.h"
+#include "wall_clock.h"
 
 typedef enum AppState_ {
     APP_COVERED,
@@ -17,11 +21,21 @@ typedef struct App_ {
     LightDMGreeter *greeter;
     UI *ui;
     FocusRing *session_ring;
+    Scheduler *scheduler;
+    // Runs the clock & all other periodic work, once a minute
+    WallClock *wall_clock;
+    // Notices when nobody is at the screen, NULL if `idle-timeout` is 0
+    IdleMonitor *idle;
+    // Cancels the running session prefetch, if any
+    GCancellable *session_prefetch;
+    // Keys typed before the password input was focused
+    TypeAhead *typeahead;
 
     // Signal Handler ID for the `handle_password` callback
     gulong password_callback_id;
     gulong button_password_callback_id;
 
+    // The user being authenticated, owned
     gchar* current_user;
 
     AppState state;
@@ -32,15 +46,13 @@ typedef struct App_ {
 } App;
 
 
-App *initialize_app(int argc, char **argv);
+App *initialize_app(int argc, char **argv, TypeAhead *typeahead);
 void destroy_app(App *app);
 
 /* Config Member Accessors */
 #define APP_LOGIN_USER(app)             (app)->config->login_user
 
 /* UI Member Accessors */
-#define APP_BACKGROUND_WINDOWS(app)     (app)->ui->background_windows
-#define APP_MONITOR_COUNT(app)          (app)->ui->monitor_count
 #define APP_MAIN_WINDOW(app)            (app)->ui->main_window
 #define APP_PASSWORD_INPUT(app)         (app)->ui->login_ui->password_input
 #define APP_LOGIN_BUTTON(app)           (app)->ui->login_ui->login_button
@@ -0,0 +1,297 @@
+/* Load User Images on a Worker Thread & Cache Them Rounded */
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "avatar.h"
+#include "utils.h"
+
+// Where the source of a cached image is stored in its PNG text chunks
+#define AVATAR_SOURCE_OPTION "tEXt::source"
+#define AVATAR_MTIME_OPTION "tEXt::mtime"
+
+
+/* The state of an avatar_load_async call, owned by its GTask */
+struct AvatarLoad {
+    gchar          *username;
+    gchar          *cache_path;
+    gint            scale;
+    /* Set by the worker thread */
+    GdkPixbuf      *avatar;
+    gboolean        changed;
+    GCancellable   *cancellable;
+    guint           timeout_id;
+    AvatarReadyFunc func;
+    gpointer        data;
+};
+
+
+static gchar *get_avatar_cache_path(const gchar *username, gint scale);
+static gboolean find_avatar_source(const gchar *username, gchar **path, gint64 *mtime);
+static void run_avatar_load(GTask *task, gpointer source, gpointer task_data,
+                            GCancellable *cancellable);
+static gboolean is_cached_source(GdkPixbuf *cached, const gchar *path, gint64 mtime);
+static GdkPixbuf *render_avatar(struct AvatarLoad *load, gchar *path, gint64 mtime);
+static void finish_avatar_load(GObject *source, GAsyncResult *result, gpointer user_data);
+static gboolean handle_avatar_timeout(gpointer user_data);
+static void free_avatar_load(gpointer data);
+
+
+/* The image rendered for a user & device scale on an earlier start, or NULL.
+ * It is small & on a local disk, so it is loaded right away as a placeholder.
+ */
+GdkPixbuf *avatar_load_cached(const gchar *username, gint scale)
+{
+    gchar *cache_path = get_avatar_cache_path(username, scale);
+    GdkPixbuf *avatar = gdk_pixbuf_new_from_file(cache_path, NULL);
+    g_free(cache_path);
+    return avatar;
+}
+
+/* Load & round a user's image at `scale` device pixels per logical pixel on a
+ * worker thread, unless the cached image was rendered from the same file.
+ *
+ * Home directories may be on a network share, so the load is cancelled if it
+ * takes longer than AVATAR_TIMEOUT_SECONDS. Cancel the returned GCancellable
+ * to drop the result, e.g. when another user is picked.
+ */
+GCancellable *avatar_load_async(const gchar *username, gint scale, AvatarReadyFunc func,
+                                gpointer data)
+{
+    struct AvatarLoad *load = g_new0(struct AvatarLoad, 1);
+    load->username = g_strdup(username);
+    load->cache_path = get_avatar_cache_path(username, scale);
+    load->scale = scale;
+    load->func = func;
+    load->data = data;
+
+    load->cancellable = g_cancellable_new();
+    load->timeout_id = g_timeout_add_seconds(AVATAR_TIMEOUT_SECONDS,
+                                             &handle_avatar_timeout, load);
+    GTask *task = g_task_new(NULL, load->cancellable, &finish_avatar_load, NULL);
+    g_task_set_task_data(task, load, &free_avatar_load);
+    g_task_run_in_thread(task, &run_avatar_load);
+    g_object_unref(task);
+    return g_object_ref(load->cancellable);
+}
+
+/* Crop an image to a circle with an outline. The outline is as thick as at
+ * AVATAR_SIZE, relative to `size`, so HiDPI images look the same.
+ */
+GdkPixbuf *avatar_round(GdkPixbuf *source, int size)
+{
+    const double tau = 2 * G_PI;
+    const double line_scale = (double) size / AVATAR_SIZE;
+
+    const int center = size / 2;
+    const int source_width = gdk_pixbuf_get_width(source);
+    const int source_height = gdk_pixbuf_get_height(source);
+
+    GdkPixbuf* dest = NULL;
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    cairo_t* cr = cairo_create(surface);
+
+    // draw the background color
+    cairo_set_source_rgb(cr, 0.106, 0.113, 0.117);
+    cairo_arc(cr, center, center, center, 0, tau);
+    cairo_fill(cr);
+
+    // draw the image
+    gdk_cairo_set_source_pixbuf(cr, source, center - (source_width / 2), center - (source_height / 2));
+
+    cairo_arc(cr, center, center, center, 0, tau);
+    cairo_fill(cr);
+
+    // draw the outline
+    cairo_arc(cr, center, center, center - 0.6 * line_scale, 0, tau);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, 1.6 * line_scale);
+
+    cairo_stroke(cr);
+
+    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
+    cairo_surface_destroy(surface);
+    cairo_destroy(cr);
+
+    return dest;
+}
+
+
+/* The image shown for users without one: a silhouette drawn at `scale`
+ * device pixels per logical pixel, framed like a user image.
+ */
+GdkPixbuf *avatar_render_default(gint scale)
+{
+    const int size = AVATAR_SIZE * scale;
+    const double center = size / 2.0;
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    cairo_t* cr = cairo_create(surface);
+    cairo_set_source_rgb(cr, 0.745, 0.745, 0.745);
+
+    // the head
+    cairo_arc(cr, center, size * 0.38, size * 0.16, 0, 2 * G_PI);
+    cairo_fill(cr);
+
+    // the shoulders, cut off by the frame
+    cairo_arc(cr, center, size * 0.92, size * 0.32, G_PI, 2 * G_PI);
+    cairo_close_path(cr);
+    cairo_fill(cr);
+
+    cairo_destroy(cr);
+    GdkPixbuf *silhouette = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
+    cairo_surface_destroy(surface);
+
+    GdkPixbuf *framed_image = avatar_round(silhouette, size);
+    g_object_unref(silhouette);
+    return framed_image;
+}
+
+
+/* Cached images are named by a hash, since user names are not file names, &
+ * keep one file per device scale, like `avatar-<hash>@2x.png`.
+ */
+static gchar *get_avatar_cache_path(const gchar *username, gint scale)
+{
+    gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, username, -1);
+    gchar *filename = scale > 1 ? g_strdup_printf("avatar-%s@%dx.png", checksum, scale)
+                                : g_strdup_printf("avatar-%s.png", checksum);
+    gchar *cache_path = get_cache_path(filename);
+    g_free(filename);
+    g_free(checksum);
+    return cache_path;
+}
+
+/* Find the user's `~/.face`, or the image LightDM ships for them */
+static gboolean find_avatar_source(const gchar *username, gchar **path, gint64 *mtime)
+{
+    gchar *candidates[] = {
+        g_build_filename("/home", username, ".face", NULL),
+        g_build_filename("/usr/share/lightdm/users", username, NULL),
+    };
+    *path = NULL;
+    *mtime = 0;
+    for (guint c = 0; c < G_N_ELEMENTS(candidates); c++) {
+        GStatBuf file_stat;
+        if (*path == NULL && g_stat(candidates[c], &file_stat) == 0 &&
+                S_ISREG(file_stat.st_mode)) {
+            *path = candidates[c];
+            *mtime = (gint64) file_stat.st_mtime;
+        } else {
+            g_free(candidates[c]);
+        }
+    }
+    return *path != NULL;
+}
+
+/* Runs on a worker thread */
+static void run_avatar_load(GTask *task, gpointer source, gpointer task_data,
+                            GCancellable *cancellable)
+{
+    struct AvatarLoad *load = (struct AvatarLoad *) task_data;
+    GdkPixbuf *cached = gdk_pixbuf_new_from_file(load->cache_path, NULL);
+    gchar *path;
+    gint64 mtime;
+    gboolean found = find_avatar_source(load->username, &path, &mtime);
+
+    if (!found) {
+        // The user removed their image, forget the cached one
+        load->changed = cached != NULL;
+        g_unlink(load->cache_path);
+    } else if (cached != NULL && is_cached_source(cached, path, mtime)) {
+        load->changed = FALSE;
+    } else if (!g_cancellable_is_cancelled(cancellable)) {
+        load->avatar = render_avatar(load, path, mtime);
+        load->changed = load->avatar != NULL || cached != NULL;
+    }
+
+    if (cached != NULL) {
+        g_object_unref(cached);
+    }
+    g_free(path);
+    g_task_return_boolean(task, TRUE);
+}
+
+/* Whether a cached image was rendered from this version of a file */
+static gboolean is_cached_source(GdkPixbuf *cached, const gchar *path, gint64 mtime)
+{
+    const gchar *cached_path = gdk_pixbuf_get_option(cached, AVATAR_SOURCE_OPTION);
+    const gchar *cached_mtime = gdk_pixbuf_get_option(cached, AVATAR_MTIME_OPTION);
+    return g_strcmp0(cached_path, path) == 0 && cached_mtime != NULL &&
+        g_ascii_strtoll(cached_mtime, NULL, 10) == mtime;
+}
+
+/* Decode an image at the device size it is shown at, round it, & cache the
+ * result
+ */
+static GdkPixbuf *render_avatar(struct AvatarLoad *load, gchar *path, gint64 mtime)
+{
+    const gint size = AVATAR_SIZE * load->scale;
+    GError *error = NULL;
+    GdkPixbuf *image = load_image_to_cover(path, size, size, &error);
+    if (image == NULL) {
+        g_warning("Could not load the user image %s: %s", path, error->message);
+        g_error_free(error);
+        g_unlink(load->cache_path);
+        return NULL;
+    }
+    GdkPixbuf *avatar = avatar_round(image, size);
+    g_object_unref(image);
+
+    // Written aside & renamed, so a crash never leaves half an image
+    gchar *mtime_text = g_strdup_printf("%" G_GINT64_FORMAT, mtime);
+    gchar *temporary_path = g_strconcat(load->cache_path, ".tmp", NULL);
+    if (!gdk_pixbuf_save(avatar, temporary_path, "png", &error,
+                         AVATAR_SOURCE_OPTION, path, AVATAR_MTIME_OPTION, mtime_text, NULL) ||
+            g_rename(temporary_path, load->cache_path) != 0) {
+        g_warning("Could not cache the user image %s: %s", load->cache_path,
+                  error == NULL ? "rename failed" : error->message);
+        g_clear_error(&error);
+        g_unlink(temporary_path);
+    }
+    g_free(temporary_path);
+    g_free(mtime_text);
+    return avatar;
+}
+
+/* Runs on the main thread */
+static void finish_avatar_load(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    struct AvatarLoad *load = g_task_get_task_data(G_TASK(result));
+    if (load->timeout_id != 0) {
+        g_source_remove(load->timeout_id);
+        load->timeout_id = 0;
+    }
+    GError *error = NULL;
+    if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+        g_message("Dropped the user image of %s: %s", load->username, error->message);
+        g_error_free(error);
+        return;
+    }
+    if (load->changed) {
+        load->func(load->username, load->avatar, load->data);
+    }
+}
+
+static gboolean handle_avatar_timeout(gpointer user_data)
+{
+    struct AvatarLoad *load = (struct AvatarLoad *) user_data;
+    g_message("Loading the user image of %s timed out", load->username);
+    load->timeout_id = 0;
+    g_cancellable_cancel(load->cancellable);
+    return G_SOURCE_REMOVE;
+}
+
+static void free_avatar_load(gpointer data)
+{
+    struct AvatarLoad *load = (struct AvatarLoad *) data;
+    if (load->avatar != NULL) {
+        g_object_unref(load->avatar);
+    }
+    g_object_unref(load->cancellable);
+    g_free(load->username);
+    g_free(load->cache_path);
+    g_free(load);
+}
@@ -0,0 +1,26 @@
+#ifndef AVATAR_H
+#define AVATAR_H
+
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+// The width & height of a user image, in logical pixels
+#define AVATAR_SIZE 130
+// How long to wait for a user image before giving up on it
+#define AVATAR_TIMEOUT_SECONDS 5
+
+
+/* Called with the loaded image, or NULL if the user has no image anymore &
+ * the default image should be shown. Not called if the cached image is still
+ * up to date.
+ */
+typedef void (*AvatarReadyFunc)(const gchar *username, GdkPixbuf *avatar, gpointer data);
+
+
+GdkPixbuf *avatar_load_cached(const gchar *username, gint scale);
+GCancellable *avatar_load_async(const gchar *username, gint scale, AvatarReadyFunc func,
+                                gpointer data);
+GdkPixbuf *avatar_round(GdkPixbuf *source, int size);
+GdkPixbuf *avatar_render_default(gint scale);
+
+#endif
@@ -0,0 +1,555 @@
+/* Decode, Scale & Blur Wallpapers for Each Monitor Geometry */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <math.h>
+
+#include <gtk/gtk.h>
+
+#include "background.h"
+#include "memory_usage.h"
+#include "utils.h"
+
+// Radius of the blur applied to the login page's background
+#define BACKGROUND_BLUR_RADIUS 25
+// How much smaller blurred images are kept when the cache is compact
+#define BACKGROUND_COMPACT_BLUR_SCALE 4
+
+
+/* The state of a background_cache_prepare call, owned by its GTask */
+struct PreparedBackground {
+    BackgroundCache    *cache;
+    gchar              *path;
+    GArray             *requests;
+    /* The rendered BackgroundSets, filled by the worker thread */
+    GPtrArray          *sets;
+    gboolean            compact;
+    BackgroundReadyFunc func;
+    gpointer            data;
+};
+
+
+static gchar *get_set_key(const gchar *path, gint width, gint height);
+static BackgroundSet *render_background_set(const gchar *path, gint width, gint height);
+static void blur_background_set(BackgroundSet *set, gboolean compact);
+static void compact_background_set(BackgroundSet *set);
+static cairo_surface_t *render_surface(GdkPixbuf *pixbuf, gint width, gint height,
+                                       gdouble x, gdouble y);
+static void insert_background_set(BackgroundCache *cache, gchar *key, BackgroundSet *set);
+static void count_set(BackgroundCache *cache, BackgroundSet *set);
+static void uncount_set(BackgroundCache *cache, BackgroundSet *set);
+static gsize get_set_size(BackgroundSet *set);
+static gsize get_surface_size(cairo_surface_t *surface);
+static void free_background_set(gpointer data);
+static void run_prepare(GTask *task, gpointer source, gpointer task_data,
+                        GCancellable *cancellable);
+static void finish_prepare(GObject *source, GAsyncResult *result, gpointer user_data);
+static void free_prepared_background(gpointer data);
+static void blur_pixbuf(GdkPixbuf *buf, int radius);
+
+
+/* Create an empty cache that holds about `budget` bytes of pixels */
+BackgroundCache *initialize_background_cache(gsize budget)
+{
+    BackgroundCache *cache = malloc(sizeof(BackgroundCache));
+    if (cache == NULL) {
+        g_error("Could not allocate memory for BackgroundCache");
+    }
+    cache->sets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        &free_background_set);
+    cache->lru = g_queue_new();
+    cache->size = 0;
+    cache->budget = budget;
+    cache->compact = FALSE;
+    cache->preparing = FALSE;
+    return cache;
+}
+
+void destroy_background_cache(BackgroundCache *cache)
+{
+    GHashTableIter iter;
+    gpointer set;
+    g_hash_table_iter_init(&iter, cache->sets);
+    while (g_hash_table_iter_next(&iter, NULL, &set)) {
+        uncount_set(cache, set);
+    }
+    g_queue_free(cache->lru);
+    g_hash_table_destroy(cache->sets);
+    free(cache);
+}
+
+
+/* Get an image rendered for a geometry, decoding it on this thread if it has
+ * not been rendered or prepared yet. Returns NULL if `path` is NULL.
+ *
+ * A failed decode is cached too, as a set without a `cover`, so an unreadable
+ * image is not retried on every draw.
+ */
+BackgroundSet *background_cache_get(BackgroundCache *cache, const gchar *path,
+                                    gint width, gint height)
+{
+    BackgroundSet *set = background_cache_lookup(cache, path, width, height);
+    if (set != NULL || path == NULL || width <= 0 || height <= 0) {
+        return set;
+    }
+
+    set = render_background_set(path, width, height);
+    insert_background_set(cache, get_set_key(path, width, height), set);
+    return set;
+}
+
+/* Get an image rendered for a geometry, or NULL if it is not in the cache.
+ * Never decodes, so it is safe to call while drawing a frame of a fade.
+ */
+BackgroundSet *background_cache_lookup(BackgroundCache *cache, const gchar *path,
+                                       gint width, gint height)
+{
+    if (path == NULL || width <= 0 || height <= 0) {
+        return NULL;
+    }
+
+    gchar *key = get_set_key(path, width, height);
+    gpointer stored_key, set;
+    gboolean found = g_hash_table_lookup_extended(cache->sets, key, &stored_key, &set);
+    g_free(key);
+    if (!found) {
+        return NULL;
+    }
+    g_queue_remove(cache->lru, stored_key);
+    g_queue_push_head(cache->lru, stored_key);
+    return (BackgroundSet *) set;
+}
+
+/* Determine if an image is rendered for a geometry, without rendering it */
+gboolean background_cache_contains(BackgroundCache *cache, const gchar *path,
+                                   gint width, gint height)
+{
+    gchar *key = get_set_key(path, width, height);
+    gboolean contains = g_hash_table_contains(cache->sets, key);
+    g_free(key);
+    return contains;
+}
+
+
+/* Decode, scale & optionally blur an image for each requested geometry on a
+ * worker thread, then add the results to the cache & call `func` on the main
+ * thread.
+ *
+ * Only one image is prepared at a time; if another is being prepared, nothing
+ * is done & `func` is not called.
+ */
+void background_cache_prepare(BackgroundCache *cache, const gchar *path,
+                              GArray *requests, BackgroundReadyFunc func,
+                              gpointer data)
+{
+    if (cache->preparing || path == NULL) {
+        return;
+    }
+    cache->preparing = TRUE;
+
+    struct PreparedBackground *prepared = malloc(sizeof(struct PreparedBackground));
+    if (prepared == NULL) {
+        g_error("Could not allocate memory for PreparedBackground");
+    }
+    prepared->cache = cache;
+    prepared->path = g_strdup(path);
+    prepared->requests = g_array_ref(requests);
+    prepared->sets = g_ptr_array_new();
+    prepared->compact = cache->compact;
+    prepared->func = func;
+    prepared->data = data;
+
+    GTask *task = g_task_new(NULL, NULL, &finish_prepare, prepared);
+    g_task_set_task_data(task, prepared, NULL);
+    g_task_run_in_thread(task, &run_prepare);
+    g_object_unref(task);
+}
+
+
+/* Drop the least recently used sets until the cache fits in its budget.
+ *
+ * Sets for any of the NULL-terminated `keep_paths` are never dropped, since
+ * they are being shown or are about to be.
+ */
+void background_cache_trim(BackgroundCache *cache, const gchar * const *keep_paths)
+{
+    GList *link = cache->lru->tail;
+    while (cache->size > cache->budget && link != NULL) {
+        GList *previous = link->prev;
+        gchar *key = (gchar *) link->data;
+        BackgroundSet *set = g_hash_table_lookup(cache->sets, key);
+        if (!g_strv_contains(keep_paths, set->path)) {
+            g_message("Dropping cached background %s", key);
+            uncount_set(cache, set);
+            g_queue_delete_link(cache->lru, link);
+            g_hash_table_remove(cache->sets, key);
+        }
+        link = previous;
+    }
+}
+
+
+/* Drop every set except the ones for `keep_paths`, whatever the budget, e.g.
+ * while nobody is at the screen to see the others.
+ */
+void background_cache_release(BackgroundCache *cache, const gchar * const *keep_paths)
+{
+    const gsize budget = cache->budget;
+    cache->budget = 0;
+    background_cache_trim(cache, keep_paths);
+    cache->budget = budget;
+}
+
+
+/* Blur the visible part of a set's cover, if that has not been done yet */
+void background_set_blur(BackgroundCache *cache, BackgroundSet *set)
+{
+    if (set->cover == NULL || set->blurred != NULL) {
+        return;
+    }
+    uncount_set(cache, set);
+    blur_background_set(set, cache->compact);
+    count_set(cache, set);
+}
+
+
+/* Keep as little as possible from now on: blurred images at a fraction of
+ * their size, & only the images that background_cache_trim is told to keep.
+ *
+ * Sets are replaced in place, so pointers to their surfaces must be re-read.
+ */
+void background_cache_compact(BackgroundCache *cache)
+{
+    cache->compact = TRUE;
+    cache->budget = 0;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, cache->sets);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        BackgroundSet *set = (BackgroundSet *) value;
+        uncount_set(cache, set);
+        compact_background_set(set);
+        count_set(cache, set);
+    }
+}
+
+
+static gchar *get_set_key(const gchar *path, gint width, gint height)
+{
+    return g_strdup_printf("%s@%dx%d", path, width, height);
+}
+
+/* Decode & scale an image to cover a geometry, & convert the part of it that
+ * is visible into a surface. Safe to call from any thread.
+ */
+static BackgroundSet *render_background_set(const gchar *path, gint width, gint height)
+{
+    BackgroundSet *set = malloc(sizeof(BackgroundSet));
+    if (set == NULL) {
+        g_error("Could not allocate memory for BackgroundSet");
+    }
+    set->path = g_strdup(path);
+    set->width = width;
+    set->height = height;
+    set->cover = NULL;
+    set->blurred = NULL;
+    set->blurred_scale = 1;
+
+    GError *error = NULL;
+    GdkPixbuf *cover = load_image_to_cover(set->path, (guint) width, (guint) height, &error);
+    if (error == NULL) {
+        // Offset to center the image
+        gdouble x = -((gdk_pixbuf_get_width(cover) / 2) - (width / 2));
+        gdouble y = -((gdk_pixbuf_get_height(cover) / 2) - (height / 2));
+        set->cover = render_surface(cover, width, height, x, y);
+        g_object_unref(cover);
+    } else {
+        g_warning("[GREETER] error loading background: %s\n", error->message);
+        g_error_free(error);
+    }
+    return set;
+}
+
+/* Blur the cover. When `compact`, it is downsampled first & blurred with a
+ * smaller radius, which looks the same once scaled up.
+ */
+static void blur_background_set(BackgroundSet *set, gboolean compact)
+{
+    if (set->cover == NULL || set->blurred != NULL) {
+        return;
+    }
+    const int width = set->width;
+    const int height = set->height;
+
+    // The blur works on RGB pixels, without an alpha channel
+    GdkPixbuf *visible = gdk_pixbuf_get_from_surface(set->cover, 0, 0, width, height);
+    GdkPixbuf *blurred = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+    gdk_pixbuf_copy_area(visible, 0, 0, width, height, blurred, 0, 0);
+    g_object_unref(visible);
+    if (compact) {
+        GdkPixbuf *downsampled = gdk_pixbuf_scale_simple(
+            blurred,
+            MAX(1, width / BACKGROUND_COMPACT_BLUR_SCALE),
+            MAX(1, height / BACKGROUND_COMPACT_BLUR_SCALE),
+            GDK_INTERP_BILINEAR);
+        g_object_unref(blurred);
+        blurred = downsampled;
+        set->blurred_scale = BACKGROUND_COMPACT_BLUR_SCALE;
+        blur_pixbuf(blurred, BACKGROUND_BLUR_RADIUS / BACKGROUND_COMPACT_BLUR_SCALE);
+    } else {
+        blur_pixbuf(blurred, BACKGROUND_BLUR_RADIUS);
+    }
+    set->blurred = render_surface(blurred, gdk_pixbuf_get_width(blurred),
+                                  gdk_pixbuf_get_height(blurred), 0, 0);
+    g_object_unref(blurred);
+}
+
+/* Downsample the blur of an already rendered set */
+static void compact_background_set(BackgroundSet *set)
+{
+    if (set->blurred == NULL || set->blurred_scale >= BACKGROUND_COMPACT_BLUR_SCALE) {
+        return;
+    }
+    const int width = MAX(1, set->width / BACKGROUND_COMPACT_BLUR_SCALE);
+    const int height = MAX(1, set->height / BACKGROUND_COMPACT_BLUR_SCALE);
+    cairo_surface_t *downsampled = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    cairo_t *cr = cairo_create(downsampled);
+    cairo_scale(cr, (gdouble) width / cairo_image_surface_get_width(set->blurred),
+                (gdouble) height / cairo_image_surface_get_height(set->blurred));
+    cairo_set_source_surface(cr, set->blurred, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(set->blurred);
+    set->blurred = downsampled;
+    set->blurred_scale = BACKGROUND_COMPACT_BLUR_SCALE;
+}
+
+/* Convert a pixbuf, placed at an offset, into a surface of the given size */
+static cairo_surface_t *render_surface(GdkPixbuf *pixbuf, gint width, gint height,
+                                       gdouble x, gdouble y)
+{
+    cairo_surface_t *surface = cairo_image_surface_create(
+        gdk_pixbuf_get_has_alpha(pixbuf) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+        width, height);
+    cairo_t *cr = cairo_create(surface);
+    gdk_cairo_set_source_pixbuf(cr, pixbuf, x, y);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    return surface;
+}
+
+/* Add a set as the most recently used one. Takes ownership of `key`. */
+static void insert_background_set(BackgroundCache *cache, gchar *key, BackgroundSet *set)
+{
+    g_hash_table_insert(cache->sets, key, set);
+    g_queue_push_head(cache->lru, key);
+    count_set(cache, set);
+}
+
+/* Add a set's pixels to the cache's size & the memory report */
+static void count_set(BackgroundCache *cache, BackgroundSet *set)
+{
+    cache->size += get_set_size(set);
+    memory_usage_add_bytes(MEMORY_OWNER_WALLPAPER, get_surface_size(set->cover));
+    memory_usage_add_bytes(MEMORY_OWNER_WALLPAPER_BLUR, get_surface_size(set->blurred));
+}
+
+static void uncount_set(BackgroundCache *cache, BackgroundSet *set)
+{
+    cache->size -= get_set_size(set);
+    memory_usage_remove_bytes(MEMORY_OWNER_WALLPAPER, get_surface_size(set->cover));
+    memory_usage_remove_bytes(MEMORY_OWNER_WALLPAPER_BLUR, get_surface_size(set->blurred));
+}
+
+/* The number of bytes of pixel data held by a set */
+static gsize get_set_size(BackgroundSet *set)
+{
+    return get_surface_size(set->cover) + get_surface_size(set->blurred);
+}
+
+static gsize get_surface_size(cairo_surface_t *surface)
+{
+    if (surface == NULL) {
+        return 0;
+    }
+    return (gsize) cairo_image_surface_get_stride(surface) *
+           (gsize) cairo_image_surface_get_height(surface);
+}
+
+static void free_background_set(gpointer data)
+{
+    BackgroundSet *set = (BackgroundSet *) data;
+    g_clear_pointer(&set->cover, cairo_surface_destroy);
+    g_clear_pointer(&set->blurred, cairo_surface_destroy);
+    g_free(set->path);
+    free(set);
+}
+
+
+/* Render every requested geometry on a GTask worker thread */
+static void run_prepare(GTask *task, gpointer source, gpointer task_data,
+                        GCancellable *cancellable)
+{
+    struct PreparedBackground *prepared = (struct PreparedBackground *) task_data;
+    for (guint r = 0; r < prepared->requests->len; r++) {
+        BackgroundRequest *request =
+            &g_array_index(prepared->requests, BackgroundRequest, r);
+        BackgroundSet *set = render_background_set(prepared->path, request->width,
+                                                   request->height);
+        if (request->blur) {
+            blur_background_set(set, prepared->compact);
+        }
+        g_ptr_array_add(prepared->sets, set);
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+/* Move the rendered sets into the cache on the main thread.
+ *
+ * If a geometry was rendered on the main thread in the meantime, the existing
+ * set is kept, since it may be on screen, & only gains the blurred image.
+ */
+static void finish_prepare(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    struct PreparedBackground *prepared = (struct PreparedBackground *) user_data;
+    BackgroundCache *cache = prepared->cache;
+
+    for (guint s = 0; s < prepared->sets->len; s++) {
+        BackgroundSet *set = g_ptr_array_index(prepared->sets, s);
+        if (cache->compact && !prepared->compact) {
+            // The cache was compacted while this was being rendered
+            compact_background_set(set);
+        }
+        gchar *key = get_set_key(set->path, set->width, set->height);
+        BackgroundSet *existing = g_hash_table_lookup(cache->sets, key);
+        if (existing == NULL) {
+            insert_background_set(cache, key, set);
+            continue;
+        }
+        if (existing->blurred == NULL && set->blurred != NULL) {
+            uncount_set(cache, existing);
+            existing->blurred = g_steal_pointer(&set->blurred);
+            existing->blurred_scale = set->blurred_scale;
+            count_set(cache, existing);
+        }
+        free_background_set(set);
+        g_free(key);
+    }
+    cache->preparing = FALSE;
+
+    prepared->func(prepared->path, prepared->data);
+    free_prepared_background(prepared);
+}
+
+static void free_prepared_background(gpointer data)
+{
+    struct PreparedBackground *prepared = (struct PreparedBackground *) data;
+    g_array_unref(prepared->requests);
+    g_ptr_array_free(prepared->sets, TRUE);
+    g_free(prepared->path);
+    free(prepared);
+}
+
+/**
+ * Apply Gaussian Blur to a GdkPixBuf.
+ * Edges are treated as if a mirrored image was off to each side.
+*/
+static void blur_pixbuf(GdkPixbuf *buf, int radius)
+{
+    GdkPixbuf *dest = gdk_pixbuf_copy(buf);
+
+    int width = gdk_pixbuf_get_width(buf);
+    int height = gdk_pixbuf_get_height(buf);
+    int stride = gdk_pixbuf_get_rowstride(buf);
+    int num_channels = gdk_pixbuf_get_n_channels(buf);
+
+    guchar *src_data = gdk_pixbuf_get_pixels(buf);
+    guchar *dst_data = gdk_pixbuf_get_pixels(dest);
+
+    g_assert(num_channels == 3);
+    g_assert(gdk_pixbuf_get_bits_per_sample(buf) == 8);
+
+    float sigma = (float)radius / 2.0f;
+    sigma = MAX(sigma, 1.0f);
+
+    // Kernel setup
+    const int kernel_width = (2*radius) + 1;
+    float kernel[kernel_width];
+    float kernel_sum = 0;
+
+    // populate kernel
+    for (int k = -radius; k < radius; k++) {
+        float e_numerator = (float) -(k*k);
+        float e_denominator = 2.0f * sigma*sigma;
+        float e_term = expf(e_numerator / e_denominator);
+
+        float kernel_value = e_term / (2.0f * M_PIf * sigma*sigma);
+        kernel[k + radius] = kernel_value;
+        kernel_sum += kernel_value;
+    }
+    // normalize kernel
+    for (int k = 0; k < kernel_width; k++) {
+        kernel[k] /= kernel_sum;
+    }
+
+    // Horizontal blur
+    for (int y = 0; y < (height); y++) {
+        for (int x = 0; x < (width); x++) {
+            guchar *dst_pixel = dst_data + y * stride + x * num_channels;
+
+            float r, g, b;
+            r = g = b = 0.0f;
+
+            for (int k = -radius; k < radius; k++) {
+                int src_x = x + k;
+                if (src_x < 0) {
+                    src_x = -src_x + 1;
+                } else if (src_x >= width) {
+                    src_x = width - (width - src_x);
+                }
+                float kernel_value = kernel[k + radius];
+                guchar *src_pixel = src_data + (y * stride) + (src_x * num_channels);
+
+                r += src_pixel[0] * kernel_value;
+                g += src_pixel[1] * kernel_value;
+                b += src_pixel[2] * kernel_value;
+            }
+
+            dst_pixel[0] = (guchar) r;
+            dst_pixel[1] = (guchar) g;
+            dst_pixel[2] = (guchar) b;
+        }
+    }
+
+    // vertical blur
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            guchar *dst_pixel = src_data + y * stride + x * num_channels;
+
+            float r, g, b;
+            r = g = b = 0.0f;
+
+            for (int k = -radius; k < radius; k++) {
+                int src_y = y + k;
+                if (src_y < 0) {
+                    src_y = -src_y + 1;
+                } else if (src_y >= height) {
+                    src_y = height - (height - src_y);
+                }
+
+                    float kernel_value = kernel[k + radius];
+                    guchar *src_pixel = dst_data + (src_y * stride) + (x * num_channels);
+
+                    r += src_pixel[0] * kernel_value;
+                    g += src_pixel[1] * kernel_value;
+                    b += src_pixel[2] * kernel_value;
+            }
+
+            dst_pixel[0] = (guchar) r;
+            dst_pixel[1] = (guchar) g;
+            dst_pixel[2] = (guchar) b;
+        }
+    }
+    
+   g_object_unref(dest);
+}
@@ -0,0 +1,68 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <gtk/gtk.h>
+
+
+/* A wallpaper rendered for a single monitor geometry, as image surfaces so
+ * drawing it is a copy
+ */
+typedef struct BackgroundSet_ {
+    gchar           *path;
+    gint             width;
+    gint             height;
+    /* Scaled to cover the geometry, centered & cropped to it, or NULL if the
+     * image could not be loaded */
+    cairo_surface_t *cover;
+    /* `cover`, blurred. NULL until it is requested */
+    cairo_surface_t *blurred;
+    /* How much `blurred` must be scaled up to fill the geometry */
+    gint             blurred_scale;
+} BackgroundSet;
+
+/* Rendered wallpapers, kept for every image & geometry they were needed at,
+ * so reconnecting a known monitor or showing a prepared image is free.
+ *
+ * The least recently used sets are dropped once the pixel data exceeds
+ * `budget` bytes, except for the images passed to background_cache_trim.
+ */
+typedef struct BackgroundCache_ {
+    /* "path@WxH" -> BackgroundSet */
+    GHashTable *sets;
+    /* Keys of `sets`, most recently used first */
+    GQueue     *lru;
+    gsize       size;
+    gsize       budget;
+    /* Whether to keep downsampled blurs, to save memory */
+    gboolean    compact;
+    /* Whether a worker thread is running background_cache_prepare */
+    gboolean    preparing;
+} BackgroundCache;
+
+/* A geometry to prepare an image for */
+typedef struct BackgroundRequest_ {
+    gint     width;
+    gint     height;
+    gboolean blur;
+} BackgroundRequest;
+
+typedef void (*BackgroundReadyFunc)(const gchar *path, gpointer data);
+
+
+BackgroundCache *initialize_background_cache(gsize budget);
+void destroy_background_cache(BackgroundCache *cache);
+BackgroundSet *background_cache_get(BackgroundCache *cache, const gchar *path,
+                                    gint width, gint height);
+BackgroundSet *background_cache_lookup(BackgroundCache *cache, const gchar *path,
+                                       gint width, gint height);
+gboolean background_cache_contains(BackgroundCache *cache, const gchar *path,
+                                   gint width, gint height);
+void background_cache_prepare(BackgroundCache *cache, const gchar *path,
+                              GArray *requests, BackgroundReadyFunc func,
+                              gpointer data);
+void background_cache_trim(BackgroundCache *cache, const gchar * const *keep_paths);
+void background_cache_release(BackgroundCache *cache, const gchar * const *keep_paths);
+void background_set_blur(BackgroundCache *cache, BackgroundSet *set);
+void background_cache_compact(BackgroundCache *cache);
+
+#endif
@@ -1,250 +1,284 @@
-#include "battery.h"
-
+/* Show the Battery's Charge, Loading UPower Only on Machines With a Battery */
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+
+#include <glib-unix.h>
+#include <gmodule.h>
 #include <upower.h>
 
-enum PowerType {
-    POWER_LINE,
-    POWER_BATTERY,
-    POWER_BATTERY_CHARGING,
-};
+#include "battery.h"
+#include "icons.h"
 
-struct PowerStats {
-    enum PowerType type;
-    double charge;
-};
+// Loaded at runtime, so machines without a battery never load UPower
+#define BATTERY_UPOWER_LIBRARY "libupower-glib.so.3"
+#define BATTERY_POWER_SUPPLY_DIR "/sys/class/power_supply"
+// The multicast group the kernel sends device events to
+#define BATTERY_UEVENT_GROUP 1
+#define BATTERY_UEVENT_BUFFER_SIZE 4096
+
+typedef UpClient* (*UpClientNewFullFunc)(GCancellable* cancellable, GError** error);
+typedef UpDevice* (*UpClientGetDisplayDeviceFunc)(UpClient* client);
 
 struct BatteryWidgetInfo {
-    GdkPixbuf* outline;
-    GdkPixbuf* charger;
-    double battery_level;
-    gboolean is_charging;
+    // UPower's display device, which combines every battery. NULL until a
+    // battery is found.
+    UpClient* client;
+    UpDevice* device;
+    // Kernel device events, followed while there is no battery
+    int uevent_socket;
+    guint uevent_watch_id;
+    // The glyph shown, ICON_NONE while there is no battery
+    IconGlyph glyph;
     GtkWidget* widget;
 };
 
 
-static gboolean power_devices(struct PowerStats* stats);
-static gboolean update_battery_status(struct BatteryWidgetInfo* info);
+static gboolean has_system_battery(void);
+static gboolean load_upower(UpClientNewFullFunc* client_new_full,
+                            UpClientGetDisplayDeviceFunc* client_get_display_device);
+static void connect_upower(struct BatteryWidgetInfo* info);
+static void watch_power_supplies(struct BatteryWidgetInfo* info);
+static gboolean handle_uevents(gint fd, GIOCondition condition, gpointer user_data);
+static gboolean is_power_supply_added(const gchar* uevent, gsize length);
+static void stop_watching_power_supplies(struct BatteryWidgetInfo* info);
+static gboolean read_battery_status(struct BatteryWidgetInfo* info);
+static void handle_battery_changed(GObject* device, GParamSpec* pspec, gpointer user_data);
+static void free_battery_widget_info(GtkWidget* widget, gpointer user_data);
 
 
-static gboolean power_devices(struct PowerStats* stats)
+/* Whether the kernel knows of a battery that powers the machine, as opposed
+ * to the battery of a mouse or keyboard.
+ */
+static gboolean has_system_battery(void)
 {
-    GError* error = NULL;
-    UpClient* client = up_client_new_full(NULL, &error);
-    if  (error != NULL) {
-        g_warning("Could not get UPower client: %s\n", error->message);
+    GDir* dir = g_dir_open(BATTERY_POWER_SUPPLY_DIR, 0, NULL);
+    if (dir == NULL) {
         return FALSE;
     }
-
-    GPtrArray* devices = up_client_get_devices2(client);
-    if (devices == NULL) return FALSE;
-
-    gboolean is_charging = FALSE;
-    gboolean has_battery = FALSE;
-
-    double charge_percent = 100;
-    for(guint i = 0; i < devices->len; i++) {
-        UpDevice* device = (UpDevice*) devices->pdata[i];
-        guint kind;
-        g_object_get(G_OBJECT(device), "kind", &kind, NULL);
-
-        UpDeviceKind device_kind = kind;
-        if (device_kind == UP_DEVICE_KIND_BATTERY) {
-            guint state;
-            g_object_get(G_OBJECT(device), "state", &state, NULL);
-            UpDeviceState device_state = state;
-            if (device_state == UP_DEVICE_STATE_CHARGING) {
-                is_charging = TRUE;
-            }
-            has_battery = TRUE;
-            g_object_get(G_OBJECT(device), "percentage", &charge_percent, NULL);
+    gboolean found = FALSE;
+    const gchar* name;
+    while (!found && (name = g_dir_read_name(dir)) != NULL) {
+        gchar* type_path = g_build_filename(BATTERY_POWER_SUPPLY_DIR, name, "type", NULL);
+        gchar* scope_path = g_build_filename(BATTERY_POWER_SUPPLY_DIR, name, "scope", NULL);
+        gchar* type = NULL;
+        gchar* scope = NULL;
+        if (g_file_get_contents(type_path, &type, NULL, NULL)) {
+            g_file_get_contents(scope_path, &scope, NULL, NULL);
+            found = g_strcmp0(g_strstrip(type), "Battery") == 0 &&
+                (scope == NULL || g_strcmp0(g_strstrip(scope), "Device") != 0);
         }
+        g_free(type);
+        g_free(scope);
+        g_free(type_path);
+        g_free(scope_path);
     }
+    g_dir_close(dir);
+    return found;
+}
 
-    g_ptr_array_unref(devices);
-
-    enum PowerType type = POWER_LINE;
-    if (has_battery) {
-        type = is_charging ? POWER_BATTERY_CHARGING : POWER_BATTERY;
+/* Open libupower-glib & look up the functions the icon needs. The library
+ * stays loaded once it is opened.
+ */
+static gboolean load_upower(UpClientNewFullFunc* client_new_full,
+                            UpClientGetDisplayDeviceFunc* client_get_display_device)
+{
+    GModule* upower = g_module_open(BATTERY_UPOWER_LIBRARY, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+    if (upower == NULL) {
+        g_warning("Could not load %s: %s", BATTERY_UPOWER_LIBRARY, g_module_error());
+        return FALSE;
     }
-
-    stats->type = type;
-    stats->charge = charge_percent;
+    if (!g_module_symbol(upower, "up_client_new_full", (gpointer*) client_new_full) ||
+            !g_module_symbol(upower, "up_client_get_display_device",
+                             (gpointer*) client_get_display_device)) {
+        g_warning("Could not find the UPower client in %s: %s", BATTERY_UPOWER_LIBRARY,
+                  g_module_error());
+        g_module_close(upower);
+        return FALSE;
+    }
+    g_module_make_resident(upower);
     return TRUE;
 }
 
-static gboolean draw_battery_widget(GtkWidget* widget, cairo_t *cr, struct BatteryWidgetInfo* widget_info)
+/* Read the display device's state. Returns whether the glyph it is shown
+ * with changed.
+ */
+static gboolean read_battery_status(struct BatteryWidgetInfo* info)
 {
-    const int size = gdk_pixbuf_get_width(widget_info->outline);
-
-    const double top = size / 4;
-    const double left = size * 0.28;
-    const double bottom = size - (top / 2);
-    const double right = size - left;
-    const double width = right - left;
-    const double height = bottom - top;
-    const double line_width = height / 10;
-
-    // draw outline
-    gdk_cairo_set_source_pixbuf(cr, widget_info->outline, 0, 0);
-
-    if (widget_info->is_charging) {
-        // set mask
-        cairo_rectangle(cr, 0, 0, size, top + (height / 3));
-        cairo_fill(cr);
-        cairo_rectangle(cr,
-            left + line_width, top + (height / 3),
-            size, size);
-        cairo_fill(cr);
-
-        // draw charger
-        gdk_cairo_set_source_pixbuf(cr, widget_info->charger, 0, 0);
-        cairo_paint(cr);
+    gdouble percentage;
+    guint state;
+    gboolean is_present;
+    g_object_get(G_OBJECT(info->device), "percentage", &percentage, "state", &state,
+                 "is-present", &is_present, NULL);
+
+    UpDeviceState device_state = state;
+    IconGlyph glyph = is_present
+        ? icon_battery_glyph((int) (percentage + 0.5), device_state == UP_DEVICE_STATE_CHARGING)
+        : ICON_NONE;
+    if (glyph == info->glyph) {
+        return FALSE;
+    }
+    info->glyph = glyph;
+    return TRUE;
+}
 
+/* Create the battery icon, which follows UPower's display device.
+ *
+ * The icon is empty while there is no battery, & is only redrawn when the
+ * charge step or charging state it shows changes. Without a battery in sysfs,
+ * UPower is not loaded or connected to until the kernel adds one.
+ */
+GtkWidget* battery_widget(void)
+{
+    struct BatteryWidgetInfo* info = malloc(sizeof(struct BatteryWidgetInfo));
+    if (info == NULL) {
+        g_error("Could not allocate memory for BatteryWidgetInfo");
+    }
+    info->client = NULL;
+    info->device = NULL;
+    info->uevent_socket = -1;
+    info->uevent_watch_id = 0;
+    info->glyph = ICON_NONE;
+    info->widget = icon_widget_new(ICON_NONE);
+    g_signal_connect(G_OBJECT(info->widget), "destroy",
+                     G_CALLBACK(free_battery_widget_info), info);
+
+    if (has_system_battery()) {
+        connect_upower(info);
     } else {
-        cairo_paint(cr);
+        watch_power_supplies(info);
     }
+    return info->widget;
+}
 
-    // draw charge
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_rectangle(cr, 
-        left + line_width, bottom - line_width,
-        width - (2*line_width), -(height - (2*line_width)) * widget_info->battery_level / 100);
-    cairo_fill(cr);
-
+/* Follow UPower's display device & show its state */
+static void connect_upower(struct BatteryWidgetInfo* info)
+{
+    UpClientNewFullFunc client_new_full;
+    UpClientGetDisplayDeviceFunc client_get_display_device;
+    if (!load_upower(&client_new_full, &client_get_display_device)) {
+        return;
+    }
 
-    return FALSE;
+    GError* error = NULL;
+    UpClient* client = client_new_full(NULL, &error);
+    if (client == NULL) {
+        g_warning("Could not get UPower client: %s\n", error->message);
+        g_error_free(error);
+        return;
+    }
+    info->client = client;
+    info->device = client_get_display_device(client);
+    read_battery_status(info);
+    icon_widget_set_glyph(info->widget, info->glyph);
+
+    g_signal_connect(info->device, "notify::percentage", G_CALLBACK(handle_battery_changed), info);
+    g_signal_connect(info->device, "notify::state", G_CALLBACK(handle_battery_changed), info);
+    g_signal_connect(info->device, "notify::is-present", G_CALLBACK(handle_battery_changed), info);
 }
 
-static GdkPixbuf* init_charger(int size)
+/* Listen for the kernel adding power supplies, so a battery plugged in later,
+ * e.g. a dock's or a UPS with a kernel driver, still shows. Until then, this
+ * socket is all that runs.
+ */
+static void watch_power_supplies(struct BatteryWidgetInfo* info)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double top = size / 4;
-    const double left = size * 0.28;
-    const double bottom = size - (top / 2);
-    const double height = bottom - top;
-    const double line_width = height / 10;
-
-    const double charger_left = left / 4 * 3;
-
-    // draw charger
-    cairo_set_source_rgb(cr, 1, 1, 1);
-
-    cairo_set_line_width(cr, line_width);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-    cairo_move_to(cr, charger_left, top + (height * 0.7));
-    cairo_line_to(cr, charger_left, size);
-    cairo_stroke(cr);
-
-    cairo_rectangle(cr,
-        charger_left - (charger_left/2), top + (height/3*2),
-        line_width*3, height / 5);
-    cairo_fill(cr);
-
-    // prongs
-    cairo_set_line_width(cr, line_width * 0.9);
-    cairo_move_to(cr, charger_left - (line_width/3*2), top + (height * 0.55));
-    cairo_line_to(cr, charger_left - (line_width/3*2), top + (height * 0.7));
-    cairo_stroke(cr);
-    cairo_move_to(cr, charger_left + (line_width/2), top + (height * 0.55));
-    cairo_line_to(cr, charger_left + (line_width/2), top + (height * 0.7));
-    cairo_stroke(cr);
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
-
-    return dest;
+    info->uevent_socket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                                 NETLINK_KOBJECT_UEVENT);
+    if (info->uevent_socket == -1) {
+        g_warning("Could not open a uevent socket: %s", g_strerror(errno));
+        return;
+    }
+    struct sockaddr_nl address = { .nl_family = AF_NETLINK, .nl_groups = BATTERY_UEVENT_GROUP };
+    if (bind(info->uevent_socket, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        g_warning("Could not follow power supplies being added: %s", g_strerror(errno));
+        close(info->uevent_socket);
+        info->uevent_socket = -1;
+        return;
+    }
+    info->uevent_watch_id = g_unix_fd_add(info->uevent_socket, G_IO_IN, &handle_uevents, info);
 }
-static GdkPixbuf* init_outline(int size)
+
+static gboolean handle_uevents(gint fd, GIOCondition condition, gpointer user_data)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double top = size / 4;
-    const double left = size * 0.28;
-    const double bottom = size - (top / 2);
-    const double right = size - left;
-    const double width = right - left;
-    const double height = bottom - top;
-    const double line_width = height / 10;
-
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, line_width);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-
-    // left side
-    cairo_move_to(cr, left, top);
-    cairo_line_to(cr, left, bottom);
-    cairo_stroke(cr);
-    // right side
-    cairo_move_to(cr, right, top);
-    cairo_line_to(cr, right, bottom);
-    cairo_stroke(cr);
-
-    // top side
-    cairo_move_to(cr, left, top);
-    cairo_line_to(cr, right, top);
-    cairo_stroke(cr);
-
-    // bottom side
-    cairo_move_to(cr, left, bottom);
-    cairo_line_to(cr, right, bottom);
-    cairo_stroke(cr);
-
-    // knob thingy
-    cairo_set_line_width(cr, line_width * 3);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-    cairo_move_to(cr, left + (width*0.38), top - (line_width * 1.2));
-    cairo_line_to(cr, right - (width*0.38), top - (line_width * 1.2));
-    cairo_stroke(cr);
-
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
-
-    return dest;
+    struct BatteryWidgetInfo* info = (struct BatteryWidgetInfo*) user_data;
+    gchar buffer[BATTERY_UEVENT_BUFFER_SIZE];
+    gboolean power_supply_added = FALSE;
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        power_supply_added |= is_power_supply_added(buffer, (gsize) received);
+    }
+    if (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+            errno != ENOBUFS) {
+        g_warning("Stopped following power supplies: %s", g_strerror(errno));
+        info->uevent_watch_id = 0;
+        stop_watching_power_supplies(info);
+        return G_SOURCE_REMOVE;
+    }
+    if (!power_supply_added || !has_system_battery()) {
+        return G_SOURCE_CONTINUE;
+    }
+    info->uevent_watch_id = 0;
+    stop_watching_power_supplies(info);
+    connect_upower(info);
+    return G_SOURCE_REMOVE;
 }
 
-GtkWidget* battery_widget(void)
+/* Whether a uevent, an `ACTION@DEVPATH` line followed by `KEY=VALUE` fields,
+ * each NUL terminated, announces a new power supply.
+ */
+static gboolean is_power_supply_added(const gchar* uevent, gsize length)
 {
-    GtkWidget* icon = gtk_drawing_area_new();
-
-    struct PowerStats stats;
-    gboolean success = power_devices(&stats);
-    if (!success || stats.type == POWER_LINE) {
-        return icon;
+    const gchar* field = uevent;
+    const gchar* end = uevent + length;
+    if (length < strlen("add@") || strncmp(field, "add@", strlen("add@")) != 0) {
+        return FALSE;
     }
-
-    struct BatteryWidgetInfo* info = malloc(sizeof(struct BatteryWidgetInfo));
-    info->widget = icon;
-    info->is_charging = stats.type == POWER_BATTERY_CHARGING;
-    info->battery_level = stats.charge;
-
-    info->outline = init_outline(27);
-    info->charger = init_charger(27);
-
-    gtk_widget_set_size_request(icon, 27, 27);
-    g_signal_connect(G_OBJECT(icon), "draw", G_CALLBACK(draw_battery_widget), info);
-
-    g_timeout_add_seconds(15, G_SOURCE_FUNC(update_battery_status), info);
-
-    return icon;
+    while (field < end) {
+        const gchar* field_end = memchr(field, '\0', (gsize) (end - field));
+        const gsize field_length = (gsize) ((field_end == NULL ? end : field_end) - field);
+        if (field_length == strlen("SUBSYSTEM=power_supply") &&
+                strncmp(field, "SUBSYSTEM=power_supply", field_length) == 0) {
+            return TRUE;
+        }
+        field += field_length + 1;
+    }
+    return FALSE;
 }
 
-static gboolean update_battery_status(struct BatteryWidgetInfo* info)
+/* Close the uevent socket, once its watch is removed */
+static void stop_watching_power_supplies(struct BatteryWidgetInfo* info)
 {
-    struct PowerStats stats;
-    gboolean success = power_devices(&stats);
-    if (!success) return TRUE;
+    if (info->uevent_watch_id != 0) {
+        g_source_remove(info->uevent_watch_id);
+        info->uevent_watch_id = 0;
+    }
+    if (info->uevent_socket != -1) {
+        close(info->uevent_socket);
+        info->uevent_socket = -1;
+    }
+}
 
-    info->battery_level = stats.charge;
-    info->is_charging = stats.type == POWER_BATTERY_CHARGING;
+static void handle_battery_changed(GObject* device, GParamSpec* pspec, gpointer user_data)
+{
+    struct BatteryWidgetInfo* info = (struct BatteryWidgetInfo*) user_data;
+    if (read_battery_status(info)) {
+        icon_widget_set_glyph(info->widget, info->glyph);
+    }
+}
 
-    gtk_widget_queue_draw(info->widget);
-    return TRUE;
+static void free_battery_widget_info(GtkWidget* widget, gpointer user_data)
+{
+    struct BatteryWidgetInfo* info = (struct BatteryWidgetInfo*) user_data;
+    stop_watching_power_supplies(info);
+    if (info->device != NULL) {
+        g_signal_handlers_disconnect_by_data(info->device, info);
+        g_object_unref(info->device);
+    }
+    if (info->client != NULL) {
+        g_object_unref(info->client);
+    }
+    free(info);
 }
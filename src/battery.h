@@ -1,3 +1,13 @@
 #include <gtk/gtk.h>
 
+#include "defines.h"
+
+#ifdef ENABLE_BATTERY
 GtkWidget* battery_widget(void);
+#else
+// Built with `--disable-battery`, an empty icon keeps the overlay's layout
+static inline GtkWidget* battery_widget(void)
+{
+    return gtk_drawing_area_new();
+}
+#endif
@@ -10,6 +10,8 @@
 #include "focus_ring.h"
 #include "callbacks.h"
 #include "compat.h"
+#include "root_window.h"
+#include "scheduler.h"
 #include "ui.h"
 
 static void set_ui_feedback_label(App *app, gchar *feedback_text);
@@ -30,18 +32,25 @@ void authentication_complete_cb(LightDMGreeter *greeter, App *app)
 
         g_message("Attempting to start session: %s", session);
 
+        if (app->config->handoff_background != HANDOFF_NONE) {
+            ui_publish_root_background(
+                app->ui, app->config->handoff_background == HANDOFF_LOGIN);
+        }
+
         gboolean session_started_successfully =
             !lightdm_greeter_start_session_sync(greeter, session, NULL);
 
         if (!session_started_successfully) {
             g_message("Unable to start session");
+            // The next attempt publishes a new one
+            root_window_withdraw_background();
         }
     } else {
         g_message("Authentication failed");
         if (strlen(app->config->invalid_password_text) > 0) {
             set_ui_feedback_label(app, app->config->invalid_password_text);
         }
-        begin_authentication_as_default_user(app);
+        begin_authentication_as_current_user(app);
     }
     gtk_entry_set_text(GTK_ENTRY(APP_PASSWORD_INPUT(app)), "");
     gtk_editable_set_editable(GTK_EDITABLE(APP_PASSWORD_INPUT(app)), TRUE);
@@ -71,6 +80,9 @@ void handle_password(GtkWidget *password_input, App *app)
         XSetScreenSaver(gdk_x11_display_get_xdisplay(gdk_display_get_default()), app->timeout, app->interval, app->prefer_blanking, app->allow_exposures);
     }
 
+    // Starting the session needs the session ring, so finish any deferred work
+    scheduler_flush(app->scheduler);
+
     if (app->password_callback_id != 0) {
         g_signal_handler_disconnect(GTK_ENTRY(APP_PASSWORD_INPUT(app)),
                                     app->password_callback_id);
@@ -85,7 +97,7 @@ void handle_password(GtkWidget *password_input, App *app)
         gtk_widget_set_sensitive(GTK_WIDGET(APP_LOGIN_BUTTON(app)), FALSE);
 
         if (!lightdm_greeter_get_in_authentication(app->greeter)) {
-            begin_authentication_as_default_user(app);
+            begin_authentication_as_current_user(app);
         }
         g_message("Using entered password to authenticate");
         const gchar *password_text =
@@ -136,6 +148,7 @@ gboolean handle_hotkeys(GtkWidget *widget, GdkEventKey *event, App *app)
         } else if (event->keyval == config->session_key && sessions != NULL) {
             gchar *new_session = focus_ring_next(sessions);
             set_ui_feedback_label(app, new_session);
+            update_session_prefetch(app);
         } else {
             return FALSE;
         }
@@ -145,14 +158,23 @@ gboolean handle_hotkeys(GtkWidget *widget, GdkEventKey *event, App *app)
     return FALSE;
 }
 
+/* Show the login page when a key or button is pressed on the cover page.
+ *
+ * The key that uncovered the page is buffered & replayed into the password
+ * input, so the first character typed is not lost. The signal is also
+ * connected for button presses, so check the event type before treating it as
+ * a key.
+ */
 gboolean handle_cover_uncover(GtkWidget *widget, GdkEventKey *event, App *app)
 {
     if (app->state == APP_COVERED) {
-        app->state = APP_LOGIN;
-        ui_uncover(app->ui);
+        if (event->type == GDK_KEY_PRESS) {
+            typeahead_add_key(app->typeahead, event->keyval, event->state);
+        }
+        show_login_page(app);
         return TRUE;
-        
-    } else if (event->keyval == GDK_KEY_Escape) {
+
+    } else if (event->type == GDK_KEY_PRESS && event->keyval == GDK_KEY_Escape) {
         app->state = APP_COVERED;
         ui_cover(app->ui);
     }
@@ -160,10 +182,37 @@ gboolean handle_cover_uncover(GtkWidget *widget, GdkEventKey *event, App *app)
     return FALSE;
 }
 
+/* Replay any buffered keys once the password input is focused.
+ *
+ * If Enter was among them, authentication starts immediately.
+ */
+gboolean handle_password_focus(GtkWidget *widget, GdkEventFocus *event, App *app)
+{
+    if (typeahead_is_empty(app->typeahead)) {
+        return FALSE;
+    }
+    gboolean submit = typeahead_replay(app->typeahead, GTK_EDITABLE(widget));
+    if (submit && app->password_callback_id != 0) {
+        handle_password(widget, app);
+    }
+    return FALSE;
+}
+
+/* Switch from the cover page to the login page */
+void show_login_page(App *app)
+{
+    app->state = APP_LOGIN;
+    ui_uncover(app->ui);
+    update_session_prefetch(app);
+}
+
 /** Determine the current time & update the time GtkLabel.
+ *
+ * Runs at the start of every minute & whenever the clock is set.
  */
-gboolean handle_time_update(App *app)
+void handle_time_update(gpointer user_data)
 {
+    App *app = (App *) user_data;
     time_t now = time(NULL);
     struct tm *local_now = localtime(&now);
     gchar time_string[30];
@@ -172,8 +221,37 @@ gboolean handle_time_update(App *app)
     strftime(date_string, 29, "%A, %d.%m.%Y", local_now);
     gtk_label_set_text(GTK_LABEL(APP_TIME_LABEL(app)), time_string);
     gtk_label_set_text(GTK_LABEL(APP_DATE_LABEL(app)), date_string);
+}
 
-    return TRUE;
+/* Switch to a user picked from the user picker, with their last session.
+ *
+ * Starting a new authentication makes LightDM drop the one in progress.
+ * Picks are ignored while a password is being checked.
+ */
+void handle_user_picked(const gchar *username, gpointer user_data)
+{
+    App *app = (App *) user_data;
+    if (app->password_callback_id == 0) {
+        return;
+    }
+    if (strcmp(username, app->current_user) != 0) {
+        g_message("Switching to user: %s", username);
+        g_free(app->current_user);
+        app->current_user = g_strdup(username);
+        login_ui_set_user(app->ui->login_ui, username);
+        gtk_widget_hide(APP_FEEDBACK_LABEL(app));
+
+        LightDMUser *user = lightdm_user_list_get_user_by_name(
+            lightdm_user_list_get_instance(), username);
+        const gchar *session = user == NULL ? NULL : lightdm_user_get_session(user);
+        if (session != NULL && app->session_ring != NULL) {
+            focus_ring_scroll_to_value(app->session_ring, session);
+            update_session_prefetch(app);
+        }
+        begin_authentication_as_current_user(app);
+    }
+    gtk_entry_set_text(GTK_ENTRY(APP_PASSWORD_INPUT(app)), "");
+    gtk_widget_grab_focus(APP_PASSWORD_INPUT(app));
 }
 
 /* Set the Feedback Label's text & ensure it is visible. */
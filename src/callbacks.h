@@ -10,8 +10,11 @@ void authentication_complete_cb(LightDMGreeter* greeter, App* app);
 void handle_password(GtkWidget* password_input, App* app);
 gboolean handle_tab_key(GtkWidget* widget, GdkEvent* event, App* app);
 gboolean handle_hotkeys(GtkWidget* widget, GdkEventKey* event, App* app);
-gboolean handle_time_update(App* app);
+void handle_time_update(gpointer user_data);
 gboolean handle_cover_uncover(GtkWidget* widget, GdkEventKey* event, App* app);
+gboolean handle_password_focus(GtkWidget* widget, GdkEventFocus* event, App* app);
+void show_login_page(App* app);
+void handle_user_picked(const gchar* username, gpointer user_data);
 
 void power_shutdown(GtkWidget* item);
 void power_restart(GtkWidget* item);
@@ -6,6 +6,7 @@
 #include <glib.h>
 
 #include "config.h"
+#include "startup_profile.h"
 #include "utils.h"
 
 
@@ -19,6 +20,7 @@ static GdkRGBA *parse_greeter_color_key(GKeyFile *keyfile, const char *key_name,
 static guint parse_greeter_hotkey_keyval(GKeyFile *keyfile, const char *key_name, const char default_char);
 static gunichar *parse_greeter_password_char(GKeyFile *keyfile);
 static gfloat parse_greeter_password_alignment(GKeyFile *keyfile);
+static HandoffBackground parse_greeter_handoff_background(GKeyFile *keyfile);
 static gboolean is_rtl_keymap_layout(void);
 gboolean input_string_equals(gchar *input_str, const gchar * const fixed_str);
 
@@ -43,6 +45,7 @@ Config *initialize_config(void)
             g_error("Could not load configuration file.");
         }
     }
+    startup_profile_track_file(CONFIG_FILE);
 
     // Parse values from the keyfile into a Config.
     config->login_user =
@@ -65,6 +68,25 @@ Config *initialize_config(void)
         keyfile, "greeter", "show-image-on-all-monitors", FALSE);
     config->show_sys_info = parse_greeter_boolean(
         keyfile, "greeter", "show-sys-info", FALSE);
+    config->prefetch_session = parse_greeter_boolean(
+        keyfile, "greeter", "prefetch-session", FALSE);
+    config->prefetch_paths = g_key_file_get_string_list(
+        keyfile, "greeter", "prefetch-paths", NULL, NULL);
+    config->record_startup_profile = parse_greeter_boolean(
+        keyfile, "greeter", "record-startup-profile", FALSE);
+    config->handoff_background = parse_greeter_handoff_background(keyfile);
+    config->memory_budget = parse_greeter_integer(
+        keyfile, "greeter", "memory-budget", 0);
+    config->user_picker = parse_greeter_boolean(
+        keyfile, "greeter", "user-picker", FALSE);
+    config->idle_timeout = parse_greeter_integer(
+        keyfile, "greeter", "idle-timeout", 30);
+    if (config->idle_timeout < 0) {
+        g_warning("Invalid idle-timeout: %d", config->idle_timeout);
+        config->idle_timeout = 30;
+    }
+    config->idle_release_memory = parse_greeter_boolean(
+        keyfile, "greeter", "idle-release-memory", FALSE);
 
     // Parse Hotkey Settings
     config->suspend_key = parse_greeter_hotkey_keyval(keyfile, "suspend-key", 'u');
@@ -111,6 +133,29 @@ Config *initialize_config(void)
     }
     config->background_color =
         parse_greeter_color_key(keyfile, "background-color", "#1B1D1E");
+    config->background_rotate_interval = parse_greeter_integer(
+        keyfile, "greeter-theme", "background-rotate-interval", 0);
+    config->background_memory_budget = parse_greeter_integer(
+        keyfile, "greeter-theme", "background-memory-budget", 128);
+    if (config->background_memory_budget < 0) {
+        g_warning("Invalid background-memory-budget: %d", config->background_memory_budget);
+        config->background_memory_budget = 128;
+    }
+    config->background_animation =
+        g_key_file_get_string(keyfile, "greeter-theme", "background-animation", NULL);
+    if (config->background_animation != NULL) {
+        // Quoted like `background-image`
+        g_strstrip(g_strdelimit(config->background_animation, "\"", ' '));
+        if (strcmp(config->background_animation, "") == 0) {
+            g_clear_pointer(&config->background_animation, g_free);
+        }
+    }
+    config->background_animation_fps = parse_greeter_integer(
+        keyfile, "greeter-theme", "background-animation-fps", 15);
+    if (config->background_animation_fps <= 0) {
+        g_warning("Invalid background-animation-fps: %d", config->background_animation_fps);
+        config->background_animation_fps = 15;
+    }
     // Window
     config->window_color =
         parse_greeter_color_key(keyfile, "window-color", "#F92672");
@@ -180,12 +225,14 @@ void destroy_config(Config *config)
     free(config->text_color);
     free(config->error_color);
     free(config->background_image);
+    free(config->background_animation);
     free(config->background_color);
     free(config->window_color);
     free(config->border_color);
     free(config->border_width);
     free(config->password_label_text);
     free(config->invalid_password_text);
+    g_strfreev(config->prefetch_paths);
     free(config->password_char);
     free(config->password_color);
     free(config->password_background_color);
@@ -199,6 +246,55 @@ void destroy_config(Config *config)
 }
 
 
+/* Read a single string from the config file without parsing anything else.
+ *
+ * This does not need GDK, so it can be used before GTK is initialized.
+ * Returns NULL if the file or the key is missing.
+ */
+gchar *config_peek_string(const char *group_name, const char *key_name)
+{
+    GKeyFile *keyfile = g_key_file_new();
+    gchar *value = NULL;
+    if (g_key_file_load_from_file(keyfile, CONFIG_FILE, G_KEY_FILE_NONE, NULL)) {
+        value = g_key_file_get_string(keyfile, group_name, key_name, NULL);
+    }
+    g_key_file_free(keyfile);
+    return value;
+}
+
+/* Read a single `;` separated list like `config_peek_string` */
+gchar **config_peek_string_list(const char *group_name, const char *key_name)
+{
+    GKeyFile *keyfile = g_key_file_new();
+    gchar **value = NULL;
+    if (g_key_file_load_from_file(keyfile, CONFIG_FILE, G_KEY_FILE_NONE, NULL)) {
+        value = g_key_file_get_string_list(keyfile, group_name, key_name, NULL, NULL);
+    }
+    g_key_file_free(keyfile);
+    return value;
+}
+
+/* Read a single boolean like `config_peek_string`, returning the fallback if
+ * the key is missing or not a boolean.
+ */
+gboolean config_peek_boolean(const char *group_name, const char *key_name,
+                             gboolean fallback)
+{
+    GKeyFile *keyfile = g_key_file_new();
+    gboolean value = fallback;
+    if (g_key_file_load_from_file(keyfile, CONFIG_FILE, G_KEY_FILE_NONE, NULL)) {
+        GError *error = NULL;
+        value = g_key_file_get_boolean(keyfile, group_name, key_name, &error);
+        if (error != NULL) {
+            value = fallback;
+            g_error_free(error);
+        }
+    }
+    g_key_file_free(keyfile);
+    return value;
+}
+
+
 /* Parse a string from the config file, returning a copy of the fallback value
  * if the key is not present in the group.
  */
@@ -409,6 +505,30 @@ static gfloat parse_greeter_password_alignment(GKeyFile *keyfile)
     return alignment;
 }
 
+/* Parse which background is published as the root window's pixmap when a
+ * session starts. Unknown values disable the handoff.
+ */
+static HandoffBackground parse_greeter_handoff_background(GKeyFile *keyfile)
+{
+    HandoffBackground handoff;
+
+    gchar *handoff_text = parse_greeter_string(
+        keyfile, "greeter", "handoff-background", "none");
+
+    if (input_string_equals(handoff_text, "cover")) {
+        handoff = HANDOFF_COVER;
+    } else if (input_string_equals(handoff_text, "login")) {
+        handoff = HANDOFF_LOGIN;
+    } else {
+        if (!input_string_equals(handoff_text, "none")) {
+            g_warning("Invalid handoff-background configuration value: '%s'", handoff_text);
+        }
+        handoff = HANDOFF_NONE;
+    }
+    free(handoff_text);
+    return handoff;
+}
+
 /* Determine if the default Display's Keymap is in the Right-to-Left direction
  */
 static gboolean is_rtl_keymap_layout(void)
@@ -9,6 +9,14 @@
 #endif
 
 
+// Which of the already-rendered backgrounds to leave on the root window when
+// a session starts.
+typedef enum HandoffBackground_ {
+    HANDOFF_NONE,
+    HANDOFF_COVER,
+    HANDOFF_LOGIN,
+} HandoffBackground;
+
 // Represents the System's Greeter Configuration. Parsed from `CONFIG_FILE`.
 typedef struct Config_ {
     gchar    *login_user;
@@ -20,6 +28,14 @@ typedef struct Config_ {
     gint      password_input_width;
     gboolean  show_image_on_all_monitors;
     gboolean  show_sys_info;
+    gboolean  prefetch_session;
+    gchar   **prefetch_paths;
+    gboolean  record_startup_profile;
+    HandoffBackground handoff_background;
+    gint      memory_budget;
+    gboolean  user_picker;
+    gint      idle_timeout;
+    gboolean  idle_release_memory;
 
     /* Theme Configuration */
     gchar    *font;
@@ -31,6 +47,10 @@ typedef struct Config_ {
     // Windows
     gchar    *background_image;
     GdkRGBA  *background_color;
+    gint      background_rotate_interval;
+    gint      background_memory_budget;
+    gchar    *background_animation;
+    gint      background_animation_fps;
     GdkRGBA  *window_color;
     GdkRGBA  *border_color;
     gchar    *border_width;
@@ -60,5 +80,9 @@ typedef struct Config_ {
 
 Config *initialize_config(void);
 void destroy_config(Config *config);
+gchar *config_peek_string(const char *group_name, const char *key_name);
+gchar **config_peek_string_list(const char *group_name, const char *key_name);
+gboolean config_peek_boolean(const char *group_name, const char *key_name,
+                             gboolean fallback);
 
 #endif
@@ -0,0 +1,187 @@
+/* Look Up Users' Display Names Without Blocking on a Slow Directory */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pwd.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "display_name.h"
+#include "utils.h"
+
+#define DISPLAY_NAME_GROUP "display-names"
+
+
+/* The state of a display_name_lookup_async call, owned by its GTask */
+struct DisplayNameLookup {
+    gchar          *username;
+    gchar          *cached_name;
+    /* Set by the worker thread, NULL if the user could not be found */
+    gchar          *display_name;
+    GCancellable   *cancellable;
+    guint           timeout_id;
+    DisplayNameFunc func;
+    gpointer        data;
+};
+
+
+static GKeyFile *load_display_names(gchar **cache_path);
+static void save_display_name(const gchar *username, const gchar *display_name);
+static void run_display_name_lookup(GTask *task, gpointer source, gpointer task_data,
+                                    GCancellable *cancellable);
+static gchar *lookup_display_name(const gchar *username);
+static void finish_display_name_lookup(GObject *source, GAsyncResult *result,
+                                       gpointer user_data);
+static gboolean handle_display_name_timeout(gpointer user_data);
+static void free_display_name_lookup(gpointer data);
+
+
+/* The name found for a user on an earlier start, or the login name */
+gchar *display_name_get_cached(const gchar *username)
+{
+    gchar *cache_path;
+    GKeyFile *display_names = load_display_names(&cache_path);
+    gchar *display_name = g_key_file_get_string(display_names, DISPLAY_NAME_GROUP,
+                                                username, NULL);
+    g_key_file_free(display_names);
+    g_free(cache_path);
+    return display_name == NULL ? g_strdup(username) : display_name;
+}
+
+/* Look up a user's GECOS name through NSS on a worker thread, so users from
+ * LDAP or sssd are found too. `cached_name` is what display_name_get_cached
+ * returned, & `func` is only called if the name differs from it.
+ *
+ * A slow directory server can block the lookup for a long time, so `func` is
+ * not called after DISPLAY_NAME_TIMEOUT_SECONDS. Cancel the returned
+ * GCancellable to not call it at all, e.g. when another user is picked.
+ * Either way the name is still cached for the next start once it is found.
+ */
+GCancellable *display_name_lookup_async(const gchar *username, const gchar *cached_name,
+                                        DisplayNameFunc func, gpointer data)
+{
+    struct DisplayNameLookup *lookup = g_new0(struct DisplayNameLookup, 1);
+    lookup->username = g_strdup(username);
+    lookup->cached_name = g_strdup(cached_name);
+    lookup->func = func;
+    lookup->data = data;
+
+    lookup->cancellable = g_cancellable_new();
+    lookup->timeout_id = g_timeout_add_seconds(DISPLAY_NAME_TIMEOUT_SECONDS,
+                                               &handle_display_name_timeout, lookup);
+    GTask *task = g_task_new(NULL, lookup->cancellable, &finish_display_name_lookup, NULL);
+    g_task_set_task_data(task, lookup, &free_display_name_lookup);
+    g_task_run_in_thread(task, &run_display_name_lookup);
+    g_object_unref(task);
+    return g_object_ref(lookup->cancellable);
+}
+
+
+static GKeyFile *load_display_names(gchar **cache_path)
+{
+    *cache_path = get_cache_path(DISPLAY_NAME_CACHE_FILE);
+    GKeyFile *display_names = g_key_file_new();
+    g_key_file_load_from_file(display_names, *cache_path, G_KEY_FILE_NONE, NULL);
+    return display_names;
+}
+
+static void save_display_name(const gchar *username, const gchar *display_name)
+{
+    gchar *cache_path;
+    GKeyFile *display_names = load_display_names(&cache_path);
+    g_key_file_set_string(display_names, DISPLAY_NAME_GROUP, username, display_name);
+    GError *error = NULL;
+    if (!g_key_file_save_to_file(display_names, cache_path, &error)) {
+        g_warning("Could not save %s: %s", cache_path, error->message);
+        g_error_free(error);
+    }
+    g_key_file_free(display_names);
+    g_free(cache_path);
+}
+
+/* Runs on a worker thread */
+static void run_display_name_lookup(GTask *task, gpointer source, gpointer task_data,
+                                    GCancellable *cancellable)
+{
+    struct DisplayNameLookup *lookup = (struct DisplayNameLookup *) task_data;
+    lookup->display_name = lookup_display_name(lookup->username);
+    g_task_return_boolean(task, TRUE);
+}
+
+/* The first GECOS field of a user's passwd entry, or the login name if it is
+ * empty. NULL if the user does not exist.
+ */
+static gchar *lookup_display_name(const gchar *username)
+{
+    long buffer_size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    gsize size = buffer_size > 0 ? (gsize) buffer_size : 1024;
+    gchar *buffer = NULL;
+    struct passwd entry;
+    struct passwd *result = NULL;
+    int error;
+    do {
+        // Entries from a directory can be larger than the suggested size
+        size *= 2;
+        buffer = g_realloc(buffer, size);
+        error = getpwnam_r(username, &entry, buffer, size, &result);
+    } while (error == ERANGE && size < 1024 * 1024);
+
+    gchar *display_name = NULL;
+    if (result != NULL) {
+        gsize name_length = strcspn(entry.pw_gecos == NULL ? "" : entry.pw_gecos, ",");
+        display_name = name_length > 0 ? g_strndup(entry.pw_gecos, name_length)
+                                       : g_strdup(username);
+    } else if (error != 0) {
+        g_message("Could not look up user %s: %s", username, g_strerror(error));
+    }
+    g_free(buffer);
+    return display_name;
+}
+
+/* Runs on the main thread, once the worker thread is done, even if the lookup
+ * was cancelled or timed out
+ */
+static void finish_display_name_lookup(GObject *source, GAsyncResult *result,
+                                       gpointer user_data)
+{
+    struct DisplayNameLookup *lookup = g_task_get_task_data(G_TASK(result));
+    if (lookup->timeout_id != 0) {
+        g_source_remove(lookup->timeout_id);
+        lookup->timeout_id = 0;
+    }
+    if (lookup->display_name == NULL ||
+            strcmp(lookup->display_name, lookup->cached_name) == 0) {
+        return;
+    }
+    // Cache late names too, so a slow directory still shows them next time
+    save_display_name(lookup->username, lookup->display_name);
+    GError *error = NULL;
+    if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+        g_message("Not showing the display name of %s: %s", lookup->username,
+                  error->message);
+        g_error_free(error);
+        return;
+    }
+    lookup->func(lookup->username, lookup->display_name, lookup->data);
+}
+
+static gboolean handle_display_name_timeout(gpointer user_data)
+{
+    struct DisplayNameLookup *lookup = (struct DisplayNameLookup *) user_data;
+    g_message("Looking up the display name of %s timed out", lookup->username);
+    lookup->timeout_id = 0;
+    g_cancellable_cancel(lookup->cancellable);
+    return G_SOURCE_REMOVE;
+}
+
+static void free_display_name_lookup(gpointer data)
+{
+    struct DisplayNameLookup *lookup = (struct DisplayNameLookup *) data;
+    g_object_unref(lookup->cancellable);
+    g_free(lookup->username);
+    g_free(lookup->cached_name);
+    g_free(lookup->display_name);
+    g_free(lookup);
+}
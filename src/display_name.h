@@ -0,0 +1,21 @@
+#ifndef DISPLAY_NAME_H
+#define DISPLAY_NAME_H
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#define DISPLAY_NAME_CACHE_FILE "display-names.cache"
+// How long to wait for the user database before keeping the cached name
+#define DISPLAY_NAME_TIMEOUT_SECONDS 2
+
+
+/* Called with a user's display name, if it differs from the cached one */
+typedef void (*DisplayNameFunc)(const gchar *username, const gchar *display_name,
+                                gpointer data);
+
+
+gchar *display_name_get_cached(const gchar *username);
+GCancellable *display_name_lookup_async(const gchar *username, const gchar *cached_name,
+                                        DisplayNameFunc func, gpointer data);
+
+#endif
@@ -0,0 +1,85 @@
+/* Load Only the Greeter's Own Fonts, Instead of Every Font on the System */
+#include <fontconfig/fontconfig.h>
+#include <glib.h>
+
+#include "config.h"
+#include "fonts.h"
+
+
+static void add_font_files(FcConfig *fc_config);
+static int count_fonts(FcConfig *fc_config);
+
+
+/* If `private-fonts` is set, give fontconfig a configuration of its own,
+ * holding only the fonts installed with the greeter & the `font-files`.
+ *
+ * The installed fonts are read from a cache built when the greeter is
+ * installed, so no font directory is scanned. This must be called before GTK
+ * is initialized, or fontconfig will already have loaded the system's
+ * configuration & every font it lists.
+ */
+void fonts_use_private_config(void)
+{
+    if (!config_peek_boolean("greeter-theme", "private-fonts", FALSE)) {
+        return;
+    }
+
+    FcConfig *fc_config = FcConfigCreate();
+    if (fc_config == NULL) {
+        g_error("Could not allocate memory for FcConfig");
+    }
+    if (!FcConfigParseAndLoad(fc_config, (const FcChar8 *) PRIVATE_FONTS_FILE, FcTrue) ||
+            !FcConfigBuildFonts(fc_config)) {
+        g_warning("Could not load %s - using the system's fonts", PRIVATE_FONTS_FILE);
+        FcConfigDestroy(fc_config);
+        return;
+    }
+    add_font_files(fc_config);
+
+    const int font_count = count_fonts(fc_config);
+    if (font_count == 0) {
+        g_warning("Found no private fonts - using the system's fonts");
+        FcConfigDestroy(fc_config);
+        return;
+    }
+    // Kept for the life of the greeter
+    if (!FcConfigSetCurrent(fc_config)) {
+        g_warning("Could not use the private fonts - using the system's fonts");
+        FcConfigDestroy(fc_config);
+        return;
+    }
+    g_message("Using %d private fonts", font_count);
+}
+
+
+/* Add the `font-files`, which are scanned since they have no cache */
+static void add_font_files(FcConfig *fc_config)
+{
+    gchar **font_files = config_peek_string_list("greeter-theme", "font-files");
+    if (font_files == NULL) {
+        return;
+    }
+    for (gchar **font_file = font_files; *font_file != NULL; font_file++) {
+        g_strstrip(*font_file);
+        if (**font_file == '\0') {
+            continue;
+        }
+        if (!FcConfigAppFontAddFile(fc_config, (const FcChar8 *) *font_file)) {
+            g_warning("Could not load the font %s", *font_file);
+        }
+    }
+    g_strfreev(font_files);
+}
+
+static int count_fonts(FcConfig *fc_config)
+{
+    int font_count = 0;
+    const FcSetName font_sets[] = { FcSetSystem, FcSetApplication };
+    for (guint s = 0; s < G_N_ELEMENTS(font_sets); s++) {
+        FcFontSet *fonts = FcConfigGetFonts(fc_config, font_sets[s]);
+        if (fonts != NULL) {
+            font_count += fonts->nfont;
+        }
+    }
+    return font_count;
+}
@@ -0,0 +1,9 @@
+#ifndef FONTS_H
+#define FONTS_H
+
+#include <glib.h>
+
+
+void fonts_use_private_config(void);
+
+#endif
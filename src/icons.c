@@ -0,0 +1,434 @@
+/* Render the Status Icons Once, Into an Atlas Every Icon Widget Draws From */
+#include "icons.h"
+#include "memory_usage.h"
+
+
+// The highest device scale an atlas is rendered at, higher ones are upscaled
+#define ICON_MAX_SCALE 4
+
+
+// Every glyph side by side, ICON_SIZE logical pixels apart, for each device
+// scale. Rendered the first time an icon is drawn at that scale.
+static cairo_surface_t* atlases[ICON_MAX_SCALE] = { NULL };
+static GQuark glyph_quark = 0;
+
+
+static cairo_surface_t* get_atlas(GtkWidget* widget);
+static cairo_surface_t* render_atlas(gint scale);
+static void begin_cell(cairo_t* cr, gint glyph);
+static gboolean draw_icon_widget(GtkWidget* widget, cairo_t* cr, gpointer user_data);
+static void draw_ethernet(cairo_t* cr, int size);
+static void draw_wireless(cairo_t* cr, int size, gint level);
+static void draw_offline(cairo_t* cr, int size);
+static void draw_battery(cairo_t* cr, int size, gint step, gboolean is_charging);
+static void draw_battery_outline(cairo_t* cr, int size);
+static void draw_charger(cairo_t* cr, int size);
+static void draw_shutdown(cairo_t* cr, int size);
+static gboolean draw_arrow_widget(GtkWidget* widget, cairo_t* cr, gpointer user_data);
+
+
+/* Create a widget showing a glyph, or nothing & taking up no space for
+ * ICON_NONE.
+ */
+GtkWidget* icon_widget_new(IconGlyph glyph)
+{
+    if (glyph_quark == 0) {
+        glyph_quark = g_quark_from_static_string("icon-glyph");
+    }
+    GtkWidget* widget = gtk_drawing_area_new();
+    gtk_widget_set_size_request(widget, 0, 0);
+    g_object_set_qdata(G_OBJECT(widget), glyph_quark, GINT_TO_POINTER(ICON_NONE));
+    g_signal_connect(G_OBJECT(widget), "draw", G_CALLBACK(draw_icon_widget), NULL);
+    icon_widget_set_glyph(widget, glyph);
+    return widget;
+}
+
+/* Show another glyph. This only queues a redraw, nothing is rendered or
+ * allocated.
+ */
+void icon_widget_set_glyph(GtkWidget* widget, IconGlyph glyph)
+{
+    IconGlyph current = GPOINTER_TO_INT(g_object_get_qdata(G_OBJECT(widget), glyph_quark));
+    if (glyph == current) {
+        return;
+    }
+    g_object_set_qdata(G_OBJECT(widget), glyph_quark, GINT_TO_POINTER(glyph));
+    // Only resizes when the icon appears or disappears
+    const int size = glyph == ICON_NONE ? 0 : ICON_SIZE;
+    gtk_widget_set_size_request(widget, size, size);
+    gtk_widget_queue_draw(widget);
+}
+
+/* The wireless glyph for a signal level. An unknown level lights every arc. */
+IconGlyph icon_wireless_glyph(gint level)
+{
+    if (level == WIRELESS_LEVEL_UNKNOWN) {
+        level = WIRELESS_LEVEL_MAX;
+    }
+    return (IconGlyph) (ICON_WIRELESS + CLAMP(level, 0, WIRELESS_LEVEL_MAX));
+}
+
+/* The battery glyph for a charge, rounded to the nearest step */
+IconGlyph icon_battery_glyph(gint percentage, gboolean is_charging)
+{
+    const gint step = (CLAMP(percentage, 0, 100) * (ICON_BATTERY_STEPS - 1) + 50) / 100;
+    return (IconGlyph) (ICON_BATTERY + step + (is_charging ? ICON_BATTERY_STEPS : 0));
+}
+
+/* Create a widget showing a right pointing arrow, for the login button. It
+ * is only drawn when its button is, so it skips the atlas.
+ */
+GtkWidget* icon_arrow_new(void)
+{
+    GtkWidget* widget = gtk_drawing_area_new();
+    gtk_widget_set_size_request(widget, ICON_ARROW_SIZE, ICON_ARROW_SIZE);
+    g_signal_connect(G_OBJECT(widget), "draw", G_CALLBACK(draw_arrow_widget), NULL);
+    return widget;
+}
+
+
+/* The atlas for the widget's device scale. A window moving to a screen with
+ * another scale redraws its widgets, so this renders each scale once.
+ */
+static cairo_surface_t* get_atlas(GtkWidget* widget)
+{
+    const gint scale = CLAMP(gtk_widget_get_scale_factor(widget), 1, ICON_MAX_SCALE);
+    if (atlases[scale - 1] == NULL) {
+        atlases[scale - 1] = render_atlas(scale);
+    }
+    return atlases[scale - 1];
+}
+
+/* Draw every glyph into its cell of an atlas with `scale` device pixels per
+ * logical pixel. The drawing itself stays in logical pixels.
+ */
+static cairo_surface_t* render_atlas(gint scale)
+{
+    cairo_surface_t* atlas = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, ICON_SIZE * ICON_COUNT * scale, ICON_SIZE * scale);
+    cairo_surface_set_device_scale(atlas, scale, scale);
+    cairo_t* cr = cairo_create(atlas);
+
+    begin_cell(cr, ICON_ETHERNET);
+    draw_ethernet(cr, ICON_SIZE);
+    cairo_restore(cr);
+
+    begin_cell(cr, ICON_OFFLINE);
+    draw_offline(cr, ICON_SIZE);
+    cairo_restore(cr);
+
+    for (gint level = 0; level <= WIRELESS_LEVEL_MAX; level++) {
+        begin_cell(cr, ICON_WIRELESS + level);
+        draw_wireless(cr, ICON_SIZE, level);
+        cairo_restore(cr);
+    }
+
+    for (gint step = 0; step < ICON_BATTERY_STEPS; step++) {
+        begin_cell(cr, ICON_BATTERY + step);
+        draw_battery(cr, ICON_SIZE, step, FALSE);
+        cairo_restore(cr);
+        begin_cell(cr, ICON_BATTERY + ICON_BATTERY_STEPS + step);
+        draw_battery(cr, ICON_SIZE, step, TRUE);
+        cairo_restore(cr);
+    }
+
+    begin_cell(cr, ICON_SHUTDOWN);
+    draw_shutdown(cr, ICON_SIZE);
+    cairo_restore(cr);
+
+    cairo_destroy(cr);
+    cairo_surface_flush(atlas);
+    memory_usage_add_bytes(MEMORY_OWNER_ICONS,
+                           (gsize) cairo_image_surface_get_stride(atlas) *
+                           (gsize) cairo_image_surface_get_height(atlas));
+    return atlas;
+}
+
+/* Move to a glyph's cell & clip to it, until the next cairo_restore */
+static void begin_cell(cairo_t* cr, gint glyph)
+{
+    cairo_save(cr);
+    cairo_translate(cr, glyph * ICON_SIZE, 0);
+    cairo_rectangle(cr, 0, 0, ICON_SIZE, ICON_SIZE);
+    cairo_clip(cr);
+}
+
+/* Blit the widget's glyph out of the atlas, centered */
+static gboolean draw_icon_widget(GtkWidget* widget, cairo_t* cr, gpointer user_data)
+{
+    IconGlyph glyph = GPOINTER_TO_INT(g_object_get_qdata(G_OBJECT(widget), glyph_quark));
+    if (glyph == ICON_NONE) {
+        return FALSE;
+    }
+    const int x = (gtk_widget_get_allocated_width(widget) - ICON_SIZE) / 2;
+    const int y = (gtk_widget_get_allocated_height(widget) - ICON_SIZE) / 2;
+    cairo_set_source_surface(cr, get_atlas(widget), x - glyph * ICON_SIZE, y);
+    cairo_rectangle(cr, x, y, ICON_SIZE, ICON_SIZE);
+    cairo_fill(cr);
+    return FALSE;
+}
+
+static void draw_ethernet(cairo_t* cr, int size)
+{
+    const double line_width = size / 10;
+    const double top = line_width;
+    const double left = line_width;
+    const double right = size - line_width;
+    const double base = size - line_width;
+    const double monitor_bottom = size * 0.65;
+    const double plug_bottom = monitor_bottom - (2 * line_width);
+    const double plug_center = left + 2.2*line_width; 
+    const double plug_right = plug_center + 2.2*line_width;
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, line_width);
+
+    // common outline
+    cairo_move_to(cr, plug_right, top);
+    cairo_line_to(cr, plug_right, plug_bottom);
+    cairo_line_to(cr, left, plug_bottom);
+    cairo_line_to(cr, left, top);
+    cairo_line_to(cr, right, top);
+    cairo_line_to(cr, right, monitor_bottom);
+    cairo_line_to(cr, plug_center, monitor_bottom);
+    cairo_stroke(cr);
+
+    // chord
+    cairo_move_to(cr, plug_center, plug_bottom);
+    cairo_line_to(cr, plug_center, base);
+    cairo_stroke(cr);
+
+    // plug details
+    cairo_move_to(cr, plug_center, top + 1.6*line_width);
+    cairo_line_to(cr, plug_center, top + 4*line_width);
+
+    cairo_move_to(cr, left, top + 2.2*line_width);
+    cairo_line_to(cr, plug_right, top + 2.2*line_width);
+    cairo_stroke(cr);
+    
+    // Monitor base
+    const double monitor_center = (right-plug_center)/2 + plug_center;
+    cairo_move_to(cr, monitor_center, monitor_bottom);
+    cairo_line_to(cr, monitor_center, base);
+
+    cairo_move_to(cr, monitor_center - (2.5*line_width), base - (line_width/2));
+    cairo_line_to(cr, monitor_center + (2.5*line_width), base - (line_width/2));
+    cairo_stroke(cr);
+}
+
+/* Draw the wireless icon with `level` arcs lit & the rest dimmed */
+static void draw_wireless(cairo_t* cr, int size, gint level)
+{
+    const double line_width = size / 10;
+    const double root_x = size / 2;
+    const double root_y = size - (line_width * 3);
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, line_width);
+
+    cairo_arc(cr, root_x, root_y, line_width, 0, 2 * G_PI);
+    cairo_fill(cr);
+
+    for (gint arc = 0; arc < WIRELESS_LEVEL_MAX; arc++) {
+        cairo_set_source_rgba(cr, 1, 1, 1, arc < level ? 1 : 0.3);
+        cairo_arc(cr, root_x, root_y, (3 + 2 * arc) * line_width, -3 * G_PI_4, -G_PI_4);
+        cairo_stroke(cr);
+    }
+}
+
+static void draw_offline(cairo_t* cr, int size)
+{
+    const double line_width = size / 10;
+    const double center = size / 2;
+    const double sign_center_x = size / 3;
+    const double sign_center_y = size - sign_center_x;
+    const double sign_radius = size / 3 - line_width;
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, line_width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+
+    // internet globe
+    cairo_arc(cr, center, center, center - line_width/2, -G_PI * 1.1, G_PI_2);
+    cairo_stroke(cr);
+
+    // inner lines "vertical"
+    cairo_arc(cr, size+line_width/2, center, size*0.75, G_PI*1.05, G_PI*1.25);
+    cairo_arc(cr, -line_width/2, center, size*0.75, -G_PI_4, G_PI_4*0.7);
+    cairo_stroke(cr);
+
+    // inner lines "horizontal"
+    cairo_arc(cr, center, -4*line_width, size*0.75, G_PI_4*1.25, G_PI_2*0.8);
+    cairo_arc(cr, center, -4*line_width, size*0.75, G_PI_2*1.2, G_PI*0.69);
+    cairo_stroke(cr);
+
+    cairo_arc(cr, center, -line_width, size*0.75, G_PI_4*1.3, G_PI_2*0.9);
+    cairo_stroke(cr);
+
+    // sign
+    cairo_arc(cr, sign_center_x, sign_center_y, sign_radius, -G_PI_4, G_PI - G_PI_4);
+    cairo_line_to(cr, sign_center_x, sign_center_y);
+    cairo_arc(cr, sign_center_x, sign_center_y, sign_radius, G_PI - G_PI_4, -G_PI_4);
+    cairo_line_to(cr, sign_center_x, sign_center_y);
+    
+    cairo_stroke(cr);
+}
+
+/* The battery, filled to `step` of ICON_BATTERY_STEPS - 1, with a plug over
+ * its lower left corner while charging.
+ */
+static void draw_battery(cairo_t* cr, int size, gint step, gboolean is_charging)
+{
+    const double top = size / 4;
+    const double left = size * 0.28;
+    const double bottom = size - (top / 2);
+    const double right = size - left;
+    const double width = right - left;
+    const double height = bottom - top;
+    const double line_width = height / 10;
+
+    // draw outline
+    cairo_push_group(cr);
+    draw_battery_outline(cr, size);
+    cairo_pop_group_to_source(cr);
+
+    if (is_charging) {
+        // set mask
+        cairo_rectangle(cr, 0, 0, size, top + (height / 3));
+        cairo_fill(cr);
+        cairo_rectangle(cr,
+            left + line_width, top + (height / 3),
+            size, size);
+        cairo_fill(cr);
+
+        // draw charger
+        draw_charger(cr, size);
+
+    } else {
+        cairo_paint(cr);
+    }
+
+    // draw charge
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_rectangle(cr,
+        left + line_width, bottom - line_width,
+        width - (2*line_width), -(height - (2*line_width)) * step / (ICON_BATTERY_STEPS - 1.0));
+    cairo_fill(cr);
+}
+
+static void draw_battery_outline(cairo_t* cr, int size)
+{
+    const double top = size / 4;
+    const double left = size * 0.28;
+    const double bottom = size - (top / 2);
+    const double right = size - left;
+    const double width = right - left;
+    const double height = bottom - top;
+    const double line_width = height / 10;
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, line_width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+
+    // left side
+    cairo_move_to(cr, left, top);
+    cairo_line_to(cr, left, bottom);
+    cairo_stroke(cr);
+    // right side
+    cairo_move_to(cr, right, top);
+    cairo_line_to(cr, right, bottom);
+    cairo_stroke(cr);
+
+    // top side
+    cairo_move_to(cr, left, top);
+    cairo_line_to(cr, right, top);
+    cairo_stroke(cr);
+
+    // bottom side
+    cairo_move_to(cr, left, bottom);
+    cairo_line_to(cr, right, bottom);
+    cairo_stroke(cr);
+
+    // knob thingy
+    cairo_set_line_width(cr, line_width * 3);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_move_to(cr, left + (width*0.38), top - (line_width * 1.2));
+    cairo_line_to(cr, right - (width*0.38), top - (line_width * 1.2));
+    cairo_stroke(cr);
+}
+
+static void draw_charger(cairo_t* cr, int size)
+{
+    const double top = size / 4;
+    const double left = size * 0.28;
+    const double bottom = size - (top / 2);
+    const double height = bottom - top;
+    const double line_width = height / 10;
+
+    const double charger_left = left / 4 * 3;
+
+    // draw charger
+    cairo_set_source_rgb(cr, 1, 1, 1);
+
+    cairo_set_line_width(cr, line_width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_move_to(cr, charger_left, top + (height * 0.7));
+    cairo_line_to(cr, charger_left, size);
+    cairo_stroke(cr);
+
+    cairo_rectangle(cr,
+        charger_left - (charger_left/2), top + (height/3*2),
+        line_width*3, height / 5);
+    cairo_fill(cr);
+
+    // prongs
+    cairo_set_line_width(cr, line_width * 0.9);
+    cairo_move_to(cr, charger_left - (line_width/3*2), top + (height * 0.55));
+    cairo_line_to(cr, charger_left - (line_width/3*2), top + (height * 0.7));
+    cairo_stroke(cr);
+    cairo_move_to(cr, charger_left + (line_width/2), top + (height * 0.55));
+    cairo_line_to(cr, charger_left + (line_width/2), top + (height * 0.7));
+    cairo_stroke(cr);
+}
+
+static void draw_shutdown(cairo_t* cr, int size)
+{
+    const double line_width = size / 10;
+    const double center = size / 2;
+    const double radius = (size / 2) - (line_width / 2);
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_set_line_width(cr, line_width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+
+    cairo_arc(cr, center, center, radius, -G_PI_4, G_PI + G_PI_4);
+    cairo_stroke(cr);
+
+    cairo_move_to(cr, center, line_width);
+    cairo_line_to(cr, center, center);
+    cairo_stroke(cr);
+}
+
+/* Drawn in the default color of symbolic icons, which the button's light
+ * background was styled around
+ */
+static gboolean draw_arrow_widget(GtkWidget* widget, cairo_t* cr, gpointer user_data)
+{
+    const double size = ICON_ARROW_SIZE;
+    const double line_width = size / 8;
+    cairo_translate(cr, (gtk_widget_get_allocated_width(widget) - size) / 2,
+                    (gtk_widget_get_allocated_height(widget) - size) / 2);
+
+    cairo_set_source_rgb(cr, 0.18, 0.204, 0.212);
+    cairo_set_line_width(cr, line_width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+
+    cairo_move_to(cr, size * 0.2, size / 2);
+    cairo_line_to(cr, size * 0.8, size / 2);
+    cairo_move_to(cr, size * 0.5, size * 0.2);
+    cairo_line_to(cr, size * 0.8, size / 2);
+    cairo_line_to(cr, size * 0.5, size * 0.8);
+    cairo_stroke(cr);
+    return FALSE;
+}
@@ -0,0 +1,37 @@
+#ifndef ICONS_H
+#define ICONS_H
+
+#include <gtk/gtk.h>
+
+#include "wireless.h"
+
+// The width & height of a status icon, in pixels
+#define ICON_SIZE 27
+// How many charge levels the battery icon shows, from empty to full
+#define ICON_BATTERY_STEPS 6
+// The width & height of the login button's arrow, in pixels
+#define ICON_ARROW_SIZE 15
+
+
+/* A glyph in the icon atlas. The wireless icon takes up a glyph per signal
+ * level & the battery icon one per charge step, followed by the same steps
+ * while charging.
+ */
+typedef enum IconGlyph_ {
+    ICON_NONE = -1,
+    ICON_ETHERNET,
+    ICON_OFFLINE,
+    ICON_WIRELESS,
+    ICON_BATTERY = ICON_WIRELESS + WIRELESS_LEVEL_MAX + 1,
+    ICON_SHUTDOWN = ICON_BATTERY + 2 * ICON_BATTERY_STEPS,
+    ICON_COUNT,
+} IconGlyph;
+
+
+GtkWidget* icon_widget_new(IconGlyph glyph);
+void icon_widget_set_glyph(GtkWidget* widget, IconGlyph glyph);
+IconGlyph icon_wireless_glyph(gint level);
+IconGlyph icon_battery_glyph(gint percentage, gboolean is_charging);
+GtkWidget* icon_arrow_new(void);
+
+#endif
@@ -0,0 +1,196 @@
+/* Notice When Nobody is at the Screen, Without Polling for It */
+#include <stdlib.h>
+#include <string.h>
+
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <glib.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/dpms.h>
+#include <X11/extensions/sync.h>
+
+#include "idle.h"
+
+
+static gboolean find_idle_counter(IdleMonitor *monitor);
+static guint get_dpms_timeout_ms(Display *display);
+static gboolean is_screen_off(Display *display);
+static gint64 get_idle_ms(IdleMonitor *monitor);
+static void set_alarm(IdleMonitor *monitor, XSyncTestType test_type, gint64 wait_ms);
+static GdkFilterReturn filter_alarm_events(GdkXEvent *gdk_xevent, GdkEvent *event,
+                                           gpointer user_data);
+static void set_idle(IdleMonitor *monitor, gboolean is_idle);
+
+
+/* Go idle after `timeout_seconds` without input, or sooner if DPMS blanks the
+ * screen sooner. A screen DPMS has already turned off is idle right away.
+ *
+ * Without the SYNC extension the greeter is never idle.
+ */
+IdleMonitor *initialize_idle_monitor(guint timeout_seconds, IdleFunc func, gpointer data)
+{
+    IdleMonitor *monitor = malloc(sizeof(IdleMonitor));
+    if (monitor == NULL) {
+        g_error("Could not allocate memory for IdleMonitor");
+    }
+    monitor->display = gdk_x11_display_get_xdisplay(gdk_display_get_default());
+    monitor->alarm = None;
+    monitor->is_idle = FALSE;
+    monitor->func = func;
+    monitor->data = data;
+
+    monitor->timeout_ms = timeout_seconds * 1000;
+    const guint dpms_timeout_ms = get_dpms_timeout_ms(monitor->display);
+    if (dpms_timeout_ms > 0 && dpms_timeout_ms < monitor->timeout_ms) {
+        monitor->timeout_ms = dpms_timeout_ms;
+    }
+
+    if (!find_idle_counter(monitor)) {
+        g_message("The X server has no IDLETIME counter, never going idle");
+        return monitor;
+    }
+    gdk_window_add_filter(NULL, &filter_alarm_events, monitor);
+    set_alarm(monitor, XSyncPositiveComparison, monitor->timeout_ms);
+    if (is_screen_off(monitor->display)) {
+        set_idle(monitor, TRUE);
+    }
+    return monitor;
+}
+
+void destroy_idle_monitor(IdleMonitor *monitor)
+{
+    if (monitor->alarm != None) {
+        gdk_window_remove_filter(NULL, &filter_alarm_events, monitor);
+        XSyncDestroyAlarm(monitor->display, monitor->alarm);
+    }
+    free(monitor);
+}
+
+
+/* Find the server's counter of milliseconds since the last input */
+static gboolean find_idle_counter(IdleMonitor *monitor)
+{
+    int error_base, major_version, minor_version;
+    if (!XSyncQueryExtension(monitor->display, &monitor->sync_event_base, &error_base) ||
+            !XSyncInitialize(monitor->display, &major_version, &minor_version)) {
+        return FALSE;
+    }
+    int counter_count;
+    XSyncSystemCounter *counters = XSyncListSystemCounters(monitor->display, &counter_count);
+    gboolean found = FALSE;
+    for (int c = 0; c < counter_count && !found; c++) {
+        if (strcmp(counters[c].name, "IDLETIME") == 0) {
+            monitor->idle_counter = counters[c].counter;
+            found = TRUE;
+        }
+    }
+    if (counters != NULL) {
+        XSyncFreeSystemCounterList(counters);
+    }
+    return found;
+}
+
+/* How long DPMS waits before its first power saving step, or 0 if it never
+ * does
+ */
+static guint get_dpms_timeout_ms(Display *display)
+{
+    int event_base, error_base;
+    CARD16 power_level;
+    BOOL enabled;
+    if (!DPMSQueryExtension(display, &event_base, &error_base) || !DPMSCapable(display) ||
+            !DPMSInfo(display, &power_level, &enabled) || !enabled) {
+        return 0;
+    }
+    CARD16 standby, suspend, off;
+    DPMSGetTimeouts(display, &standby, &suspend, &off);
+    guint timeout = 0;
+    const CARD16 timeouts[] = { standby, suspend, off };
+    for (guint t = 0; t < G_N_ELEMENTS(timeouts); t++) {
+        if (timeouts[t] > 0 && (timeout == 0 || timeouts[t] < timeout)) {
+            timeout = timeouts[t];
+        }
+    }
+    return timeout * 1000;
+}
+
+/* Whether DPMS has put the monitors into a power saving mode */
+static gboolean is_screen_off(Display *display)
+{
+    int event_base, error_base;
+    CARD16 power_level;
+    BOOL enabled;
+    return DPMSQueryExtension(display, &event_base, &error_base) && DPMSCapable(display) &&
+        DPMSInfo(display, &power_level, &enabled) && enabled && power_level != DPMSModeOn;
+}
+
+static gint64 get_idle_ms(IdleMonitor *monitor)
+{
+    XSyncValue value;
+    if (!XSyncQueryCounter(monitor->display, monitor->idle_counter, &value)) {
+        return 0;
+    }
+    return (gint64) XSyncValueHigh32(value) * G_GINT64_CONSTANT(0x100000000) +
+        (gint64) XSyncValueLow32(value);
+}
+
+/* Fire once the idle time passes `wait_ms` in the test's direction */
+static void set_alarm(IdleMonitor *monitor, XSyncTestType test_type, gint64 wait_ms)
+{
+    XSyncAlarmAttributes attributes;
+    attributes.trigger.counter = monitor->idle_counter;
+    attributes.trigger.value_type = XSyncAbsolute;
+    attributes.trigger.test_type = test_type;
+    XSyncIntsToValue(&attributes.trigger.wait_value, (unsigned int) (wait_ms & 0xFFFFFFFF),
+                     (int) (wait_ms >> 32));
+    XSyncIntToValue(&attributes.delta, 0);
+    attributes.events = True;
+    const unsigned long flags = XSyncCACounter | XSyncCAValueType | XSyncCATestType |
+                                XSyncCAValue | XSyncCADelta | XSyncCAEvents;
+    if (monitor->alarm == None) {
+        monitor->alarm = XSyncCreateAlarm(monitor->display, flags, &attributes);
+    } else {
+        XSyncChangeAlarm(monitor->display, monitor->alarm, flags, &attributes);
+    }
+    XFlush(monitor->display);
+}
+
+static GdkFilterReturn filter_alarm_events(GdkXEvent *gdk_xevent, GdkEvent *event,
+                                           gpointer user_data)
+{
+    IdleMonitor *monitor = (IdleMonitor *) user_data;
+    XEvent *xevent = (XEvent *) gdk_xevent;
+    if (xevent->type != monitor->sync_event_base + XSyncAlarmNotify) {
+        return GDK_FILTER_CONTINUE;
+    }
+    XSyncAlarmNotifyEvent *alarm_event = (XSyncAlarmNotifyEvent *) gdk_xevent;
+    if (alarm_event->alarm != monitor->alarm || alarm_event->state == XSyncAlarmDestroyed) {
+        return GDK_FILTER_CONTINUE;
+    }
+    set_idle(monitor, !monitor->is_idle);
+    return GDK_FILTER_REMOVE;
+}
+
+/* Switch the alarm to watch for the opposite change, & report this one.
+ *
+ * Input resets the idle time to 0, so while idle the alarm fires as soon as
+ * it drops below its current value.
+ */
+static void set_idle(IdleMonitor *monitor, gboolean is_idle)
+{
+    if (is_idle) {
+        const gint64 idle_ms = get_idle_ms(monitor);
+        if (idle_ms == 0) {
+            // Someone is at the screen after all
+            set_alarm(monitor, XSyncPositiveComparison, monitor->timeout_ms);
+            return;
+        }
+        set_alarm(monitor, XSyncNegativeTransition, idle_ms - 1);
+        g_message("No input for %" G_GINT64_FORMAT "ms, going idle", idle_ms);
+    } else {
+        set_alarm(monitor, XSyncPositiveComparison, monitor->timeout_ms);
+        g_message("Input after being idle, waking up");
+    }
+    monitor->is_idle = is_idle;
+    monitor->func(is_idle, monitor->data);
+}
@@ -0,0 +1,35 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <glib.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/sync.h>
+
+
+/* Called when nobody has touched the keyboard or mouse for the idle timeout,
+ * & again on the first input after that.
+ */
+typedef void (*IdleFunc)(gboolean is_idle, gpointer data);
+
+/* Follows the X server's IDLETIME counter with an XSync alarm, so the
+ * greeter is only woken when the screen becomes unattended or is used again.
+ */
+typedef struct IdleMonitor_ {
+    Display      *display;
+    int           sync_event_base;
+    XSyncCounter  idle_counter;
+    // None if the server has no SYNC extension or IDLETIME counter
+    XSyncAlarm    alarm;
+    // Milliseconds without input before the screen counts as unattended
+    guint         timeout_ms;
+
+    gboolean      is_idle;
+    IdleFunc      func;
+    gpointer      data;
+} IdleMonitor;
+
+
+IdleMonitor *initialize_idle_monitor(guint timeout_seconds, IdleFunc func, gpointer data);
+void destroy_idle_monitor(IdleMonitor *monitor);
+
+#endif
@@ -5,15 +5,36 @@
 #include <gtk/gtkx.h>
 
 #include "app.h"
+#include "callbacks.h"
+#include "root_window.h"
+#include "scheduler.h"
+#include "startup_profile.h"
 #include "utils.h"
 
 
+/* Build the session ring once the first frame is on screen */
+static void make_session_focus_ring_deferred(gpointer user_data)
+{
+    make_session_focus_ring((App *) user_data);
+}
+
+
 int main(int argc, char **argv)
 {
+    // Cover the root window with our colors while GTK starts up
+    root_window_paint_splash();
+
     // This is apparently a bad idea, so we disable it (source: lightdm-gtk-greeter)
     // mlockall(MCL_CURRENT | MCL_FUTURE);  // Keep data out of any swap devices
 
-    App *app = initialize_app(argc, argv);
+    // Hold on to any keys typed while the UI is being built
+    TypeAhead *typeahead = initialize_typeahead();
+    typeahead_grab_early(typeahead);
+
+    // Read everything the last startup touched before GTK starts faulting it in
+    startup_profile_replay();
+
+    App *app = initialize_app(argc, argv, typeahead);
 
     if (!connect_to_lightdm_daemon(app->greeter)) {
         return EXIT_FAILURE;
@@ -28,14 +49,24 @@ int main(int argc, char **argv)
         XSetScreenSaver(display, 30, 0, ScreenSaverActive, DefaultExposures);
     }
 
-    begin_authentication_as_default_user(app);
-    make_session_focus_ring(app);
-
-    for (int m = 0; m < APP_MONITOR_COUNT(app); m++) {
-        gtk_widget_show_all(GTK_WIDGET(APP_BACKGROUND_WINDOWS(app)[m]));
+    begin_authentication_as_current_user(app);
+    scheduler_add(app->scheduler, "session-ring", SCHEDULER_PRIORITY_HIGH,
+                  &make_session_focus_ring_deferred, app);
+    if (app->config->record_startup_profile) {
+        // Queued last so it samples everything the other deferred work loaded
+        scheduler_add(app->scheduler, "startup-profile", SCHEDULER_PRIORITY_LOW,
+                      &startup_profile_record, NULL);
     }
+
+    ui_show_background_windows(app->ui);
     gtk_widget_show_all(GTK_WIDGET(APP_MAIN_WINDOW(app)));
     gtk_window_present(APP_MAIN_WINDOW(app));
+
+    typeahead_release_early(app->typeahead);
+    if (!typeahead_is_empty(app->typeahead)) {
+        show_login_page(app);
+    }
+    scheduler_start(app->scheduler, GTK_WIDGET(APP_MAIN_WINDOW(app)));
     gtk_main();
 
     destroy_app(app);
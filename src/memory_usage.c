@@ -0,0 +1,121 @@
+/* Account for the Pixel Buffers We Hold & Report the Process' Memory Use */
+#include <stdio.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+#include "memory_usage.h"
+
+#define MIB(bytes) ((gdouble) (bytes) / (1024.0 * 1024.0))
+
+
+static const gchar *owner_names[MEMORY_OWNER_COUNT] = {
+    "wallpapers",
+    "blurred wallpapers",
+    "icons",
+    "user image",
+    "animation frames",
+};
+
+// Bytes currently held & the most ever held, per owner & in total
+static gsize owner_bytes[MEMORY_OWNER_COUNT];
+static gsize owner_peak_bytes[MEMORY_OWNER_COUNT];
+static gsize total_bytes;
+static gsize total_peak_bytes;
+G_LOCK_DEFINE_STATIC(memory_usage);
+
+static gsize get_status_kib(const gchar *field);
+
+
+/* Count a pixel buffer as held by an owner */
+void memory_usage_add(MemoryOwner owner, GdkPixbuf *pixbuf)
+{
+    if (pixbuf != NULL) {
+        memory_usage_add_bytes(owner, gdk_pixbuf_get_byte_length(pixbuf));
+    }
+}
+
+/* Stop counting a pixel buffer that was passed to memory_usage_add */
+void memory_usage_remove(MemoryOwner owner, GdkPixbuf *pixbuf)
+{
+    if (pixbuf != NULL) {
+        memory_usage_remove_bytes(owner, gdk_pixbuf_get_byte_length(pixbuf));
+    }
+}
+
+/* Count pixels held in something other than a GdkPixbuf, like a surface */
+void memory_usage_add_bytes(MemoryOwner owner, gsize bytes)
+{
+    G_LOCK(memory_usage);
+    owner_bytes[owner] += bytes;
+    owner_peak_bytes[owner] = MAX(owner_peak_bytes[owner], owner_bytes[owner]);
+    total_bytes += bytes;
+    total_peak_bytes = MAX(total_peak_bytes, total_bytes);
+    G_UNLOCK(memory_usage);
+}
+
+void memory_usage_remove_bytes(MemoryOwner owner, gsize bytes)
+{
+    G_LOCK(memory_usage);
+    owner_bytes[owner] -= MIN(bytes, owner_bytes[owner]);
+    total_bytes -= MIN(bytes, total_bytes);
+    G_UNLOCK(memory_usage);
+}
+
+
+/* The process' resident set size in bytes, or 0 if it can't be read */
+gsize memory_usage_get_rss(void)
+{
+    return get_status_kib("VmRSS:") * 1024;
+}
+
+/* Return freed heap memory to the system */
+void memory_usage_trim(void)
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+/* Log the bytes held by each owner, & the current & peak RSS */
+void memory_usage_log(const gchar *reason)
+{
+    GString *report = g_string_new(NULL);
+    G_LOCK(memory_usage);
+    for (int owner = 0; owner < MEMORY_OWNER_COUNT; owner++) {
+        g_string_append_printf(report, "%s %.1fMiB (peak %.1fMiB), ", owner_names[owner],
+                               MIB(owner_bytes[owner]), MIB(owner_peak_bytes[owner]));
+    }
+    g_string_append_printf(report, "pixels %.1fMiB (peak %.1fMiB)",
+                           MIB(total_bytes), MIB(total_peak_bytes));
+    G_UNLOCK(memory_usage);
+
+    g_message("Memory after %s: %s; RSS %.1fMiB (peak %.1fMiB)", reason, report->str,
+              MIB(get_status_kib("VmRSS:") * 1024), MIB(get_status_kib("VmHWM:") * 1024));
+    g_string_free(report, TRUE);
+}
+
+
+/* Read a `kB` field from /proc/self/status */
+static gsize get_status_kib(const gchar *field)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        return 0;
+    }
+    gsize kib = 0;
+    gsize field_length = strlen(field);
+    char line[256];
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, field, field_length) == 0) {
+            kib = (gsize) g_ascii_strtoull(line + field_length, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kib;
+}
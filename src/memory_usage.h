@@ -0,0 +1,27 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+
+/* What a pixel buffer is held for */
+typedef enum MemoryOwner_ {
+    MEMORY_OWNER_WALLPAPER,
+    MEMORY_OWNER_WALLPAPER_BLUR,
+    MEMORY_OWNER_ICONS,
+    MEMORY_OWNER_USER_IMAGE,
+    MEMORY_OWNER_ANIMATION,
+    MEMORY_OWNER_COUNT,
+} MemoryOwner;
+
+
+void memory_usage_add(MemoryOwner owner, GdkPixbuf *pixbuf);
+void memory_usage_remove(MemoryOwner owner, GdkPixbuf *pixbuf);
+void memory_usage_add_bytes(MemoryOwner owner, gsize bytes);
+void memory_usage_remove_bytes(MemoryOwner owner, gsize bytes);
+gsize memory_usage_get_rss(void);
+void memory_usage_trim(void);
+void memory_usage_log(const gchar *reason);
+
+#endif
@@ -0,0 +1,111 @@
+/* Build & Walk Netlink Messages Without the Kernel's Signed-Length Macros */
+#include <string.h>
+
+#include "netlink.h"
+
+
+// NLA_HDRLEN, unsigned. The header is already aligned.
+#define NETLINK_ATTRIBUTE_HEADER_LENGTH sizeof(struct nlattr)
+
+
+static gsize align_attribute(gsize length);
+
+
+/* Start a request with a header of `header_length` bytes after the netlink
+ * header, zeroed for the caller to fill in. The result points into the
+ * request & is valid until the next call.
+ */
+struct nlmsghdr* netlink_request_start(NetlinkRequest* request, guint16 type, guint16 flags,
+                                       guint32 sequence, gsize header_length)
+{
+    memset(request->data, 0, sizeof(request->data));
+    struct nlmsghdr* header = (struct nlmsghdr*) request->data;
+    request->length = NLMSG_ALIGN(NLMSG_HDRLEN + header_length);
+    header->nlmsg_len = (guint32) request->length;
+    header->nlmsg_type = type;
+    header->nlmsg_flags = flags;
+    header->nlmsg_seq = sequence;
+    return header;
+}
+
+/* Append an attribute. Requests are small, so running out of room is a bug. */
+void netlink_request_add(NetlinkRequest* request, guint16 type, const void* data,
+                         gsize length)
+{
+    const gsize attribute_length = NETLINK_ATTRIBUTE_HEADER_LENGTH + length;
+    g_assert(request->length + align_attribute(attribute_length) <= sizeof(request->data));
+
+    struct nlattr* attribute = (struct nlattr*) ((guint8*) request->data + request->length);
+    attribute->nla_len = (guint16) attribute_length;
+    attribute->nla_type = type;
+    if (length > 0) {
+        memcpy((guint8*) attribute + NETLINK_ATTRIBUTE_HEADER_LENGTH, data, length);
+    }
+    request->length += align_attribute(attribute_length);
+    ((struct nlmsghdr*) request->data)->nlmsg_len = (guint32) request->length;
+}
+
+/* The message at `offset` in a received datagram, advancing `offset` past
+ * it. NULL at the end of the datagram or on a truncated message.
+ */
+const struct nlmsghdr* netlink_next_message(const void* buffer, gsize length, gsize* offset)
+{
+    if (*offset + sizeof(struct nlmsghdr) > length) {
+        return NULL;
+    }
+    const struct nlmsghdr* header =
+        (const struct nlmsghdr*) ((const guint8*) buffer + *offset);
+    if (header->nlmsg_len < sizeof(struct nlmsghdr) || *offset + header->nlmsg_len > length) {
+        return NULL;
+    }
+    *offset += NLMSG_ALIGN(header->nlmsg_len);
+    return header;
+}
+
+/* The attribute at `offset` in `length` bytes of attributes, advancing
+ * `offset` past it. Route attributes share this layout.
+ */
+const struct nlattr* netlink_next_attribute(const void* attributes, gsize length,
+                                            gsize* offset)
+{
+    if (*offset + sizeof(struct nlattr) > length) {
+        return NULL;
+    }
+    const struct nlattr* attribute =
+        (const struct nlattr*) ((const guint8*) attributes + *offset);
+    if ((gsize) attribute->nla_len < sizeof(struct nlattr) || *offset + attribute->nla_len > length) {
+        return NULL;
+    }
+    *offset += align_attribute(attribute->nla_len);
+    return attribute;
+}
+
+const struct nlattr* netlink_find_attribute(const void* attributes, gsize length,
+                                            guint16 type)
+{
+    gsize offset = 0;
+    const struct nlattr* attribute;
+    while ((attribute = netlink_next_attribute(attributes, length, &offset)) != NULL) {
+        if ((attribute->nla_type & NLA_TYPE_MASK) == type) {
+            return attribute;
+        }
+    }
+    return NULL;
+}
+
+const void* netlink_attribute_data(const struct nlattr* attribute)
+{
+    return (const guint8*) attribute + NETLINK_ATTRIBUTE_HEADER_LENGTH;
+}
+
+gsize netlink_attribute_length(const struct nlattr* attribute)
+{
+    return (gsize) attribute->nla_len - NETLINK_ATTRIBUTE_HEADER_LENGTH;
+}
+
+
+/* NLA_ALIGN, for unsigned lengths */
+static gsize align_attribute(gsize length)
+{
+    return (length + NLA_ALIGNTO - 1) & ~((gsize) NLA_ALIGNTO - 1);
+}
@@ -0,0 +1,31 @@
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <linux/netlink.h>
+
+#include <glib.h>
+
+// Large enough for a full page of messages from the kernel
+#define NETLINK_BUFFER_SIZE 8192
+
+
+/* A buffer for building a request, aligned for the message headers */
+typedef struct NetlinkRequest_ {
+    guint32 data[NETLINK_BUFFER_SIZE / sizeof(guint32)];
+    gsize   length;
+} NetlinkRequest;
+
+
+struct nlmsghdr* netlink_request_start(NetlinkRequest* request, guint16 type, guint16 flags,
+                                       guint32 sequence, gsize header_length);
+void netlink_request_add(NetlinkRequest* request, guint16 type, const void* data,
+                         gsize length);
+const struct nlmsghdr* netlink_next_message(const void* buffer, gsize length, gsize* offset);
+const struct nlattr* netlink_find_attribute(const void* attributes, gsize length,
+                                            guint16 type);
+const struct nlattr* netlink_next_attribute(const void* attributes, gsize length,
+                                            gsize* offset);
+const void* netlink_attribute_data(const struct nlattr* attribute);
+gsize netlink_attribute_length(const struct nlattr* attribute);
+
+#endif
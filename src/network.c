@@ -1,18 +1,19 @@
-#include <ifaddrs.h>
-#include <sys/types.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
-#include <sys/ioctl.h>
 #include <unistd.h>
-#include <linux/wireless.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
-#include "network.h"
+#include <glib-unix.h>
 
+#include "icons.h"
+#include "netlink.h"
+#include "network.h"
+#include "wireless.h"
 
-static GdkPixbuf* icon_wireless(int size);
-static GdkPixbuf* icon_ethernet(int size);
-static GdkPixbuf* icon_offline(int size);
 
 enum NetworkType {
     NW_NONE,
@@ -20,257 +21,402 @@ enum NetworkType {
     NW_WIRELESS,
 };
 
-static gboolean is_wireless(char* if_name)
-{
-    int sock = -1;
-    struct iwreq pwrq = { 0 };
+/* What is known about an interface, kept by its index */
+struct NetworkInterface {
+    // Classified once, when the interface first appears
+    gboolean    is_wireless;
+    gboolean    is_loopback;
+    gboolean    has_carrier;
+    // The interface's global addresses, as GBytes
+    GHashTable* addresses;
+};
+
+struct NetworkWidget {
+    GtkWidget*       icon;
+    enum NetworkType current_network;
+    int              socket;
+    guint            watch_id;
+    guint32          sequence;
+    // struct NetworkInterface by ifindex
+    GHashTable*      interfaces;
+    // Opened once a wireless link is in use
+    WirelessMonitor* wireless;
+    WallClock*       wall_clock;
+};
 
-    strncpy(pwrq.ifr_name, if_name, IFNAMSIZ);
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock == -1) {
-        return FALSE;
-    }
 
-    if (ioctl(sock, SIOCGIWNAME, &pwrq) != -1) {
-        close(sock);
-        return TRUE;
+static gboolean open_netlink_socket(struct NetworkWidget* nw_widget);
+static gboolean sync_interfaces(struct NetworkWidget* nw_widget);
+static gboolean dump_netlink(struct NetworkWidget* nw_widget, guint16 type);
+static gboolean handle_netlink_messages(gint fd, GIOCondition condition, gpointer user_data);
+static gboolean read_netlink_messages(struct NetworkWidget* nw_widget, int flags,
+                                      guint32 dump_sequence, gboolean* dump_done);
+static void handle_link_message(struct NetworkWidget* nw_widget, const struct nlmsghdr* header);
+static void handle_address_message(struct NetworkWidget* nw_widget,
+                                   const struct nlmsghdr* header);
+static struct NetworkInterface* new_interface(const struct ifinfomsg* link,
+                                              const struct nlattr* name);
+static void free_interface(gpointer data);
+static enum NetworkType get_network_type(struct NetworkWidget* nw_widget,
+                                        gint* wireless_ifindex);
+static void update_network_widget(struct NetworkWidget* nw_widget);
+static void handle_wireless_signal_changed(gint level, gpointer data);
+static void set_network_icon(struct NetworkWidget* nw_widget);
+static IconGlyph network_glyph(enum NetworkType type, gint wireless_level);
+static void free_network_widget(GtkWidget* widget, gpointer user_data);
+
+
+/* Create an icon representing the currently connected network.
+ *
+ * The icon follows the kernel's link & address notifications over
+ * RTNETLINK, so it only changes when an interface gains or loses its
+ * carrier or addresses.
+ */
+GtkWidget* init_network_widget(WallClock* wall_clock)
+{
+    struct NetworkWidget* nw_widget = malloc(sizeof(struct NetworkWidget));
+    nw_widget->wall_clock = wall_clock;
+    nw_widget->current_network = NW_NONE;
+    nw_widget->socket = -1;
+    nw_widget->watch_id = 0;
+    nw_widget->sequence = 0;
+    nw_widget->interfaces = g_hash_table_new_full(NULL, NULL, NULL, &free_interface);
+    nw_widget->wireless = NULL;
+    nw_widget->icon = icon_widget_new(ICON_OFFLINE);
+
+    if (open_netlink_socket(nw_widget) && sync_interfaces(nw_widget)) {
+        nw_widget->watch_id = g_unix_fd_add(nw_widget->socket, G_IO_IN,
+                                            &handle_netlink_messages, nw_widget);
     }
+    update_network_widget(nw_widget);
 
-    close(sock);
-    return FALSE;
+    g_signal_connect(G_OBJECT(nw_widget->icon), "destroy",
+                     G_CALLBACK(free_network_widget), nw_widget);
+    return nw_widget->icon;
 }
 
-static enum NetworkType get_network_type(void)
-{
-    struct ifaddrs *all_addresses, *address;
-    all_addresses = NULL;
 
-    if (getifaddrs(&all_addresses) == -1) {
-        return NW_NONE;
+/* Subscribe to link & address changes */
+static gboolean open_netlink_socket(struct NetworkWidget* nw_widget)
+{
+    nw_widget->socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nw_widget->socket == -1) {
+        g_warning("Could not open a netlink socket: %s", g_strerror(errno));
+        return FALSE;
     }
-    if (all_addresses == NULL) {
-        return NW_NONE;
+    struct sockaddr_nl address = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR,
+    };
+    if (bind(nw_widget->socket, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        g_warning("Could not subscribe to network changes: %s", g_strerror(errno));
+        close(nw_widget->socket);
+        nw_widget->socket = -1;
+        return FALSE;
     }
+    return TRUE;
+}
 
-    gboolean has_wireles = FALSE;
-    gboolean has_wired = FALSE;
-    for(address = all_addresses; address != NULL; address = address->ifa_next) {
-        if (strcmp(address->ifa_name, "lo") == 0)
-            continue;
-        
-        if (address->ifa_addr == NULL || address->ifa_addr->sa_family != AF_PACKET)
-            continue;
-        
-        if (is_wireless(address->ifa_name)) {
-            has_wireles = TRUE;
-        } else {
-            has_wired = TRUE;
+/* Fill the interface table from scratch, with the links before their
+ * addresses. Only one dump can run on a socket at a time.
+ */
+static gboolean sync_interfaces(struct NetworkWidget* nw_widget)
+{
+    g_hash_table_remove_all(nw_widget->interfaces);
+    const guint16 dumps[] = { RTM_GETLINK, RTM_GETADDR };
+    for (guint d = 0; d < G_N_ELEMENTS(dumps); d++) {
+        if (!dump_netlink(nw_widget, dumps[d])) {
+            return FALSE;
+        }
+        gboolean dump_done = FALSE;
+        while (!dump_done) {
+            if (!read_netlink_messages(nw_widget, 0, nw_widget->sequence, &dump_done) &&
+                    errno != EINTR) {
+                g_warning("Could not read the network interfaces: %s", g_strerror(errno));
+                return FALSE;
+            }
         }
     }
+    return TRUE;
+}
 
-    freeifaddrs(all_addresses);
-
-    if  (has_wired) {
-        return NW_WIRED;
-    } else if (has_wireles) {
-        return NW_WIRELESS;
-    } else {
-        return NW_NONE;
+static gboolean dump_netlink(struct NetworkWidget* nw_widget, guint16 type)
+{
+    NetlinkRequest request;
+    struct nlmsghdr* header = netlink_request_start(&request, type, NLM_F_REQUEST | NLM_F_DUMP,
+                                                    ++nw_widget->sequence,
+                                                    sizeof(struct rtgenmsg));
+    struct rtgenmsg* message = NLMSG_DATA(header);
+    message->rtgen_family = AF_UNSPEC;
+    if (send(nw_widget->socket, request.data, request.length, 0) == -1) {
+        g_warning("Could not request the network interfaces: %s", g_strerror(errno));
+        return FALSE;
     }
+    return TRUE;
 }
 
-struct NetworkWidget {
-    GtkWidget* image;
-    enum NetworkType current_network;
-};
-
-static gboolean update_network_widget(struct NetworkWidget* nw_widget)
+/* Runs whenever the kernel sends a notification */
+static gboolean handle_netlink_messages(gint fd, GIOCondition condition, gpointer user_data)
 {
-    enum NetworkType new_network = get_network_type();
-    if (new_network != nw_widget->current_network) {
-        nw_widget->current_network = new_network;
+    struct NetworkWidget* nw_widget = (struct NetworkWidget*) user_data;
+    gboolean dump_done = FALSE;
+    while (read_netlink_messages(nw_widget, MSG_DONTWAIT, 0, &dump_done)) {
+    }
+    if (errno == ENOBUFS) {
+        // Notifications were dropped, so the table can't be trusted anymore
+        g_message("Missed network notifications, reloading the interfaces");
+        if (!sync_interfaces(nw_widget)) {
+            nw_widget->watch_id = 0;
+            update_network_widget(nw_widget);
+            return G_SOURCE_REMOVE;
+        }
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        g_warning("Stopped following network changes: %s", g_strerror(errno));
+        nw_widget->watch_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    update_network_widget(nw_widget);
+    return G_SOURCE_CONTINUE;
+}
 
-        GdkPixbuf* icon;
-        if (new_network == NW_WIRED) {
-            icon = icon_ethernet(27);
+/* Read one datagram of messages. Returns FALSE with errno set if there was
+ * nothing to read or the read failed, & sets dump_done when the dump with
+ * the given sequence number is complete.
+ */
+static gboolean read_netlink_messages(struct NetworkWidget* nw_widget, int flags,
+                                      guint32 dump_sequence, gboolean* dump_done)
+{
+    // Aligned for the message headers
+    guint32 buffer[NETLINK_BUFFER_SIZE / sizeof(guint32)];
+    ssize_t received = recv(nw_widget->socket, buffer, sizeof(buffer), flags);
+    if (received == -1) {
+        return FALSE;
+    }
 
-        } else if (new_network == NW_WIRELESS) {
-            icon = icon_wireless(27);
-        } else {
-            icon = icon_offline(27);
+    gsize offset = 0;
+    const struct nlmsghdr* header;
+    while ((header = netlink_next_message(buffer, (gsize) received, &offset)) != NULL) {
+        switch (header->nlmsg_type) {
+            case NLMSG_DONE:
+                *dump_done = *dump_done || (dump_sequence != 0 &&
+                                            header->nlmsg_seq == dump_sequence);
+                break;
+            case NLMSG_ERROR:
+                if (header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+                    const struct nlmsgerr* error = NLMSG_DATA(header);
+                    g_warning("The kernel refused a network request: %s",
+                              g_strerror(-error->error));
+                }
+                *dump_done = *dump_done || (dump_sequence != 0 &&
+                                            header->nlmsg_seq == dump_sequence);
+                break;
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+                handle_link_message(nw_widget, header);
+                break;
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                handle_address_message(nw_widget, header);
+                break;
+            default:
+                break;
         }
-
-        gtk_image_set_from_pixbuf(GTK_IMAGE(nw_widget->image), icon);
-        g_object_unref(icon);
     }
     return TRUE;
 }
-/* Create an icon image representing the currently connected network */
-GtkWidget* init_network_widget(void)
-{
-    GdkPixbuf* icon;
-    enum NetworkType type = get_network_type();
-
-    if (type == NW_WIRED) {
-        icon = icon_ethernet(27);
 
-    } else if (type == NW_WIRELESS) {
-        icon = icon_wireless(27);
-    } else {
-        icon = icon_offline(27);
+static void handle_link_message(struct NetworkWidget* nw_widget, const struct nlmsghdr* header)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+        return;
     }
-
-    if (!icon) {
-        g_warning("[GREETER] network icon not found!\n");
+    const struct ifinfomsg* link = NLMSG_DATA(header);
+    gpointer key = GINT_TO_POINTER(link->ifi_index);
+    if (header->nlmsg_type == RTM_DELLINK) {
+        g_hash_table_remove(nw_widget->interfaces, key);
+        return;
     }
 
-    GtkImage* icon_image = GTK_IMAGE(gtk_image_new_from_pixbuf(icon));
-    g_object_unref(icon);
-
-    struct NetworkWidget* info = malloc(sizeof(struct NetworkWidget));
-    info->current_network = type;
-    info->image = GTK_WIDGET(icon_image);
+    struct NetworkInterface* interface = g_hash_table_lookup(nw_widget->interfaces, key);
+    if (interface == NULL) {
+        const struct nlattr* name = netlink_find_attribute(
+            IFLA_RTA(link), header->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+            IFLA_IFNAME);
+        interface = new_interface(link, name);
+        g_hash_table_insert(nw_widget->interfaces, key, interface);
+    }
+    interface->has_carrier = (link->ifi_flags & IFF_UP) != 0 &&
+        (link->ifi_flags & IFF_LOWER_UP) != 0;
+}
 
-    g_timeout_add_seconds(15, G_SOURCE_FUNC(update_network_widget), info);
+static void handle_address_message(struct NetworkWidget* nw_widget,
+                                   const struct nlmsghdr* header)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg))) {
+        return;
+    }
+    const struct ifaddrmsg* address_message = NLMSG_DATA(header);
+    struct NetworkInterface* interface = g_hash_table_lookup(
+        nw_widget->interfaces, GINT_TO_POINTER(address_message->ifa_index));
+    // Link-local addresses come up without any network attached
+    if (interface == NULL || address_message->ifa_scope >= RT_SCOPE_LINK) {
+        return;
+    }
 
-    return GTK_WIDGET(icon_image);
+    const gsize attributes_length = header->nlmsg_len - NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    const struct nlattr* address = netlink_find_attribute(IFA_RTA(address_message),
+                                                          attributes_length, IFA_LOCAL);
+    if (address == NULL) {
+        address = netlink_find_attribute(IFA_RTA(address_message), attributes_length,
+                                         IFA_ADDRESS);
+    }
+    if (address == NULL) {
+        return;
+    }
+    GBytes* bytes = g_bytes_new(netlink_attribute_data(address),
+                                netlink_attribute_length(address));
+    if (header->nlmsg_type == RTM_NEWADDR) {
+        g_hash_table_add(interface->addresses, bytes);
+    } else {
+        g_hash_table_remove(interface->addresses, bytes);
+        g_bytes_unref(bytes);
+    }
 }
 
-static GdkPixbuf* icon_ethernet(int size)
+/* Classify a new interface. Wireless drivers register a `wireless` or
+ * `phy80211` entry in sysfs, so this replaces asking each interface with an
+ * ioctl.
+ */
+static struct NetworkInterface* new_interface(const struct ifinfomsg* link,
+                                              const struct nlattr* name)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double line_width = size / 10;
-    const double top = line_width;
-    const double left = line_width;
-    const double right = size - line_width;
-    const double base = size - line_width;
-    const double monitor_bottom = size * 0.65;
-    const double plug_bottom = monitor_bottom - (2 * line_width);
-    const double plug_center = left + 2.2*line_width; 
-    const double plug_right = plug_center + 2.2*line_width;
-
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, line_width);
-
-    // common outline
-    cairo_move_to(cr, plug_right, top);
-    cairo_line_to(cr, plug_right, plug_bottom);
-    cairo_line_to(cr, left, plug_bottom);
-    cairo_line_to(cr, left, top);
-    cairo_line_to(cr, right, top);
-    cairo_line_to(cr, right, monitor_bottom);
-    cairo_line_to(cr, plug_center, monitor_bottom);
-    cairo_stroke(cr);
-
-    // chord
-    cairo_move_to(cr, plug_center, plug_bottom);
-    cairo_line_to(cr, plug_center, base);
-    cairo_stroke(cr);
-
-    // plug details
-    cairo_move_to(cr, plug_center, top + 1.6*line_width);
-    cairo_line_to(cr, plug_center, top + 4*line_width);
-
-    cairo_move_to(cr, left, top + 2.2*line_width);
-    cairo_line_to(cr, plug_right, top + 2.2*line_width);
-    cairo_stroke(cr);
-    
-    // Monitor base
-    const double monitor_center = (right-plug_center)/2 + plug_center;
-    cairo_move_to(cr, monitor_center, monitor_bottom);
-    cairo_line_to(cr, monitor_center, base);
-
-    cairo_move_to(cr, monitor_center - (2.5*line_width), base - (line_width/2));
-    cairo_line_to(cr, monitor_center + (2.5*line_width), base - (line_width/2));
-    cairo_stroke(cr);
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
-
-    return dest;
+    struct NetworkInterface* interface = malloc(sizeof(struct NetworkInterface));
+    interface->is_loopback = (link->ifi_flags & IFF_LOOPBACK) != 0;
+    interface->is_wireless = FALSE;
+    interface->has_carrier = FALSE;
+    interface->addresses = g_hash_table_new_full(&g_bytes_hash, &g_bytes_equal,
+                                                 (GDestroyNotify) &g_bytes_unref, NULL);
+    if (name != NULL && !interface->is_loopback) {
+        gchar* if_name = g_strndup(netlink_attribute_data(name), netlink_attribute_length(name));
+        gchar* wireless_path = g_build_filename("/sys/class/net", if_name, "wireless", NULL);
+        gchar* phy_path = g_build_filename("/sys/class/net", if_name, "phy80211", NULL);
+        interface->is_wireless = g_file_test(wireless_path, G_FILE_TEST_EXISTS) ||
+            g_file_test(phy_path, G_FILE_TEST_EXISTS);
+        g_free(phy_path);
+        g_free(wireless_path);
+        g_free(if_name);
+    }
+    return interface;
 }
 
-static GdkPixbuf* icon_wireless(int size)
+static void free_interface(gpointer data)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double line_width = size / 10;
-    const double root_x = size / 2;
-    const double root_y = size - (line_width * 3);
+    struct NetworkInterface* interface = (struct NetworkInterface*) data;
+    g_hash_table_destroy(interface->addresses);
+    free(interface);
+}
 
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, line_width);
+/* An interface counts as connected when it has a carrier & an address.
+ * Wired connections win over wireless ones. Sets `wireless_ifindex` to a
+ * connected wireless interface, or 0.
+ */
+static enum NetworkType get_network_type(struct NetworkWidget* nw_widget,
+                                        gint* wireless_ifindex)
+{
+    gboolean has_wired = FALSE;
+    *wireless_ifindex = 0;
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    g_hash_table_iter_init(&iter, nw_widget->interfaces);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        struct NetworkInterface* interface = (struct NetworkInterface*) value;
+        if (interface->is_loopback || !interface->has_carrier ||
+                g_hash_table_size(interface->addresses) == 0) {
+            continue;
+        }
+        if (interface->is_wireless) {
+            *wireless_ifindex = GPOINTER_TO_INT(key);
+        } else {
+            has_wired = TRUE;
+        }
+    }
 
-    cairo_arc(cr, root_x, root_y, line_width, 0, 2 * G_PI);
-    cairo_fill(cr);
+    if  (has_wired) {
+        return NW_WIRED;
+    } else if (*wireless_ifindex != 0) {
+        return NW_WIRELESS;
+    } else {
+        return NW_NONE;
+    }
+}
 
-    cairo_arc(cr, root_x, root_y, 3*line_width, -3 * G_PI_4, -G_PI_4);
-    cairo_stroke(cr);
+/* Swap the icon if the kind of connection changed, & follow the signal of
+ * the wireless link in use.
+ */
+static void update_network_widget(struct NetworkWidget* nw_widget)
+{
+    gint wireless_ifindex;
+    enum NetworkType new_network = get_network_type(nw_widget, &wireless_ifindex);
+    if (new_network == NW_WIRELESS && nw_widget->wireless == NULL) {
+        nw_widget->wireless = initialize_wireless_monitor(nw_widget->wall_clock,
+                                                          &handle_wireless_signal_changed,
+                                                          nw_widget);
+    }
+    if (nw_widget->wireless != NULL) {
+        wireless_monitor_set_interface(nw_widget->wireless,
+                                       new_network == NW_WIRELESS ? wireless_ifindex : 0);
+    }
 
-    cairo_arc(cr, root_x, root_y, 5*line_width,  -3 * G_PI_4, -G_PI_4);
-    cairo_stroke(cr);
+    if (new_network == nw_widget->current_network) {
+        return;
+    }
+    nw_widget->current_network = new_network;
+    set_network_icon(nw_widget);
+}
 
-    cairo_arc(cr, root_x, root_y, 7*line_width,  -3 * G_PI_4, -G_PI_4);
-    cairo_stroke(cr);
+/* Show the wireless glyph for a new signal level */
+static void handle_wireless_signal_changed(gint level, gpointer data)
+{
+    struct NetworkWidget* nw_widget = (struct NetworkWidget*) data;
+    if (nw_widget->current_network == NW_WIRELESS) {
+        set_network_icon(nw_widget);
+    }
+}
 
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
+static void set_network_icon(struct NetworkWidget* nw_widget)
+{
+    const gint wireless_level = nw_widget->wireless == NULL
+        ? WIRELESS_LEVEL_UNKNOWN : nw_widget->wireless->level;
+    icon_widget_set_glyph(nw_widget->icon,
+                          network_glyph(nw_widget->current_network, wireless_level));
+}
 
-    return dest;
+static IconGlyph network_glyph(enum NetworkType type, gint wireless_level)
+{
+    switch (type) {
+        case NW_WIRED:
+            return ICON_ETHERNET;
+        case NW_WIRELESS:
+            return icon_wireless_glyph(wireless_level);
+        case NW_NONE:
+            return ICON_OFFLINE;
+    }
+    return ICON_OFFLINE;
 }
 
-static GdkPixbuf* icon_offline(int size)
+static void free_network_widget(GtkWidget* widget, gpointer user_data)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double line_width = size / 10;
-    const double center = size / 2;
-    const double sign_center_x = size / 3;
-    const double sign_center_y = size - sign_center_x;
-    const double sign_radius = size / 3 - line_width;
-
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, line_width);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-
-    // internet globe
-    cairo_arc(cr, center, center, center - line_width/2, -G_PI * 1.1, G_PI_2);
-    cairo_stroke(cr);
-
-    // inner lines "vertical"
-    cairo_arc(cr, size+line_width/2, center, size*0.75, G_PI*1.05, G_PI*1.25);
-    cairo_arc(cr, -line_width/2, center, size*0.75, -G_PI_4, G_PI_4*0.7);
-    cairo_stroke(cr);
-
-    // inner lines "horizontal"
-    cairo_arc(cr, center, -4*line_width, size*0.75, G_PI_4*1.25, G_PI_2*0.8);
-    cairo_arc(cr, center, -4*line_width, size*0.75, G_PI_2*1.2, G_PI*0.69);
-    cairo_stroke(cr);
-
-    cairo_arc(cr, center, -line_width, size*0.75, G_PI_4*1.3, G_PI_2*0.9);
-    cairo_stroke(cr);
-
-    // sign
-    cairo_arc(cr, sign_center_x, sign_center_y, sign_radius, -G_PI_4, G_PI - G_PI_4);
-    cairo_line_to(cr, sign_center_x, sign_center_y);
-    cairo_arc(cr, sign_center_x, sign_center_y, sign_radius, G_PI - G_PI_4, -G_PI_4);
-    cairo_line_to(cr, sign_center_x, sign_center_y);
-    
-    cairo_stroke(cr);
-
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
-
-    return dest;
+    struct NetworkWidget* nw_widget = (struct NetworkWidget*) user_data;
+    if (nw_widget->watch_id != 0) {
+        g_source_remove(nw_widget->watch_id);
+    }
+    if (nw_widget->socket != -1) {
+        close(nw_widget->socket);
+    }
+    if (nw_widget->wireless != NULL) {
+        destroy_wireless_monitor(nw_widget->wireless);
+    }
+    g_hash_table_destroy(nw_widget->interfaces);
+    free(nw_widget);
 }
@@ -1,3 +1,5 @@
 #include <gtk/gtk.h>
 
-GtkWidget* init_network_widget(void);
+#include "wall_clock.h"
+
+GtkWidget* init_network_widget(WallClock* wall_clock);
@@ -0,0 +1,416 @@
+/* Warm the Page Cache for the Selected Session */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "prefetch.h"
+
+// From linux/ioprio.h, which is not shipped by every libc
+#define PREFETCH_IOPRIO_CLASS_IDLE 3
+#define PREFETCH_IOPRIO_CLASS_SHIFT 13
+#define PREFETCH_IOPRIO_WHO_PROCESS 1
+
+// Only objects matching the greeter's own word size are inspected
+#if __ELF_NATIVE_CLASS == 64
+#define PREFETCH_ELF_CLASS ELFCLASS64
+#else
+#define PREFETCH_ELF_CLASS ELFCLASS32
+#endif
+
+
+struct PrefetchJob {
+    gchar        *session_key;
+    gchar       **extra_paths;
+    GCancellable *cancellable;
+};
+
+static gpointer run_prefetch_job(gpointer data);
+static void lower_thread_priority(void);
+static gchar *find_session_executable(const gchar *session_key);
+static void prefetch_dependencies(const gchar *executable, GCancellable *cancellable);
+static void queue_elf_dependencies(const gchar *path, GPtrArray *library_dirs,
+                                   GQueue *pending, GHashTable *seen);
+static gchar *find_library(const gchar *name, gchar **runpath, GPtrArray *library_dirs);
+static GPtrArray *get_library_dirs(void);
+static void prefetch_directory(const gchar *path, GCancellable *cancellable);
+
+
+/* Read the selected session's executable, its shared libraries, & any extra
+ * paths into the page cache on a low-priority thread.
+ *
+ * Returns a GCancellable that stops the prefetch once it is cancelled. The
+ * caller owns the returned reference.
+ */
+GCancellable *prefetch_session(const gchar *session_key, gchar **extra_paths)
+{
+    struct PrefetchJob *job = malloc(sizeof(struct PrefetchJob));
+    if (job == NULL) {
+        g_error("Could not allocate memory for PrefetchJob");
+    }
+    job->session_key = g_strdup(session_key);
+    job->extra_paths = g_strdupv(extra_paths);
+    job->cancellable = g_cancellable_new();
+
+    GCancellable *cancellable = g_object_ref(job->cancellable);
+    g_thread_unref(g_thread_new("session-prefetch", &run_prefetch_job, job));
+
+    return cancellable;
+}
+
+/* Ask the kernel to read a whole file into the page cache.
+ *
+ * Falls back to `posix_fadvise` on filesystems that don't support
+ * `readahead`.
+ */
+void prefetch_file(const gchar *path)
+{
+    int file_descriptor = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (file_descriptor < 0) {
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        if (readahead(file_descriptor, 0, (size_t) file_stat.st_size) != 0) {
+            posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_WILLNEED);
+        }
+    }
+    close(file_descriptor);
+}
+
+
+/* Thread body: prefetch the session, then the extra paths */
+static gpointer run_prefetch_job(gpointer data)
+{
+    struct PrefetchJob *job = (struct PrefetchJob *) data;
+    gint64 start_time = g_get_monotonic_time();
+
+    lower_thread_priority();
+
+    gchar *executable = find_session_executable(job->session_key);
+    if (executable == NULL) {
+        g_message("Could not find an executable to prefetch for session: %s",
+                  job->session_key);
+    } else {
+        prefetch_dependencies(executable, job->cancellable);
+        g_free(executable);
+    }
+
+    for (gchar **path = job->extra_paths; path != NULL && *path != NULL; path++) {
+        if (g_cancellable_is_cancelled(job->cancellable)) {
+            break;
+        }
+        if (g_file_test(*path, G_FILE_TEST_IS_DIR)) {
+            prefetch_directory(*path, job->cancellable);
+        } else {
+            prefetch_file(*path);
+        }
+    }
+
+    if (g_cancellable_is_cancelled(job->cancellable)) {
+        g_message("Cancelled prefetch for session: %s", job->session_key);
+    } else {
+        g_message("Prefetched session %s in %.2fms", job->session_key,
+                  (double) (g_get_monotonic_time() - start_time) / 1000.0);
+    }
+
+    g_object_unref(job->cancellable);
+    g_strfreev(job->extra_paths);
+    g_free(job->session_key);
+    free(job);
+    return NULL;
+}
+
+/* Give the calling thread the lowest CPU & IO priority so the prefetch never
+ * competes with the UI.
+ */
+static void lower_thread_priority(void)
+{
+    pid_t thread_id = (pid_t) syscall(SYS_gettid);
+    if (setpriority(PRIO_PROCESS, (id_t) thread_id, 19) != 0) {
+        g_message("Could not lower the prefetch thread's CPU priority");
+    }
+    int io_priority = PREFETCH_IOPRIO_CLASS_IDLE << PREFETCH_IOPRIO_CLASS_SHIFT;
+    if (syscall(SYS_ioprio_set, PREFETCH_IOPRIO_WHO_PROCESS, thread_id, io_priority) != 0) {
+        g_message("Could not lower the prefetch thread's IO priority");
+    }
+}
+
+/* Find the session's desktop file & resolve the first word of its `Exec`
+ * line to an absolute path.
+ *
+ * Leading `env` invocations & variable assignments are skipped.
+ */
+static gchar *find_session_executable(const gchar *session_key)
+{
+    const gchar *const session_dirs[] = { "xsessions", "wayland-sessions", "lightdm/sessions" };
+    const gchar *const *data_dirs = g_get_system_data_dirs();
+    gchar *desktop_name = g_strconcat(session_key, ".desktop", NULL);
+    gchar *executable = NULL;
+
+    for (gsize d = 0; data_dirs[d] != NULL && executable == NULL; d++) {
+        for (gsize s = 0; s < G_N_ELEMENTS(session_dirs) && executable == NULL; s++) {
+            gchar *desktop_path = g_build_filename(
+                data_dirs[d], session_dirs[s], desktop_name, NULL);
+            GKeyFile *keyfile = g_key_file_new();
+
+            if (g_key_file_load_from_file(keyfile, desktop_path, G_KEY_FILE_NONE, NULL)) {
+                gchar *exec_line = g_key_file_get_string(
+                    keyfile, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
+                gchar **argv = NULL;
+                if (exec_line != NULL && g_shell_parse_argv(exec_line, NULL, &argv, NULL)) {
+                    gchar **program = argv;
+                    while (*program != NULL &&
+                           (strcmp(*program, "env") == 0 || strchr(*program, '=') != NULL)) {
+                        program++;
+                    }
+                    if (*program != NULL) {
+                        executable = g_find_program_in_path(*program);
+                    }
+                    g_strfreev(argv);
+                }
+                g_free(exec_line);
+            }
+
+            g_key_file_free(keyfile);
+            g_free(desktop_path);
+        }
+    }
+
+    g_free(desktop_name);
+    return executable;
+}
+
+/* Prefetch an executable along with its interpreter & every shared library
+ * it transitively depends on.
+ */
+static void prefetch_dependencies(const gchar *executable, GCancellable *cancellable)
+{
+    GPtrArray *library_dirs = get_library_dirs();
+    GQueue *pending = g_queue_new();
+    GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    g_hash_table_add(seen, g_strdup(executable));
+    g_queue_push_tail(pending, g_strdup(executable));
+
+    while (!g_queue_is_empty(pending)) {
+        gchar *path = g_queue_pop_head(pending);
+        if (!g_cancellable_is_cancelled(cancellable)) {
+            prefetch_file(path);
+            queue_elf_dependencies(path, library_dirs, pending, seen);
+        }
+        g_free(path);
+    }
+
+    g_queue_free(pending);
+    g_hash_table_destroy(seen);
+    g_ptr_array_unref(library_dirs);
+}
+
+/* Map a file & queue its `PT_INTERP` & `DT_NEEDED` entries.
+ *
+ * Scripts queue the interpreter from their `#!` line instead. Files that
+ * aren't native ELF objects are ignored.
+ */
+static void queue_elf_dependencies(const gchar *path, GPtrArray *library_dirs,
+                                   GQueue *pending, GHashTable *seen)
+{
+    int file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (file_descriptor < 0) {
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 ||
+            (size_t) file_stat.st_size < sizeof(ElfW(Ehdr))) {
+        close(file_descriptor);
+        return;
+    }
+    size_t size = (size_t) file_stat.st_size;
+    const guchar *contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (contents == MAP_FAILED) {
+        return;
+    }
+
+    GPtrArray *dependencies = g_ptr_array_new_with_free_func(g_free);
+
+    if (contents[0] == '#' && contents[1] == '!') {
+        // The file isn't NUL-terminated, so stay within the mapping
+        size_t start = 2;
+        while (start < size && contents[start] == ' ') {
+            start++;
+        }
+        size_t end = start;
+        while (end < size && !g_ascii_isspace(contents[end])) {
+            end++;
+        }
+        if (end > start) {
+            g_ptr_array_add(dependencies, g_strndup((const char *) contents + start, end - start));
+        }
+    } else if (memcmp(contents, ELFMAG, SELFMAG) == 0 &&
+               contents[EI_CLASS] == PREFETCH_ELF_CLASS) {
+        const ElfW(Ehdr) *header = (const ElfW(Ehdr) *) contents;
+        const ElfW(Phdr) *program_headers = (const ElfW(Phdr) *) (contents + header->e_phoff);
+        if (header->e_phoff + header->e_phnum * sizeof(ElfW(Phdr)) > size) {
+            header = NULL;
+        }
+
+        const ElfW(Dyn) *dynamic = NULL;
+        size_t dynamic_count = 0;
+        for (int p = 0; header != NULL && p < header->e_phnum; p++) {
+            const ElfW(Phdr) *segment = &program_headers[p];
+            if (segment->p_offset + segment->p_filesz > size) {
+                continue;
+            }
+            if (segment->p_type == PT_INTERP) {
+                g_ptr_array_add(dependencies, g_strndup(
+                    (const char *) contents + segment->p_offset, segment->p_filesz));
+            } else if (segment->p_type == PT_DYNAMIC) {
+                dynamic = (const ElfW(Dyn) *) (contents + segment->p_offset);
+                dynamic_count = segment->p_filesz / sizeof(ElfW(Dyn));
+            }
+        }
+
+        // DT_STRTAB holds a virtual address, so map it back to a file offset
+        size_t string_table = 0;
+        for (size_t d = 0; dynamic != NULL && d < dynamic_count; d++) {
+            if (dynamic[d].d_tag != DT_STRTAB) {
+                continue;
+            }
+            for (int p = 0; p < header->e_phnum; p++) {
+                const ElfW(Phdr) *segment = &program_headers[p];
+                if (segment->p_type == PT_LOAD &&
+                        dynamic[d].d_un.d_ptr >= segment->p_vaddr &&
+                        dynamic[d].d_un.d_ptr < segment->p_vaddr + segment->p_filesz) {
+                    string_table = dynamic[d].d_un.d_ptr - segment->p_vaddr + segment->p_offset;
+                }
+            }
+        }
+
+        if (string_table != 0 && string_table < size) {
+            const char *strings = (const char *) contents + string_table;
+            size_t strings_size = size - string_table;
+            gchar **runpath = NULL;
+            for (size_t d = 0; d < dynamic_count; d++) {
+                if ((dynamic[d].d_tag == DT_RUNPATH || dynamic[d].d_tag == DT_RPATH) &&
+                        dynamic[d].d_un.d_val < strings_size && runpath == NULL) {
+                    runpath = g_strsplit(strings + dynamic[d].d_un.d_val, ":", -1);
+                }
+            }
+            for (size_t d = 0; d < dynamic_count; d++) {
+                if (dynamic[d].d_tag == DT_NEEDED && dynamic[d].d_un.d_val < strings_size) {
+                    gchar *library = find_library(
+                        strings + dynamic[d].d_un.d_val, runpath, library_dirs);
+                    if (library != NULL) {
+                        g_ptr_array_add(dependencies, library);
+                    }
+                }
+            }
+            g_strfreev(runpath);
+        }
+    }
+
+    munmap((void *) contents, size);
+
+    for (guint d = 0; d < dependencies->len; d++) {
+        const gchar *dependency = g_ptr_array_index(dependencies, d);
+        if (!g_hash_table_contains(seen, dependency)) {
+            g_hash_table_add(seen, g_strdup(dependency));
+            g_queue_push_tail(pending, g_strdup(dependency));
+        }
+    }
+    g_ptr_array_unref(dependencies);
+}
+
+/* Search the object's runpath, then the system library directories, for a
+ * shared library. Runpaths using `$ORIGIN` are skipped.
+ */
+static gchar *find_library(const gchar *name, gchar **runpath, GPtrArray *library_dirs)
+{
+    if (strchr(name, '/') != NULL) {
+        return g_file_test(name, G_FILE_TEST_EXISTS) ? g_strdup(name) : NULL;
+    }
+    for (gchar **dir = runpath; dir != NULL && *dir != NULL; dir++) {
+        if (**dir == '\0' || strchr(*dir, '$') != NULL) {
+            continue;
+        }
+        gchar *candidate = g_build_filename(*dir, name, NULL);
+        if (g_file_test(candidate, G_FILE_TEST_EXISTS)) {
+            return candidate;
+        }
+        g_free(candidate);
+    }
+    for (guint d = 0; d < library_dirs->len; d++) {
+        gchar *candidate = g_build_filename(g_ptr_array_index(library_dirs, d), name, NULL);
+        if (g_file_test(candidate, G_FILE_TEST_EXISTS)) {
+            return candidate;
+        }
+        g_free(candidate);
+    }
+    return NULL;
+}
+
+/* Build the library search path.
+ *
+ * The directories of every library mapped into the greeter come first, since
+ * they cover the system's multiarch layout without parsing `ld.so.conf`.
+ */
+static GPtrArray *get_library_dirs(void)
+{
+    const gchar *const default_dirs[] = { "/lib", "/usr/lib", "/lib64", "/usr/lib64" };
+    GPtrArray *library_dirs = g_ptr_array_new_with_free_func(g_free);
+
+    gchar *maps = NULL;
+    if (g_file_get_contents("/proc/self/maps", &maps, NULL, NULL)) {
+        gchar **lines = g_strsplit(maps, "\n", -1);
+        for (gchar **line = lines; *line != NULL; line++) {
+            const gchar *mapped_path = strchr(*line, '/');
+            if (mapped_path == NULL || strstr(mapped_path, ".so") == NULL) {
+                continue;
+            }
+            gchar *dir = g_path_get_dirname(mapped_path);
+            if (!g_ptr_array_find_with_equal_func(library_dirs, dir, g_str_equal, NULL)) {
+                g_ptr_array_add(library_dirs, dir);
+            } else {
+                g_free(dir);
+            }
+        }
+        g_strfreev(lines);
+        g_free(maps);
+    }
+    for (gsize d = 0; d < G_N_ELEMENTS(default_dirs); d++) {
+        if (!g_ptr_array_find_with_equal_func(library_dirs, default_dirs[d], g_str_equal, NULL)) {
+            g_ptr_array_add(library_dirs, g_strdup(default_dirs[d]));
+        }
+    }
+
+    return library_dirs;
+}
+
+/* Prefetch the regular files directly inside a directory */
+static void prefetch_directory(const gchar *path, GCancellable *cancellable)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir == NULL) {
+        return;
+    }
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL &&
+           !g_cancellable_is_cancelled(cancellable)) {
+        gchar *file_path = g_build_filename(path, name, NULL);
+        prefetch_file(file_path);
+        g_free(file_path);
+    }
+    g_dir_close(dir);
+}
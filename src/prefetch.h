@@ -0,0 +1,10 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <gio/gio.h>
+
+
+GCancellable *prefetch_session(const gchar *session_key, gchar **extra_paths);
+void prefetch_file(const gchar *path);
+
+#endif
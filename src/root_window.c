@@ -0,0 +1,399 @@
+/* Paint the X Root Window Before & After the Greeter's Windows
+ *
+ * The splash is painted with a plain Xlib connection at the very top of
+ * `main`, so the screen shows the greeter's colors while GTK is still
+ * initializing. When a session starts, the greeter's wallpaper can be handed
+ * off as the root pixmap so the desktop doesn't flash black.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cairo.h>
+#include <glib.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "config.h"
+#include "root_window.h"
+#include "utils.h"
+
+#define SPLASH_MAGIC "LWGS"
+
+
+/* A cached frame is this header followed by `stride * height` bytes of
+ * CAIRO_FORMAT_RGB24 pixels, placed at `x`, `y` on the root window.
+ */
+struct SplashHeader {
+    char    magic[4];
+    gint32  x;
+    gint32  y;
+    guint32 width;
+    guint32 height;
+    guint32 stride;
+};
+
+static unsigned long get_background_pixel(Display *display, int screen);
+static void put_splash_frame(Display *display, int screen, Pixmap pixmap, GC gc);
+static void put_rgb24_pixels(Display *display, int screen, Pixmap pixmap, GC gc,
+                             char *pixels, int x, int y,
+                             guint32 width, guint32 height, guint32 stride);
+static Pixmap get_esetroot_pixmap(Display *display, Window root);
+static void free_previous_root_pixmap(Display *display, Window root);
+static gint64 get_mtime(const gchar *path);
+
+
+// The retained pixmap last published as the root background, or None
+static Pixmap published_pixmap = None;
+
+
+/* Fill the root window with the configured background color & the cached
+ * frame of the cover page, if one exists.
+ *
+ * The pixmap is freed right away; the server keeps it alive for as long as it
+ * is the root window's background.
+ */
+void root_window_paint_splash(void)
+{
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        return;
+    }
+    int screen = DefaultScreen(display);
+    Window root = RootWindow(display, screen);
+    unsigned int width = (unsigned int) DisplayWidth(display, screen);
+    unsigned int height = (unsigned int) DisplayHeight(display, screen);
+
+    Pixmap pixmap = XCreatePixmap(display, root, width, height,
+                                  (unsigned int) DefaultDepth(display, screen));
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    XSetForeground(display, gc, get_background_pixel(display, screen));
+    XFillRectangle(display, pixmap, gc, 0, 0, width, height);
+    put_splash_frame(display, screen, pixmap, gc);
+
+    XSetWindowBackgroundPixmap(display, root, pixmap);
+    XClearWindow(display, root);
+
+    XFreeGC(display, gc);
+    XFreePixmap(display, pixmap);
+    XCloseDisplay(display);
+}
+
+/* Determine if the cached frame needs to be re-rendered.
+ *
+ * It is stale if it is missing, was rendered for a different geometry, or is
+ * older than the config file or the background image.
+ */
+gboolean root_window_splash_is_stale(const gchar *background_image, int x, int y,
+                                     int width, int height)
+{
+    gchar *splash_path = get_cache_path(ROOT_WINDOW_SPLASH_FILE);
+    gint64 splash_mtime = get_mtime(splash_path);
+    struct SplashHeader header;
+    gboolean is_stale = TRUE;
+
+    int file_descriptor = open(splash_path, O_RDONLY | O_CLOEXEC);
+    if (file_descriptor >= 0) {
+        gboolean header_matches =
+            read(file_descriptor, &header, sizeof(header)) == sizeof(header) &&
+            memcmp(header.magic, SPLASH_MAGIC, sizeof(header.magic)) == 0 &&
+            header.x == x && header.y == y &&
+            header.width == (guint32) width && header.height == (guint32) height;
+        is_stale = !header_matches ||
+            splash_mtime < get_mtime(CONFIG_FILE) ||
+            (background_image != NULL && splash_mtime < get_mtime(background_image));
+        close(file_descriptor);
+    }
+
+    g_free(splash_path);
+    return is_stale;
+}
+
+/* Write a rendered frame of the cover page to the cache for the next start */
+void root_window_save_splash(cairo_surface_t *frame, int x, int y)
+{
+    if (cairo_image_surface_get_format(frame) != CAIRO_FORMAT_RGB24) {
+        g_warning("Splash frames must use the RGB24 format");
+        return;
+    }
+    cairo_surface_flush(frame);
+
+    struct SplashHeader header;
+    memcpy(header.magic, SPLASH_MAGIC, sizeof(header.magic));
+    header.x = x;
+    header.y = y;
+    header.width = (guint32) cairo_image_surface_get_width(frame);
+    header.height = (guint32) cairo_image_surface_get_height(frame);
+    header.stride = (guint32) cairo_image_surface_get_stride(frame);
+
+    gsize pixels_size = (gsize) header.stride * header.height;
+    gchar *contents = malloc(sizeof(header) + pixels_size);
+    if (contents == NULL) {
+        g_warning("Could not allocate memory for the splash frame");
+        return;
+    }
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + sizeof(header), cairo_image_surface_get_data(frame), pixels_size);
+
+    gchar *splash_path = get_cache_path(ROOT_WINDOW_SPLASH_FILE);
+    GError *error = NULL;
+    if (!g_file_set_contents(splash_path, contents,
+                             (gssize) (sizeof(header) + pixels_size), &error)) {
+        g_warning("Could not write splash frame: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(splash_path);
+    free(contents);
+}
+
+
+/* Publish a frame as the root window's background for the session.
+ *
+ * The pixmap is created on a connection with the RetainPermanent close mode,
+ * so it outlives the greeter. `_XROOTPMAP_ID` & `ESETROOT_PMAP_ID` are set so
+ * that compositors & pseudo-transparent terminals can find it. Wallpaper
+ * setters check the same properties before freeing a previous pixmap.
+ */
+void root_window_publish_background(cairo_surface_t *frame, int x, int y,
+                                    const GdkRGBA *fill_color)
+{
+    if (cairo_image_surface_get_format(frame) != CAIRO_FORMAT_RGB24) {
+        g_warning("Root window backgrounds must use the RGB24 format");
+        return;
+    }
+    cairo_surface_flush(frame);
+
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        g_warning("Could not open the display to publish the root background");
+        return;
+    }
+    XSetCloseDownMode(display, RetainPermanent);
+
+    int screen = DefaultScreen(display);
+    Window root = RootWindow(display, screen);
+    unsigned int width = (unsigned int) DisplayWidth(display, screen);
+    unsigned int height = (unsigned int) DisplayHeight(display, screen);
+
+    XColor color = {
+        .red = (unsigned short) (fill_color->red * 65535),
+        .green = (unsigned short) (fill_color->green * 65535),
+        .blue = (unsigned short) (fill_color->blue * 65535),
+    };
+    Colormap colormap = DefaultColormap(display, screen);
+    unsigned long fill_pixel = XAllocColor(display, colormap, &color) ?
+        color.pixel : BlackPixel(display, screen);
+
+    Pixmap pixmap = XCreatePixmap(display, root, width, height,
+                                  (unsigned int) DefaultDepth(display, screen));
+    GC gc = XCreateGC(display, pixmap, 0, NULL);
+    XSetForeground(display, gc, fill_pixel);
+    XFillRectangle(display, pixmap, gc, 0, 0, width, height);
+    put_rgb24_pixels(display, screen, pixmap, gc,
+                     (char *) cairo_image_surface_get_data(frame), x, y,
+                     (guint32) cairo_image_surface_get_width(frame),
+                     (guint32) cairo_image_surface_get_height(frame),
+                     (guint32) cairo_image_surface_get_stride(frame));
+    XFreeGC(display, gc);
+
+    free_previous_root_pixmap(display, root);
+    Atom root_pixmap_atom = XInternAtom(display, "_XROOTPMAP_ID", False);
+    Atom esetroot_atom = XInternAtom(display, "ESETROOT_PMAP_ID", False);
+    XChangeProperty(display, root, root_pixmap_atom, XA_PIXMAP, 32, PropModeReplace,
+                    (unsigned char *) &pixmap, 1);
+    XChangeProperty(display, root, esetroot_atom, XA_PIXMAP, 32, PropModeReplace,
+                    (unsigned char *) &pixmap, 1);
+
+    XSetWindowBackgroundPixmap(display, root, pixmap);
+    XClearWindow(display, root);
+    XCloseDisplay(display);
+    published_pixmap = pixmap;
+}
+
+/* Take back the background published for a session that failed to start.
+ *
+ * The retained pixmap is freed & its properties removed, unless a wallpaper
+ * setter has replaced it since. The root window shows the configured
+ * background color again.
+ */
+void root_window_withdraw_background(void)
+{
+    if (published_pixmap == None) {
+        return;
+    }
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        g_warning("Could not open the display to withdraw the root background");
+        return;
+    }
+    int screen = DefaultScreen(display);
+    Window root = RootWindow(display, screen);
+
+    XSetWindowBackground(display, root, get_background_pixel(display, screen));
+    XClearWindow(display, root);
+    if (get_esetroot_pixmap(display, root) == published_pixmap) {
+        XKillClient(display, published_pixmap);
+        XDeleteProperty(display, root, XInternAtom(display, "_XROOTPMAP_ID", False));
+        XDeleteProperty(display, root, XInternAtom(display, "ESETROOT_PMAP_ID", False));
+    }
+    XCloseDisplay(display);
+    published_pixmap = None;
+}
+
+
+/* Allocate the configured `background-color`, falling back to the default.
+ *
+ * Only formats understood by `XParseColor` work here, since GDK is not
+ * available yet. Anything else uses the default color.
+ */
+static unsigned long get_background_pixel(Display *display, int screen)
+{
+    Colormap colormap = DefaultColormap(display, screen);
+    gchar *color_string = config_peek_string("greeter-theme", "background-color");
+    if (color_string != NULL) {
+        remove_char(color_string, '"');
+        remove_char(color_string, '\'');
+        g_strstrip(color_string);
+    }
+
+    XColor color;
+    gboolean color_was_parsed = color_string != NULL &&
+        XParseColor(display, colormap, color_string, &color);
+    if (!color_was_parsed) {
+        color_was_parsed = XParseColor(display, colormap, "#1B1D1E", &color);
+    }
+    g_free(color_string);
+
+    if (color_was_parsed && XAllocColor(display, colormap, &color)) {
+        return color.pixel;
+    }
+    return BlackPixel(display, screen);
+}
+
+/* Copy the cached frame onto the pixmap if it matches the screen's format */
+static void put_splash_frame(Display *display, int screen, Pixmap pixmap, GC gc)
+{
+    gchar *splash_path = get_cache_path(ROOT_WINDOW_SPLASH_FILE);
+    int file_descriptor = open(splash_path, O_RDONLY | O_CLOEXEC);
+    g_free(splash_path);
+    if (file_descriptor < 0) {
+        return;
+    }
+    struct stat splash_stat;
+    if (fstat(file_descriptor, &splash_stat) != 0 ||
+            (size_t) splash_stat.st_size < sizeof(struct SplashHeader)) {
+        close(file_descriptor);
+        return;
+    }
+    size_t size = (size_t) splash_stat.st_size;
+    char *contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (contents == MAP_FAILED) {
+        return;
+    }
+
+    struct SplashHeader header;
+    memcpy(&header, contents, sizeof(header));
+    gboolean frame_is_usable =
+        memcmp(header.magic, SPLASH_MAGIC, sizeof(header.magic)) == 0 &&
+        size >= sizeof(header) + (size_t) header.stride * header.height;
+
+    if (frame_is_usable) {
+        put_rgb24_pixels(display, screen, pixmap, gc, contents + sizeof(header),
+                         header.x, header.y, header.width, header.height, header.stride);
+    }
+
+    munmap(contents, size);
+}
+
+/* Copy CAIRO_FORMAT_RGB24 pixels onto a pixmap.
+ *
+ * Nothing is drawn unless the pixels fit on the screen & the screen uses a
+ * 24-bit TrueColor visual with the same channel layout as cairo.
+ */
+static void put_rgb24_pixels(Display *display, int screen, Pixmap pixmap, GC gc,
+                             char *pixels, int x, int y,
+                             guint32 width, guint32 height, guint32 stride)
+{
+    Visual *visual = DefaultVisual(display, screen);
+    int depth = DefaultDepth(display, screen);
+    gboolean pixels_are_usable =
+        x >= 0 && y >= 0 &&
+        (guint32) x + width <= (guint32) DisplayWidth(display, screen) &&
+        (guint32) y + height <= (guint32) DisplayHeight(display, screen) &&
+        depth >= 24 && visual->red_mask == 0xff0000 &&
+        visual->green_mask == 0xff00 && visual->blue_mask == 0xff;
+    if (!pixels_are_usable) {
+        return;
+    }
+
+    XImage *image = XCreateImage(
+        display, visual, (unsigned int) depth, ZPixmap, 0, pixels,
+        width, height, 32, (int) stride);
+    if (image != NULL) {
+        // Cairo writes native-endian pixels, Xlib swaps them if needed
+        image->byte_order = G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst;
+        XPutImage(display, pixmap, gc, image, 0, 0, x, y, width, height);
+        // The pixels belong to the caller, not the image
+        image->data = NULL;
+        XDestroyImage(image);
+    }
+}
+
+/* Kill the client that retained the current root pixmap, freeing it.
+ *
+ * This follows the Esetroot convention: the pixmap is only freed if both
+ * properties still point at it, meaning nobody else has replaced it since.
+ */
+static void free_previous_root_pixmap(Display *display, Window root)
+{
+    Pixmap pixmap = get_esetroot_pixmap(display, root);
+    if (pixmap != None) {
+        XKillClient(display, pixmap);
+    }
+}
+
+/* The pixmap both `_XROOTPMAP_ID` & `ESETROOT_PMAP_ID` point at, or None */
+static Pixmap get_esetroot_pixmap(Display *display, Window root)
+{
+    Atom root_pixmap_atom = XInternAtom(display, "_XROOTPMAP_ID", True);
+    Atom esetroot_atom = XInternAtom(display, "ESETROOT_PMAP_ID", True);
+    if (root_pixmap_atom == None || esetroot_atom == None) {
+        return None;
+    }
+
+    Pixmap pixmaps[2] = { None, None };
+    Atom properties[2] = { root_pixmap_atom, esetroot_atom };
+    for (int p = 0; p < 2; p++) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long item_count, bytes_after;
+        unsigned char *data = NULL;
+        int status = XGetWindowProperty(display, root, properties[p], 0, 1, False,
+                                        AnyPropertyType, &actual_type, &actual_format,
+                                        &item_count, &bytes_after, &data);
+        if (status == Success && actual_type == XA_PIXMAP && item_count == 1 && data != NULL) {
+            pixmaps[p] = *((Pixmap *) data);
+        }
+        if (data != NULL) {
+            XFree(data);
+        }
+    }
+
+    return pixmaps[0] == pixmaps[1] ? pixmaps[0] : None;
+}
+
+/* Get a file's modification time in seconds, or 0 if it can't be read */
+static gint64 get_mtime(const gchar *path)
+{
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0) {
+        return 0;
+    }
+    return (gint64) file_stat.st_mtime;
+}
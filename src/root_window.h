@@ -0,0 +1,19 @@
+#ifndef ROOT_WINDOW_H
+#define ROOT_WINDOW_H
+
+#include <cairo.h>
+#include <gdk/gdk.h>
+#include <glib.h>
+
+#define ROOT_WINDOW_SPLASH_FILE "splash.frame"
+
+
+void root_window_paint_splash(void);
+gboolean root_window_splash_is_stale(const gchar *background_image, int x, int y,
+                                     int width, int height);
+void root_window_save_splash(cairo_surface_t *frame, int x, int y);
+void root_window_publish_background(cairo_surface_t *frame, int x, int y,
+                                    const GdkRGBA *fill_color);
+void root_window_withdraw_background(void);
+
+#endif
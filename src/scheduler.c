@@ -0,0 +1,172 @@
+/* Deferred Work that Runs After the First Frame */
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "scheduler.h"
+
+// The longest time a single idle slice may run before yielding, in µs.
+#define SCHEDULER_SLICE_USEC 5000
+
+
+struct ScheduledItem {
+    const gchar       *name;
+    SchedulerPriority  priority;
+    guint              sequence;
+    SchedulerFunc      func;
+    gpointer           data;
+};
+
+static gint compare_items(gconstpointer a, gconstpointer b);
+static gboolean handle_first_draw(GtkWidget *widget, cairo_t *cr, Scheduler *scheduler);
+static gboolean run_idle_slice(Scheduler *scheduler);
+static void run_next_item(Scheduler *scheduler);
+
+
+/* Create an empty Scheduler that waits for `scheduler_start` */
+Scheduler *initialize_scheduler(void)
+{
+    Scheduler *scheduler = malloc(sizeof(Scheduler));
+    if (scheduler == NULL) {
+        g_error("Could not allocate memory for Scheduler");
+    }
+    scheduler->queue = NULL;
+    scheduler->next_sequence = 0;
+    scheduler->widget = NULL;
+    scheduler->draw_handler_id = 0;
+    scheduler->idle_source_id = 0;
+    scheduler->started = FALSE;
+
+    return scheduler;
+}
+
+/* Drop any pending items & free the Scheduler */
+void destroy_scheduler(Scheduler *scheduler)
+{
+    if (scheduler->idle_source_id != 0) {
+        g_source_remove(scheduler->idle_source_id);
+    }
+    if (scheduler->draw_handler_id != 0) {
+        g_signal_handler_disconnect(scheduler->widget, scheduler->draw_handler_id);
+    }
+    g_list_free_full(scheduler->queue, free);
+    free(scheduler);
+}
+
+
+/* Queue a function to run after the first frame.
+ *
+ * Items with the same priority run in the order they were added. If the
+ * Scheduler is already running, the item will be picked up by the next idle
+ * slice.
+ */
+void scheduler_add(Scheduler *scheduler, const gchar *name,
+                   SchedulerPriority priority, SchedulerFunc func, gpointer data)
+{
+    struct ScheduledItem *item = malloc(sizeof(struct ScheduledItem));
+    if (item == NULL) {
+        g_error("Could not allocate memory for ScheduledItem: %s", name);
+    }
+    item->name = name;
+    item->priority = priority;
+    item->sequence = scheduler->next_sequence++;
+    item->func = func;
+    item->data = data;
+
+    scheduler->queue = g_list_insert_sorted(scheduler->queue, item, &compare_items);
+
+    if (scheduler->started && scheduler->idle_source_id == 0) {
+        scheduler->idle_source_id =
+            g_idle_add(G_SOURCE_FUNC(run_idle_slice), scheduler);
+    }
+}
+
+/* Begin running queued items once the widget has finished its first draw */
+void scheduler_start(Scheduler *scheduler, GtkWidget *widget)
+{
+    scheduler->widget = widget;
+    scheduler->draw_handler_id =
+        g_signal_connect_after(widget, "draw",
+                               G_CALLBACK(handle_first_draw), scheduler);
+}
+
+/* Synchronously run every pending item.
+ *
+ * Used when something the user did depends on deferred work, like starting a
+ * session before the session ring has been built.
+ */
+void scheduler_flush(Scheduler *scheduler)
+{
+    while (scheduler->queue != NULL) {
+        run_next_item(scheduler);
+    }
+}
+
+
+/* Sort by priority, then by insertion order */
+static gint compare_items(gconstpointer a, gconstpointer b)
+{
+    const struct ScheduledItem *item_a = a;
+    const struct ScheduledItem *item_b = b;
+
+    if (item_a->priority != item_b->priority) {
+        return (gint) item_a->priority - (gint) item_b->priority;
+    }
+    return item_a->sequence < item_b->sequence ? -1 : 1;
+}
+
+/* Start the idle slices after the first frame has been drawn.
+ *
+ * The idle source runs at a lower priority than input events & redraws, so
+ * queued work always yields to the user.
+ */
+static gboolean handle_first_draw(GtkWidget *widget, cairo_t *cr, Scheduler *scheduler)
+{
+    g_signal_handler_disconnect(widget, scheduler->draw_handler_id);
+    scheduler->draw_handler_id = 0;
+    scheduler->started = TRUE;
+
+    if (scheduler->queue != NULL && scheduler->idle_source_id == 0) {
+        scheduler->idle_source_id =
+            g_idle_add(G_SOURCE_FUNC(run_idle_slice), scheduler);
+    }
+    return FALSE;
+}
+
+/* Run items until the slice's time budget is spent or input is waiting */
+static gboolean run_idle_slice(Scheduler *scheduler)
+{
+    gint64 slice_start = g_get_monotonic_time();
+
+    // Always make progress, even if a single item overruns the budget
+    while (scheduler->queue != NULL) {
+        run_next_item(scheduler);
+        if (gtk_events_pending() ||
+                g_get_monotonic_time() - slice_start >= SCHEDULER_SLICE_USEC) {
+            break;
+        }
+    }
+
+    if (scheduler->queue == NULL) {
+        scheduler->idle_source_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* Pop the first item off the queue, run it, & log how long it took */
+static void run_next_item(Scheduler *scheduler)
+{
+    GList *head = scheduler->queue;
+    struct ScheduledItem *item = head->data;
+    scheduler->queue = g_list_delete_link(scheduler->queue, head);
+
+    gint64 item_start = g_get_monotonic_time();
+    item->func(item->data);
+    gint64 item_duration = g_get_monotonic_time() - item_start;
+
+    g_message("Deferred work '%s' took %.2fms",
+              item->name, (double) item_duration / 1000.0);
+    free(item);
+}
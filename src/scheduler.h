@@ -0,0 +1,39 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <gtk/gtk.h>
+
+
+/* The order in which deferred work is run, lower values run first. */
+typedef enum SchedulerPriority_ {
+    SCHEDULER_PRIORITY_HIGH,
+    SCHEDULER_PRIORITY_NORMAL,
+    SCHEDULER_PRIORITY_LOW,
+} SchedulerPriority;
+
+typedef void (*SchedulerFunc)(gpointer data);
+
+/* A queue of work that is not needed for the first frame. Items are run in
+ * short idle slices once the watched widget has been drawn for the first time.
+ */
+typedef struct Scheduler_ {
+    /* Pending items, sorted by priority & then insertion order */
+    GList      *queue;
+    guint       next_sequence;
+
+    GtkWidget  *widget;
+    gulong      draw_handler_id;
+    guint       idle_source_id;
+    gboolean    started;
+} Scheduler;
+
+
+Scheduler *initialize_scheduler(void);
+void destroy_scheduler(Scheduler *scheduler);
+
+void scheduler_add(Scheduler *scheduler, const gchar *name,
+                   SchedulerPriority priority, SchedulerFunc func, gpointer data);
+void scheduler_start(Scheduler *scheduler, GtkWidget *widget);
+void scheduler_flush(Scheduler *scheduler);
+
+#endif
@@ -0,0 +1,264 @@
+/* Record & Replay the Files Touched During Startup
+ *
+ * A profile is a text file with one `<offset> <length> <path>` line for every
+ * range of a file that was in the page cache once the greeter finished
+ * starting. Replaying it issues a `readahead` for every range before GTK is
+ * initialized, so cold starts read the files in one batch instead of faulting
+ * them in one page at a time.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "startup_profile.h"
+#include "utils.h"
+
+
+struct FileRange {
+    guint64 offset;
+    guint64 length;
+};
+
+// Files read without being mapped, like the config & the wallpaper
+G_LOCK_DEFINE_STATIC(tracked_files);
+static GPtrArray *tracked_files = NULL;
+
+static void record_mapped_files(GHashTable *ranges);
+static void record_file_residency(GHashTable *ranges, const gchar *path);
+static void record_resident_pages(GHashTable *ranges, const gchar *path,
+                                  guchar *address, size_t length, guint64 file_offset);
+static gint compare_ranges(gconstpointer a, gconstpointer b);
+
+
+/* Read every range listed in the startup profile into the page cache.
+ *
+ * Does nothing if a profile has not been recorded yet.
+ */
+void startup_profile_replay(void)
+{
+    gchar *profile_path = get_cache_path(STARTUP_PROFILE_FILE);
+    gchar *contents = NULL;
+    gboolean profile_loaded = g_file_get_contents(profile_path, &contents, NULL, NULL);
+    g_free(profile_path);
+    if (!profile_loaded) {
+        return;
+    }
+
+    gint64 start_time = g_get_monotonic_time();
+    guint range_count = 0;
+    gchar *open_path = NULL;
+    int file_descriptor = -1;
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (gchar **line = lines; *line != NULL; line++) {
+        gchar *end;
+        guint64 offset = g_ascii_strtoull(*line, &end, 10);
+        guint64 length = g_ascii_strtoull(end, &end, 10);
+        if (*end != ' ') {
+            continue;
+        }
+        const gchar *path = end + 1;
+
+        // The profile is sorted by path, so keep the file open between ranges
+        if (g_strcmp0(path, open_path) != 0) {
+            if (file_descriptor >= 0) {
+                close(file_descriptor);
+            }
+            g_free(open_path);
+            open_path = g_strdup(path);
+            file_descriptor = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        }
+        if (file_descriptor >= 0) {
+            readahead(file_descriptor, (off64_t) offset, (size_t) length);
+            range_count++;
+        }
+    }
+    if (file_descriptor >= 0) {
+        close(file_descriptor);
+    }
+    g_free(open_path);
+    g_strfreev(lines);
+    g_free(contents);
+
+    g_message("Replayed %u startup profile ranges in %.2fms", range_count,
+              (double) (g_get_monotonic_time() - start_time) / 1000.0);
+}
+
+/* Include a file that is read rather than mapped in the next recording */
+void startup_profile_track_file(const gchar *path)
+{
+    G_LOCK(tracked_files);
+    if (tracked_files == NULL) {
+        tracked_files = g_ptr_array_new_with_free_func(g_free);
+    }
+    if (!g_ptr_array_find_with_equal_func(tracked_files, path, g_str_equal, NULL)) {
+        g_ptr_array_add(tracked_files, g_strdup(path));
+    }
+    G_UNLOCK(tracked_files);
+}
+
+/* Write a new startup profile from the pages that are currently resident.
+ *
+ * Every mapped file is sampled with `mincore`, along with any files passed to
+ * `startup_profile_track_file`. This is meant to run as the last piece of
+ * deferred startup work.
+ */
+void startup_profile_record(gpointer user_data)
+{
+    GHashTable *ranges = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+
+    record_mapped_files(ranges);
+    G_LOCK(tracked_files);
+    for (guint f = 0; tracked_files != NULL && f < tracked_files->len; f++) {
+        record_file_residency(ranges, g_ptr_array_index(tracked_files, f));
+    }
+    G_UNLOCK(tracked_files);
+
+    // Sort & merge each file's ranges, then the files themselves by path
+    GList *paths = g_list_sort(g_hash_table_get_keys(ranges), (GCompareFunc) strcmp);
+    GString *profile = g_string_new(NULL);
+    for (GList *path = paths; path != NULL; path = path->next) {
+        GArray *file_ranges = g_hash_table_lookup(ranges, path->data);
+        if (file_ranges->len == 0) {
+            continue;
+        }
+        g_array_sort(file_ranges, &compare_ranges);
+
+        struct FileRange merged = g_array_index(file_ranges, struct FileRange, 0);
+        for (guint r = 1; r <= file_ranges->len; r++) {
+            struct FileRange *next = r < file_ranges->len ?
+                &g_array_index(file_ranges, struct FileRange, r) : NULL;
+            if (next != NULL && next->offset <= merged.offset + merged.length) {
+                merged.length = MAX(merged.length, next->offset + next->length - merged.offset);
+                continue;
+            }
+            g_string_append_printf(profile, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %s\n",
+                                   merged.offset, merged.length, (gchar *) path->data);
+            if (next != NULL) {
+                merged = *next;
+            }
+        }
+    }
+
+    gchar *profile_path = get_cache_path(STARTUP_PROFILE_FILE);
+    GError *error = NULL;
+    if (g_file_set_contents(profile_path, profile->str, (gssize) profile->len, &error)) {
+        g_message("Recorded startup profile for %u files to %s",
+                  g_list_length(paths), profile_path);
+    } else {
+        g_warning("Could not write startup profile: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_free(profile_path);
+    g_string_free(profile, TRUE);
+    g_list_free(paths);
+    g_hash_table_destroy(ranges);
+}
+
+
+/* Sample the resident pages of every file mapped into the greeter */
+static void record_mapped_files(GHashTable *ranges)
+{
+    gchar *maps = NULL;
+    if (!g_file_get_contents("/proc/self/maps", &maps, NULL, NULL)) {
+        return;
+    }
+
+    gchar **lines = g_strsplit(maps, "\n", -1);
+    for (gchar **line = lines; *line != NULL; line++) {
+        guint64 start, end, file_offset;
+        int path_start = 0;
+        if (sscanf(*line, "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x %*s %"
+                   G_GINT64_MODIFIER "x %*s %*s %n",
+                   &start, &end, &file_offset, &path_start) < 3 || path_start == 0) {
+            continue;
+        }
+        const gchar *path = *line + path_start;
+        if (path[0] != '/' || g_str_has_suffix(path, "(deleted)") ||
+                g_str_has_prefix(path, "/dev/") || g_str_has_prefix(path, "/memfd:")) {
+            continue;
+        }
+        record_resident_pages(ranges, path, (guchar *) (guintptr) start,
+                              (size_t) (end - start), file_offset);
+    }
+
+    g_strfreev(lines);
+    g_free(maps);
+}
+
+/* Sample the page cache residency of a whole file by mapping it */
+static void record_file_residency(GHashTable *ranges, const gchar *path)
+{
+    int file_descriptor = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (file_descriptor < 0) {
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+            file_stat.st_size > 0) {
+        size_t length = (size_t) file_stat.st_size;
+        void *address = mmap(NULL, length, PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if (address != MAP_FAILED) {
+            record_resident_pages(ranges, path, address, length, 0);
+            munmap(address, length);
+        }
+    }
+    close(file_descriptor);
+}
+
+/* Add a range for every run of resident pages in a mapped region */
+static void record_resident_pages(GHashTable *ranges, const gchar *path,
+                                  guchar *address, size_t length, guint64 file_offset)
+{
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t page_count = (length + page_size - 1) / page_size;
+    guchar *residency = malloc(page_count);
+    if (residency == NULL || mincore(address, length, residency) != 0) {
+        free(residency);
+        return;
+    }
+
+    GArray *file_ranges = g_hash_table_lookup(ranges, path);
+    if (file_ranges == NULL) {
+        file_ranges = g_array_new(FALSE, FALSE, sizeof(struct FileRange));
+        g_hash_table_insert(ranges, g_strdup(path), file_ranges);
+    }
+
+    size_t run_start = 0;
+    for (size_t page = 0; page <= page_count; page++) {
+        gboolean is_resident = page < page_count && (residency[page] & 1);
+        if (is_resident) {
+            continue;
+        }
+        if (page > run_start) {
+            struct FileRange range = {
+                .offset = file_offset + run_start * page_size,
+                .length = (page - run_start) * page_size,
+            };
+            g_array_append_val(file_ranges, range);
+        }
+        run_start = page + 1;
+    }
+
+    free(residency);
+}
+
+/* Order ranges by their starting offset */
+static gint compare_ranges(gconstpointer a, gconstpointer b)
+{
+    const struct FileRange *range_a = a;
+    const struct FileRange *range_b = b;
+    if (range_a->offset == range_b->offset) {
+        return 0;
+    }
+    return range_a->offset < range_b->offset ? -1 : 1;
+}
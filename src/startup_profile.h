@@ -0,0 +1,13 @@
+#ifndef STARTUP_PROFILE_H
+#define STARTUP_PROFILE_H
+
+#include <glib.h>
+
+#define STARTUP_PROFILE_FILE "startup.profile"
+
+
+void startup_profile_replay(void);
+void startup_profile_track_file(const gchar *path);
+void startup_profile_record(gpointer user_data);
+
+#endif
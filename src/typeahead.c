@@ -0,0 +1,193 @@
+/* Buffer Keystrokes Until the Password Input is Ready */
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <gtk/gtk.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "typeahead.h"
+
+// The most characters that will be buffered
+#define TYPEAHEAD_CAPACITY 256
+
+// Keystrokes with these modifiers are hotkeys, not password characters
+#define TYPEAHEAD_IGNORED_MODIFIERS \
+    (GDK_CONTROL_MASK | GDK_MOD1_MASK | GDK_MOD4_MASK | GDK_SUPER_MASK)
+
+
+/* Allocate an empty buffer in a locked, non-dumpable page */
+TypeAhead *initialize_typeahead(void)
+{
+    TypeAhead *typeahead = malloc(sizeof(TypeAhead));
+    if (typeahead == NULL) {
+        g_error("Could not allocate memory for TypeAhead");
+    }
+
+    gsize page_size = (gsize) sysconf(_SC_PAGESIZE);
+    gsize buffer_size = TYPEAHEAD_CAPACITY * sizeof(gunichar);
+    typeahead->allocation_size = (buffer_size + page_size - 1) / page_size * page_size;
+    typeahead->buffer = mmap(NULL, typeahead->allocation_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (typeahead->buffer == MAP_FAILED) {
+        g_error("Could not allocate memory for the type-ahead buffer");
+    }
+    if (mlock(typeahead->buffer, typeahead->allocation_size) != 0) {
+        g_warning("Could not lock the type-ahead buffer into memory");
+    }
+    madvise(typeahead->buffer, typeahead->allocation_size, MADV_DONTDUMP);
+
+    typeahead->capacity = TYPEAHEAD_CAPACITY;
+    typeahead->length = 0;
+    typeahead->submit = FALSE;
+    typeahead->early_display = NULL;
+
+    return typeahead;
+}
+
+/* Wipe & free the buffer */
+void destroy_typeahead(TypeAhead *typeahead)
+{
+    typeahead_release_early(typeahead);
+    explicit_bzero(typeahead->buffer, typeahead->allocation_size);
+    munlock(typeahead->buffer, typeahead->allocation_size);
+    munmap(typeahead->buffer, typeahead->allocation_size);
+    free(typeahead);
+}
+
+
+/* Grab the keyboard on the root window with a plain Xlib connection.
+ *
+ * This runs before GTK is initialized so that keystrokes typed while the UI is
+ * being built are queued for us instead of being dropped.
+ */
+void typeahead_grab_early(TypeAhead *typeahead)
+{
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        return;
+    }
+    int grab_status = XGrabKeyboard(display, DefaultRootWindow(display), False,
+                                    GrabModeAsync, GrabModeAsync, CurrentTime);
+    if (grab_status != GrabSuccess) {
+        g_message("Could not grab the keyboard for type-ahead");
+        XCloseDisplay(display);
+        return;
+    }
+    XFlush(display);
+    typeahead->early_display = display;
+}
+
+/* Move every key press queued on the early connection into the buffer &
+ * release the keyboard so GTK's windows receive input.
+ */
+void typeahead_release_early(TypeAhead *typeahead)
+{
+    Display *display = typeahead->early_display;
+    if (display == NULL) {
+        return;
+    }
+
+    XEvent event;
+    char lookup_buffer[8];
+    XSync(display, False);
+    while (XPending(display) > 0) {
+        XNextEvent(display, &event);
+        if (event.type == KeyPress) {
+            KeySym keysym = NoSymbol;
+            XLookupString(&event.xkey, lookup_buffer, sizeof(lookup_buffer), &keysym, NULL);
+            typeahead_add_key(typeahead, (guint) keysym, event.xkey.state);
+        }
+    }
+    explicit_bzero(&event, sizeof(event));
+    explicit_bzero(lookup_buffer, sizeof(lookup_buffer));
+
+    XUngrabKeyboard(display, CurrentTime);
+    XCloseDisplay(display);
+    typeahead->early_display = NULL;
+}
+
+
+/* Buffer a key press.
+ *
+ * Printable characters are appended, BackSpace removes the last character,
+ * Escape clears the buffer & Enter marks it for submission. Enter with
+ * nothing buffered only uncovers the login page, so it never submits an empty
+ * password. Returns TRUE if the key was handled.
+ */
+gboolean typeahead_add_key(TypeAhead *typeahead, guint keyval, guint state)
+{
+    if (state & TYPEAHEAD_IGNORED_MODIFIERS) {
+        return FALSE;
+    }
+
+    switch (keyval) {
+        case GDK_KEY_Return:
+        case GDK_KEY_KP_Enter:
+        case GDK_KEY_ISO_Enter:
+            if (typeahead->length > 0) {
+                typeahead->submit = TRUE;
+            }
+            return TRUE;
+        case GDK_KEY_BackSpace:
+            if (typeahead->length > 0 && !typeahead->submit) {
+                typeahead->length--;
+                typeahead->buffer[typeahead->length] = 0;
+            }
+            return TRUE;
+        case GDK_KEY_Escape:
+            typeahead_clear(typeahead);
+            return TRUE;
+        default:
+            break;
+    }
+
+    gunichar character = gdk_keyval_to_unicode(keyval);
+    if (character == 0 || !g_unichar_isprint(character)) {
+        return FALSE;
+    }
+    // Anything typed after Enter belongs to whatever comes after the login
+    if (!typeahead->submit && typeahead->length < typeahead->capacity) {
+        typeahead->buffer[typeahead->length++] = character;
+    }
+    return TRUE;
+}
+
+/* Determine if there is nothing to replay */
+gboolean typeahead_is_empty(TypeAhead *typeahead)
+{
+    return typeahead->length == 0 && !typeahead->submit;
+}
+
+/* Append the buffered characters to an editable & wipe the buffer.
+ *
+ * Characters are encoded & inserted one at a time so the password never sits
+ * in an unlocked heap allocation. Returns TRUE if Enter was pressed.
+ */
+gboolean typeahead_replay(TypeAhead *typeahead, GtkEditable *editable)
+{
+    gboolean submit = typeahead->submit;
+    gint position = gtk_entry_get_text_length(GTK_ENTRY(editable));
+    gchar encoded[6];
+
+    for (gsize c = 0; c < typeahead->length; c++) {
+        gint encoded_length = g_unichar_to_utf8(typeahead->buffer[c], encoded);
+        gtk_editable_insert_text(editable, encoded, encoded_length, &position);
+    }
+    explicit_bzero(encoded, sizeof(encoded));
+    gtk_editable_set_position(editable, -1);
+
+    typeahead_clear(typeahead);
+    return submit;
+}
+
+/* Forget every buffered character */
+void typeahead_clear(TypeAhead *typeahead)
+{
+    explicit_bzero(typeahead->buffer, typeahead->capacity * sizeof(gunichar));
+    typeahead->length = 0;
+    typeahead->submit = FALSE;
+}
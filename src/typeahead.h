@@ -0,0 +1,36 @@
+#ifndef TYPEAHEAD_H
+#define TYPEAHEAD_H
+
+#include <gtk/gtk.h>
+
+
+/* Keystrokes typed before the password input could receive them.
+ *
+ * The characters are kept in a locked page that is never swapped out or
+ * included in core dumps, & are wiped as soon as they are replayed.
+ */
+typedef struct TypeAhead_ {
+    gunichar *buffer;
+    gsize     capacity;
+    gsize     length;
+    gsize     allocation_size;
+    /* Whether Enter was pressed after the buffered characters */
+    gboolean  submit;
+
+    /* Grabs the keyboard from process start until the windows are shown */
+    struct _XDisplay *early_display;
+} TypeAhead;
+
+
+TypeAhead *initialize_typeahead(void);
+void destroy_typeahead(TypeAhead *typeahead);
+
+void typeahead_grab_early(TypeAhead *typeahead);
+void typeahead_release_early(TypeAhead *typeahead);
+
+gboolean typeahead_add_key(TypeAhead *typeahead, guint keyval, guint state);
+gboolean typeahead_is_empty(TypeAhead *typeahead);
+gboolean typeahead_replay(TypeAhead *typeahead, GtkEditable *editable);
+void typeahead_clear(TypeAhead *typeahead);
+
+#endif
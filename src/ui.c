@@ -15,14 +15,30 @@
 #include "utils.h"
 #include "network.h"
 #include "battery.h"
+#include "icons.h"
+#include "root_window.h"
+#include "background.h"
+#include "memory_usage.h"
 
 #define UI_STACK_OVERLAY "overlay"
 #define UI_STACK_LOGIN "login"
+// How long switching to the next wallpaper takes
+#define UI_BACKGROUND_FADE_USEC (800 * G_TIME_SPAN_MILLISECOND)
+// Compiled in from data/theme/greeter.css
+#define UI_STYLESHEET_RESOURCE "/org/lightdm-win-greeter/greeter.css"
 
 
-static UI *new_ui(Config *config);
+static UI *new_ui(Config *config, Scheduler *scheduler, WallClock *wall_clock);
 static void setup_background_windows(Config *config, UI *ui);
-static GtkWindow *new_background_window(GdkMonitor *monitor);
+static void add_background_window(UI *ui, GdkMonitor *monitor);
+static void handle_monitor_added(GdkDisplay *display, GdkMonitor *monitor, gpointer user_data);
+static void handle_monitor_removed(GdkDisplay *display, GdkMonitor *monitor, gpointer user_data);
+static void handle_monitor_geometry(GObject *monitor, GParamSpec *pspec, gpointer user_data);
+static void handle_monitors_changed(GdkScreen *screen, gpointer user_data);
+static GtkWindow *new_background_window(UI *ui, GdkMonitor *monitor);
+static gboolean draw_background_window(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+static GdkMonitor *get_primary_monitor(void);
+static void get_monitor_pixel_size(GdkMonitor *monitor, gint *width, gint *height);
 static void set_window_to_monitor_size(GdkMonitor *monitor, GtkWindow *window);
 static void hide_mouse_cursor(GtkWidget *window, gpointer user_data);
 static void show_default_cursor(GtkWidget *window, gpointer user_data);
@@ -30,19 +46,49 @@ static void show_default_cursor(GtkWidget *window, gpointer user_data);
 
 static void setup_main_window(Config *config, UI *ui);
 static void place_main_window(GtkWidget *main_window, gpointer user_data);
+static void fit_main_window_to_primary(UI *ui);
+static void update_main_window_backgrounds(UI *ui);
+static struct BackgroundPixbuf *new_background_pixbuf(GdkRGBA *default_color);
+static void paint_background_pixbuf(cairo_t *cr, struct BackgroundPixbuf *bg);
+static void paint_overlay_gradient(cairo_t *cr, int width, int height);
+static void paint_scaled_surface(cairo_t *cr, cairo_surface_t *surface, gdouble scale,
+                                 gdouble alpha);
+static void check_memory_budget(gpointer user_data);
 static void create_and_attach_layout_stack(UI *ui);
 static void init_background_image(UI* ui, Config* config);
+static void blur_login_background(gpointer user_data);
+static void prepare_next_background(gpointer user_data);
+static void add_background_request(GArray *requests, GdkMonitor *monitor, gboolean blur);
+static void handle_next_background_ready(const gchar *path, gpointer user_data);
+static gboolean handle_background_rotate_timer(gpointer user_data);
+static void handle_background_rotate_tick(gpointer user_data);
+static void rotate_background(UI *ui);
+static gboolean handle_background_fade(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data);
+static void set_background_fade(UI *ui, gdouble fade);
+static void redraw_backgrounds(UI *ui);
+static void finish_background_fade(UI *ui);
+static void trim_background_cache(UI *ui);
+static void release_idle_memory(UI *ui);
+static void init_background_animation(UI *ui, Config *config);
+static gboolean handle_main_window_visibility(GtkWidget *widget, GdkEventVisibility *event,
+                                              gpointer user_data);
+static void save_splash_frame(gpointer user_data);
 static void create_and_attach_overlay_container(UI *ui);
+static void create_and_attach_status_icons(gpointer user_data);
 static void create_and_attach_layout_container(UI *ui);
 static void attach_config_colors_to_screen(Config *config);
+static void append_color_definition(GString *css, const gchar *name, const GdkRGBA *color);
 
-static void create_and_attach_power_menu(UI* ui);
-static GdkPixbuf* icon_shutdown(int size);
+static void create_and_attach_power_menu(gpointer user_data);
 
-/* Initialize the Main Window & it's Children */
-UI *initialize_ui(Config *config)
+/* Initialize the Main Window & it's Children
+ *
+ * Anything that is not needed to draw the cover page or type a password is
+ * queued on the Scheduler & built after the first frame.
+ */
+UI *initialize_ui(Config *config, Scheduler *scheduler, WallClock *wall_clock)
 {
-    UI *ui = new_ui(config);
+    UI *ui = new_ui(config, scheduler, wall_clock);
 
     // Setup Windows
     setup_background_windows(config, ui);
@@ -54,43 +100,216 @@ UI *initialize_ui(Config *config)
 
     create_and_attach_overlay_container(ui);
     create_and_attach_layout_container(ui);
+    init_background_animation(ui, config);
     
     gtk_stack_set_visible_child_full(ui->layout_stack, UI_STACK_OVERLAY, GTK_STACK_TRANSITION_TYPE_OVER_DOWN);
 
-    create_and_attach_power_menu(ui);
+    scheduler_add(scheduler, "power-menu", SCHEDULER_PRIORITY_LOW,
+                  &create_and_attach_power_menu, ui);
+    scheduler_add(scheduler, "splash-frame", SCHEDULER_PRIORITY_LOW,
+                  &save_splash_frame, ui);
+    scheduler_add(scheduler, "memory-budget", SCHEDULER_PRIORITY_LOW,
+                  &check_memory_budget, ui);
 
     attach_config_colors_to_screen(config);
 
     return ui;
 }
 
+/* Free what the UI owns besides its widgets, which GTK frees with the windows.
+ * Only called once the main loop has stopped.
+ */
+void destroy_ui(UI *ui)
+{
+    if (ui->user_picker != NULL) {
+        destroy_user_picker(ui->user_picker);
+    }
+    if (ui->animation != NULL) {
+        destroy_animation(ui->animation);
+    }
+    if (ui->wallpapers != NULL) {
+        destroy_wallpapers(ui->wallpapers);
+    }
+    if (ui->background_cache != NULL) {
+        destroy_background_cache(ui->background_cache);
+    }
+    free(ui->overlay_bg);
+    free(ui->login_bg);
+    g_free(ui->background_path);
+    g_free(ui->previous_background_path);
+    free(ui);
+}
+
 void ui_cover(UI* ui)
 {
     gtk_stack_set_visible_child_full(ui->layout_stack, UI_STACK_OVERLAY, GTK_STACK_TRANSITION_TYPE_OVER_DOWN);
     gtk_widget_grab_focus(GTK_WIDGET(ui->overlay_container));
+    if (ui->animation != NULL) {
+        animation_resume(ui->animation, ANIMATION_PAUSE_LOGIN);
+    }
 }
 
 void ui_uncover(UI* ui)
 {
     gtk_stack_set_visible_child_full(ui->layout_stack, UI_STACK_LOGIN, GTK_STACK_TRANSITION_TYPE_UNDER_UP);
-    gtk_widget_grab_focus(ui->login_ui->password_input);
+    if (ui->animation != NULL) {
+        animation_pause(ui->animation, ANIMATION_PAUSE_LOGIN);
+    }
+    // Clear before focusing, since focusing replays any buffered keys
     gtk_entry_set_text(GTK_ENTRY(ui->login_ui->password_input), "");
+    gtk_widget_grab_focus(ui->login_ui->password_input);
+}
+
+/* Show the background window of every connected monitor */
+void ui_show_background_windows(UI* ui)
+{
+    GHashTableIter iter;
+    gpointer background_window;
+    g_hash_table_iter_init(&iter, ui->background_windows);
+    while (g_hash_table_iter_next(&iter, NULL, &background_window)) {
+        gtk_widget_show_all(GTK_WIDGET(background_window));
+    }
+}
+
+/* Connect a "key-press-event" handler to every background window, including
+ * the ones created for monitors that are plugged in later.
+ */
+void ui_connect_background_key_handler(UI* ui, GCallback handler, gpointer data)
+{
+    ui->background_key_handler = handler;
+    ui->background_key_data = data;
+
+    GHashTableIter iter;
+    gpointer background_window;
+    g_hash_table_iter_init(&iter, ui->background_windows);
+    while (g_hash_table_iter_next(&iter, NULL, &background_window)) {
+        g_signal_connect(GTK_WIDGET(background_window), "key-press-event", handler, data);
+    }
+}
+
+/* Leave one of the rendered backgrounds on the root window.
+ *
+ * Used right before a session starts, so the screen keeps showing the
+ * wallpaper until the desktop draws its own.
+ */
+void ui_publish_root_background(UI* ui, gboolean use_login_background)
+{
+    struct BackgroundPixbuf *bg = use_login_background ? ui->login_bg : ui->overlay_bg;
+
+    int window_x, window_y, window_width, window_height;
+    gtk_window_get_position(ui->main_window, &window_x, &window_y);
+    gtk_window_get_size(ui->main_window, &window_width, &window_height);
+    const int scale = gtk_widget_get_scale_factor(GTK_WIDGET(ui->main_window));
+
+    cairo_surface_t *frame = cairo_image_surface_create(
+        CAIRO_FORMAT_RGB24, window_width * scale, window_height * scale);
+    cairo_t *cr = cairo_create(frame);
+    cairo_scale(cr, scale, scale);
+    paint_background_pixbuf(cr, bg);
+    cairo_destroy(cr);
+
+    root_window_publish_background(frame, window_x * scale, window_y * scale,
+                                   bg->default_color);
+    cairo_surface_destroy(frame);
+}
+
+/* Add the list of other users to the bottom-left of the login page, & start
+ * filling it.
+ */
+void ui_attach_user_picker(UI* ui, UserPickerFunc func, gpointer data)
+{
+    ui->user_picker = initialize_user_picker(func, data);
+    gtk_box_pack_start(ui->layout, ui->user_picker->container, FALSE, FALSE, 0);
+    gtk_widget_show_all(ui->user_picker->container);
+    user_picker_load(ui->user_picker);
+}
+
+/* Stop everything that draws or wakes up on its own while nobody is at the
+ * screen: background fades & rotation, & the animation. With
+ * `idle-release-memory`, the images that aren't shown are freed too.
+ *
+ * Waking up starts it all again & redraws every window right away. The
+ * WallClock is paused & resumed by the caller.
+ */
+void ui_set_idle(UI* ui, gboolean is_idle)
+{
+    if (is_idle == ui->is_idle) {
+        return;
+    }
+    ui->is_idle = is_idle;
+    const gint rotate_interval = ui->config->background_rotate_interval;
+    if (is_idle) {
+        if (ui->background_fade_id != 0) {
+            gtk_widget_remove_tick_callback(GTK_WIDGET(ui->main_window), ui->background_fade_id);
+            finish_background_fade(ui);
+        }
+        if (ui->background_rotate_id != 0) {
+            g_source_remove(ui->background_rotate_id);
+            ui->background_rotate_id = 0;
+        }
+        if (ui->animation != NULL) {
+            animation_pause(ui->animation, ANIMATION_PAUSE_IDLE);
+        }
+        if (ui->config->idle_release_memory) {
+            release_idle_memory(ui);
+        }
+        return;
+    }
+
+    if (ui->animation != NULL) {
+        animation_resume(ui->animation, ANIMATION_PAUSE_IDLE);
+    }
+    if (ui->wallpapers != NULL && ui->wallpapers->count > 1) {
+        if (rotate_interval > 0 && rotate_interval < 60) {
+            ui->background_rotate_id = g_timeout_add_seconds(
+                (guint) rotate_interval, &handle_background_rotate_timer, ui);
+        }
+        if (!ui->next_background_ready) {
+            scheduler_add(ui->scheduler, "next-background", SCHEDULER_PRIORITY_LOW,
+                          &prepare_next_background, ui);
+        } else if (ui->rotate_background_pending) {
+            rotate_background(ui);
+        }
+    }
+    redraw_backgrounds(ui);
 }
 
 /* Create a new UI with all values initialized to NULL */
-static UI *new_ui(Config *config)
+static UI *new_ui(Config *config, Scheduler *scheduler, WallClock *wall_clock)
 {
     UI *ui = malloc(sizeof(UI));
     if (ui == NULL) {
         g_error("Could not allocate memory for UI");
     }
+    ui->config = config;
     ui->background_windows = NULL;
-    ui->monitor_count = 0;
+    ui->background_key_handler = NULL;
+    ui->background_key_data = NULL;
     ui->main_window = NULL;
 
     ui->layout = NULL;
     ui->layout_vertical = NULL;
     ui->overlay_container = NULL;
+    ui->battery_display = NULL;
+    ui->network_display = NULL;
+    ui->power_button = NULL;
+    ui->user_picker = NULL;
+    ui->background_path = NULL;
+    ui->previous_background_path = NULL;
+    ui->background_fade = 1.0;
+    ui->background_fade_id = 0;
+    ui->background_fade_start = 0;
+    ui->next_background_ready = FALSE;
+    ui->rotate_background_pending = FALSE;
+    ui->background_rotate_id = 0;
+    ui->wallpapers = NULL;
+    ui->background_cache = NULL;
+    ui->animation = NULL;
+    ui->overlay_bg = NULL;
+    ui->login_bg = NULL;
+    ui->scheduler = scheduler;
+    ui->wall_clock = wall_clock;
+    ui->is_idle = FALSE;
 
     ui->login_ui = initialize_login_ui(config);
 
@@ -98,55 +317,199 @@ static UI *new_ui(Config *config)
 }
 
 
-/* Create a Background Window for Every Monitor */
+/* Create a Background Window for Every Monitor & Follow Hotplugging
+ *
+ * Only the windows of monitors that are added or removed are created or
+ * destroyed, everything else is kept as is.
+ */
 static void setup_background_windows(Config *config, UI *ui)
 {
     GdkDisplay *display = gdk_display_get_default();
-    ui->monitor_count = gdk_display_get_n_monitors(display);
-    ui->background_windows = malloc((uint) ui->monitor_count * sizeof (GtkWindow *));
-    for (int m = 0; m < ui->monitor_count; m++) {
+    ui->background_windows = g_hash_table_new(NULL, NULL);
+    for (int m = 0; m < gdk_display_get_n_monitors(display); m++) {
         GdkMonitor *monitor = gdk_display_get_monitor(display, m);
         if (monitor == NULL) {
             break;
         }
+        add_background_window(ui, monitor);
+    }
 
-        GtkWindow *background_window = new_background_window(monitor);
-        ui->background_windows[m] = background_window;
+    g_signal_connect(display, "monitor-added",
+                     G_CALLBACK(handle_monitor_added), ui);
+    g_signal_connect(display, "monitor-removed",
+                     G_CALLBACK(handle_monitor_removed), ui);
+    // Also emitted when a different monitor becomes the primary one
+    g_signal_connect(gdk_display_get_default_screen(display), "monitors-changed",
+                     G_CALLBACK(handle_monitors_changed), ui);
+}
 
-        gboolean show_background_image =
-            (gdk_monitor_is_primary(monitor) || config->show_image_on_all_monitors) &&
-            (strcmp(config->background_image, "\"\"") != 0);
-        if (show_background_image) {
-            GtkStyleContext *style_context =
-                gtk_widget_get_style_context(GTK_WIDGET(background_window));
-            gtk_style_context_add_class(style_context, "with-image");
-        }
+
+/* Create, Track & Connect the Background Window for a Monitor */
+static void add_background_window(UI *ui, GdkMonitor *monitor)
+{
+    GtkWindow *background_window = new_background_window(ui, monitor);
+    g_hash_table_insert(ui->background_windows, monitor, background_window);
+
+    g_signal_connect(monitor, "notify::geometry",
+                     G_CALLBACK(handle_monitor_geometry), ui);
+    // Backgrounds are rendered per device pixel, so a new scale is a new size
+    g_signal_connect(monitor, "notify::scale-factor",
+                     G_CALLBACK(handle_monitor_geometry), ui);
+    if (ui->background_key_handler != NULL) {
+        g_signal_connect(GTK_WIDGET(background_window), "key-press-event",
+                         ui->background_key_handler, ui->background_key_data);
+    }
+
+    // Monitors plugged in after the greeter is shown need showing themselves
+    if (ui->main_window != NULL && gtk_widget_get_visible(GTK_WIDGET(ui->main_window))) {
+        gtk_widget_show_all(GTK_WIDGET(background_window));
+    }
+}
+
+static void handle_monitor_added(GdkDisplay *display, GdkMonitor *monitor, gpointer user_data)
+{
+    add_background_window((UI *) user_data, monitor);
+}
+
+static void handle_monitor_removed(GdkDisplay *display, GdkMonitor *monitor, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    GtkWindow *background_window = g_hash_table_lookup(ui->background_windows, monitor);
+    if (background_window == NULL) {
+        return;
+    }
+    g_signal_handlers_disconnect_by_data(monitor, ui);
+    g_hash_table_remove(ui->background_windows, monitor);
+    gtk_widget_destroy(GTK_WIDGET(background_window));
+}
+
+/* Resize the monitor's background window & follow it with the main window if
+ * the monitor is the primary one.
+ */
+static void handle_monitor_geometry(GObject *monitor, GParamSpec *pspec, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    GtkWindow *background_window = g_hash_table_lookup(ui->background_windows, monitor);
+    if (background_window != NULL) {
+        set_window_to_monitor_size(GDK_MONITOR(monitor), background_window);
+        gtk_widget_queue_draw(GTK_WIDGET(background_window));
+    }
+    if (GDK_MONITOR(monitor) == get_primary_monitor()) {
+        fit_main_window_to_primary(ui);
+    }
+}
+
+/* Redraw every background window, since which of them show the image depends
+ * on the primary monitor, & move the main window to the primary monitor.
+ */
+static void handle_monitors_changed(GdkScreen *screen, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    GHashTableIter iter;
+    gpointer background_window;
+    g_hash_table_iter_init(&iter, ui->background_windows);
+    while (g_hash_table_iter_next(&iter, NULL, &background_window)) {
+        gtk_widget_queue_draw(GTK_WIDGET(background_window));
     }
+    fit_main_window_to_primary(ui);
 }
 
 
 /* Create & Configure a Background Window for a Monitor */
-static GtkWindow *new_background_window(GdkMonitor *monitor)
+static GtkWindow *new_background_window(UI *ui, GdkMonitor *monitor)
 {
     GtkWindow *background_window = GTK_WINDOW(gtk_window_new(
         GTK_WINDOW_TOPLEVEL));
     gtk_window_set_type_hint(background_window, GDK_WINDOW_TYPE_HINT_DESKTOP);
     gtk_window_set_keep_below(background_window, TRUE);
     gtk_widget_set_name(GTK_WIDGET(background_window), "background");
+    // The wallpaper is painted by draw_background_window instead of CSS
+    gtk_widget_set_app_paintable(GTK_WIDGET(background_window), TRUE);
+    g_object_set_data(G_OBJECT(background_window), "monitor", monitor);
 
     // Set Window Size to Monitor Size
     set_window_to_monitor_size(monitor, background_window);
 
     g_signal_connect(background_window, "realize", G_CALLBACK(hide_mouse_cursor),
                      NULL);
-    // TODO: is this needed?
-    g_signal_connect(background_window, "destroy", G_CALLBACK(gtk_main_quit),
-                     NULL);
+    g_signal_connect(background_window, "draw", G_CALLBACK(draw_background_window),
+                     ui);
 
     return background_window;
 }
 
 
+/* Paint the wallpaper scaled for the window's monitor, or only the background
+ * color if the image is not shown on this monitor.
+ *
+ * While fading, a wallpaper that is not rendered for this monitor is left out
+ * rather than decoded in the middle of the fade.
+ */
+static gboolean draw_background_window(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    GdkMonitor *monitor = g_object_get_data(G_OBJECT(widget), "monitor");
+
+    gdk_cairo_set_source_rgba(cr, ui->config->background_color);
+    cairo_paint(cr);
+
+    gboolean show_background_image = monitor != NULL &&
+        (gdk_monitor_is_primary(monitor) || ui->config->show_image_on_all_monitors);
+    if (!show_background_image) {
+        return FALSE;
+    }
+
+    gint width, height;
+    get_monitor_pixel_size(monitor, &width, &height);
+    const gdouble scale = gdk_monitor_get_scale_factor(monitor);
+    cairo_scale(cr, 1 / scale, 1 / scale);
+    gdouble alpha = 1.0;
+    BackgroundSet *set;
+    if (ui->previous_background_path != NULL) {
+        BackgroundSet *previous = background_cache_lookup(
+            ui->background_cache, ui->previous_background_path, width, height);
+        if (previous != NULL && previous->cover != NULL) {
+            cairo_set_source_surface(cr, previous->cover, 0, 0);
+            cairo_paint(cr);
+        }
+        alpha = ui->background_fade;
+        set = background_cache_lookup(ui->background_cache, ui->background_path, width, height);
+    } else {
+        set = background_cache_get(ui->background_cache, ui->background_path, width, height);
+    }
+    if (set != NULL && set->cover != NULL) {
+        cairo_set_source_surface(cr, set->cover, 0, 0);
+        cairo_paint_with_alpha(cr, alpha);
+    }
+    return FALSE;
+}
+
+
+/* Get the primary monitor, or the first one if none is marked as primary */
+static GdkMonitor *get_primary_monitor(void)
+{
+    GdkDisplay *display = gdk_display_get_default();
+    GdkMonitor *monitor = gdk_display_get_primary_monitor(display);
+    if (monitor == NULL) {
+        monitor = gdk_display_get_monitor(display, 0);
+    }
+    return monitor;
+}
+
+
+/* A monitor's size in device pixels, which backgrounds are rendered at, so
+ * they stay sharp on HiDPI screens.
+ */
+static void get_monitor_pixel_size(GdkMonitor *monitor, gint *width, gint *height)
+{
+    GdkRectangle geometry;
+    gdk_monitor_get_geometry(monitor, &geometry);
+    const gint scale = gdk_monitor_get_scale_factor(monitor);
+    *width = geometry.width * scale;
+    *height = geometry.height * scale;
+}
+
+
 /* Set the Window's Minimum Size to the Default Screen's Size */
 static void set_window_to_monitor_size(GdkMonitor *monitor, GtkWindow *window)
 {
@@ -157,6 +520,7 @@ static void set_window_to_monitor_size(GdkMonitor *monitor, GtkWindow *window)
         geometry.width,
         geometry.height
     );
+    gtk_window_resize(window, geometry.width, geometry.height);
     gtk_window_move(window, geometry.x, geometry.y);
     gtk_window_set_resizable(window, FALSE);
 }
@@ -212,9 +576,7 @@ static void setup_main_window(Config *config, UI *ui)
     // gtk_container_set_border_width(GTK_CONTAINER(main_window), config->layout_spacing);
     gtk_widget_set_name(GTK_WIDGET(main_window), "main");
 
-    GdkDisplay *display = gdk_display_get_default();
-    GdkMonitor *monitor = gdk_display_get_monitor(display, 0);
-    set_window_to_monitor_size(monitor, GTK_WINDOW(main_window));
+    set_window_to_monitor_size(get_primary_monitor(), GTK_WINDOW(main_window));
 
     g_signal_connect(main_window, "show", G_CALLBACK(place_main_window), ui);
     g_signal_connect(main_window, "realize", G_CALLBACK(show_default_cursor),
@@ -234,10 +596,8 @@ static void setup_main_window(Config *config, UI *ui)
 static void place_main_window(GtkWidget *main_window, gpointer user_data)
 {
     // Get the Geometry of the Primary Monitor
-    GdkDisplay *display = gdk_display_get_default();
-    GdkMonitor *primary_monitor = gdk_display_get_primary_monitor(display);
     GdkRectangle primary_monitor_geometry;
-    gdk_monitor_get_geometry(primary_monitor, &primary_monitor_geometry);
+    gdk_monitor_get_geometry(get_primary_monitor(), &primary_monitor_geometry);
 
     // Get the Geometry of the Window
     gint window_width, window_height;
@@ -255,6 +615,37 @@ static void place_main_window(GtkWidget *main_window, gpointer user_data)
 }
 
 
+/* Resize & re-center the main window after the primary monitor changed, &
+ * switch its backgrounds to the ones rendered for the new geometry.
+ */
+static void fit_main_window_to_primary(UI *ui)
+{
+    GdkMonitor *primary = get_primary_monitor();
+    set_window_to_monitor_size(primary, ui->main_window);
+    place_main_window(GTK_WIDGET(ui->main_window), NULL);
+    update_main_window_backgrounds(ui);
+    gtk_widget_queue_draw(GTK_WIDGET(ui->main_window));
+
+    gint width, height;
+    get_monitor_pixel_size(primary, &width, &height);
+    if (ui->animation != NULL) {
+        animation_set_geometry(ui->animation, width, height);
+    }
+
+    // Images that fit the new shape may be different ones
+    if (ui->wallpapers != NULL && ui->wallpapers->count > 1) {
+        gchar *next_path = g_strdup(wallpapers_peek_next(ui->wallpapers));
+        wallpapers_set_geometry(ui->wallpapers, width, height);
+        if (strcmp(next_path, wallpapers_peek_next(ui->wallpapers)) != 0 &&
+                ui->background_fade_id == 0) {
+            scheduler_add(ui->scheduler, "next-background", SCHEDULER_PRIORITY_LOW,
+                          &prepare_next_background, ui);
+        }
+        g_free(next_path);
+    }
+}
+
+
 /* Add a Stack for All Widgets */
 static void create_and_attach_layout_stack(UI *ui)
 {
@@ -266,202 +657,492 @@ static void create_and_attach_layout_stack(UI *ui)
 
 }
 
-/**
- * Apply Gaussian Blur to a GdkPixBuf.
- * Edges are treated as if a mirrored image was off to each side.
-*/
-static void blur_pixbuf(GdkPixbuf *buf, int radius)
+/* Paint the cover image with a gradient that darkens the bottom, where the
+ * time & status icons are.
+ */
+static void paint_overlay_background(cairo_t *cr, struct BackgroundPixbuf *bg, int width, int height)
 {
-    GdkPixbuf *dest = gdk_pixbuf_copy(buf);
+    paint_background_pixbuf(cr, bg);
+    paint_overlay_gradient(cr, width, height);
+}
 
-    int width = gdk_pixbuf_get_width(buf);
-    int height = gdk_pixbuf_get_height(buf);
-    int stride = gdk_pixbuf_get_rowstride(buf);
-    int num_channels = gdk_pixbuf_get_n_channels(buf);
+static void paint_overlay_gradient(cairo_t *cr, int width, int height)
+{
+    cairo_pattern_t* gradient = cairo_pattern_create_linear(0, 0, 0, height);
 
-    guchar *src_data = gdk_pixbuf_get_pixels(buf);
-    guchar *dst_data = gdk_pixbuf_get_pixels(dest);
+    cairo_pattern_add_color_stop_rgba(gradient, 0, 0, 0, 0, 0);
+    cairo_pattern_add_color_stop_rgba(gradient, 0.5, 0, 0, 0, 0);
+    cairo_pattern_add_color_stop_rgba(gradient, 0.8, 0, 0, 0, 0.4);
 
-    g_assert(num_channels == 3);
-    g_assert(gdk_pixbuf_get_bits_per_sample(buf) == 8);
+    cairo_rectangle(cr, 0, 0, width, height);
+    cairo_set_source(cr, gradient);
+    cairo_fill(cr);
 
-    float sigma = (float)radius / 2.0f;
-    sigma = MAX(sigma, 1.0f);
+    cairo_pattern_destroy(gradient);
+}
 
-    // Kernel setup
-    const int kernel_width = (2*radius) + 1;
-    float kernel[kernel_width];
-    float kernel_sum = 0;
+/* Draw the animation's current frame, or the cover image until the first
+ * frame is decoded.
+ */
+static gboolean draw_overlay_background(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    UI *ui = (UI *) data;
+    GtkAllocation rect = {0};
+    gtk_widget_get_allocation(widget, &rect);
+    cairo_surface_t *frame = ui->animation == NULL ? NULL : animation_get_frame(ui->animation);
+    if (frame == NULL) {
+        paint_overlay_background(cr, ui->overlay_bg, rect.width, rect.height);
+    } else {
+        // Frames are decoded at device pixels
+        const gdouble scale = gtk_widget_get_scale_factor(widget);
+        cairo_save(cr);
+        cairo_scale(cr, 1 / scale, 1 / scale);
+        cairo_set_source_surface(cr, frame, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+        paint_overlay_gradient(cr, rect.width, rect.height);
+    }
 
-    // populate kernel
-    for (int k = -radius; k < radius; k++) {
-        float e_numerator = (float) -(k*k);
-        float e_denominator = 2.0f * sigma*sigma;
-        float e_term = expf(e_numerator / e_denominator);
+    return FALSE;
+}
 
-        float kernel_value = e_term / (2.0f * M_PIf * sigma*sigma);
-        kernel[k + radius] = kernel_value;
-        kernel_sum += kernel_value;
+/* Cache a frame of the cover page for the early splash on the next start.
+ *
+ * The frame is only re-rendered when the geometry, the config, or the image
+ * has changed.
+ */
+static void save_splash_frame(gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+
+    int window_x, window_y, window_width, window_height;
+    gtk_window_get_position(ui->main_window, &window_x, &window_y);
+    gtk_window_get_size(ui->main_window, &window_width, &window_height);
+    // The root window is in device pixels
+    const int scale = gtk_widget_get_scale_factor(GTK_WIDGET(ui->main_window));
+    if (!root_window_splash_is_stale(ui->background_path, window_x * scale, window_y * scale,
+                                     window_width * scale, window_height * scale)) {
+        return;
     }
-    // normalize kernel
-    for (int k = 0; k < kernel_width; k++) {
-        kernel[k] /= kernel_sum;
+
+    cairo_surface_t *frame = cairo_image_surface_create(
+        CAIRO_FORMAT_RGB24, window_width * scale, window_height * scale);
+    cairo_t *cr = cairo_create(frame);
+    cairo_scale(cr, scale, scale);
+    paint_overlay_background(cr, ui->overlay_bg, window_width, window_height);
+    cairo_destroy(cr);
+
+    root_window_save_splash(frame, window_x * scale, window_y * scale);
+    cairo_surface_destroy(frame);
+}
+
+static gboolean draw_blurred_background(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    struct BackgroundPixbuf* bg = (struct BackgroundPixbuf*) data;
+    paint_background_pixbuf(cr, bg);
+
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+
+    cairo_paint(cr);
+
+    return FALSE;
+}
+
+/* Paint a background's image, or its color if there is no image, faded in
+ * over the image it is replacing.
+ */
+static void paint_background_pixbuf(cairo_t *cr, struct BackgroundPixbuf *bg)
+{
+    gdouble alpha = 1.0;
+    if (bg->previous != NULL) {
+        paint_scaled_surface(cr, bg->previous, bg->previous_scale, 1.0);
+        alpha = bg->fade;
     }
+    if (bg->buf == NULL) {
+        gdk_cairo_set_source_rgba(cr, bg->default_color);
+        cairo_paint_with_alpha(cr, alpha);
+    } else {
+        paint_scaled_surface(cr, bg->buf, bg->scale, alpha);
+    }
+}
 
-    // Horizontal blur
-    for (int y = 0; y < (height); y++) {
-        for (int x = 0; x < (width); x++) {
-            guchar *dst_pixel = dst_data + y * stride + x * num_channels;
+static void paint_scaled_surface(cairo_t *cr, cairo_surface_t *surface, gdouble scale,
+                                 gdouble alpha)
+{
+    cairo_save(cr);
+    cairo_scale(cr, scale, scale);
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_paint_with_alpha(cr, alpha);
+    cairo_restore(cr);
+}
 
-            float r, g, b;
-            r = g = b = 0.0f;
+static struct BackgroundPixbuf *new_background_pixbuf(GdkRGBA *default_color)
+{
+    struct BackgroundPixbuf *bg = malloc(sizeof(struct BackgroundPixbuf));
+    if (bg == NULL) {
+        g_error("Could not allocate memory for BackgroundPixbuf");
+    }
+    bg->default_color = default_color;
+    bg->buf = NULL;
+    bg->scale = 1.0;
+    bg->previous = NULL;
+    bg->previous_scale = 1.0;
+    bg->fade = 1.0;
+    return bg;
+}
 
-            for (int k = -radius; k < radius; k++) {
-                int src_x = x + k;
-                if (src_x < 0) {
-                    src_x = -src_x + 1;
-                } else if (src_x >= width) {
-                    src_x = width - (width - src_x);
-                }
-                float kernel_value = kernel[k + radius];
-                guchar *src_pixel = src_data + (y * stride) + (src_x * num_channels);
+/* Pick the first wallpaper & queue preparing the one after it.
+ *
+ * The first wallpaper is decoded right away, since the cover page needs it;
+ * every following one is rendered on a worker thread before it is shown.
+ */
+static void init_background_image(UI* ui, Config* config)
+{
+    ui->login_bg = new_background_pixbuf(config->background_color);
+    ui->overlay_bg = new_background_pixbuf(config->background_color);
+    ui->background_cache = initialize_background_cache(
+        (gsize) config->background_memory_budget * 1024 * 1024);
 
-                r += src_pixel[0] * kernel_value;
-                g += src_pixel[1] * kernel_value;
-                b += src_pixel[2] * kernel_value;
-            }
+    char *bg_url = strndup(config->background_image + 1, strlen(config->background_image) - 2);
+    if (strlen(bg_url) > 0) {
+        gint width, height;
+        get_monitor_pixel_size(get_primary_monitor(), &width, &height);
+        ui->wallpapers = initialize_wallpapers(bg_url, width, height);
+        ui->background_path = g_strdup(wallpapers_current(ui->wallpapers));
+    }
+    free(bg_url);
 
-            dst_pixel[0] = (guchar) r;
-            dst_pixel[1] = (guchar) g;
-            dst_pixel[2] = (guchar) b;
+    update_main_window_backgrounds(ui);
+
+    if (ui->wallpapers != NULL && ui->wallpapers->count > 1) {
+        scheduler_add(ui->scheduler, "next-background", SCHEDULER_PRIORITY_LOW,
+                      &prepare_next_background, ui);
+        // Intervals of a minute or more share the clock's wakeup, rounded to
+        // whole minutes
+        const gint interval = config->background_rotate_interval;
+        if (interval >= 60) {
+            wall_clock_add(ui->wall_clock, "background-rotation", (guint) (interval + 30) / 60,
+                           &handle_background_rotate_tick, ui);
+        } else if (interval > 0) {
+            ui->background_rotate_id = g_timeout_add_seconds(
+                (guint) interval, &handle_background_rotate_timer, ui);
         }
     }
+}
 
-    // vertical blur
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            guchar *dst_pixel = src_data + y * stride + x * num_channels;
+/* Point the cover & login page at the wallpaper rendered for the primary
+ * monitor's size in device pixels. The surfaces are owned by the
+ * BackgroundCache.
+ */
+static void update_main_window_backgrounds(UI *ui)
+{
+    GdkMonitor *primary = get_primary_monitor();
+    gint width, height;
+    get_monitor_pixel_size(primary, &width, &height);
+    BackgroundSet *set = background_cache_get(ui->background_cache, ui->background_path,
+                                              width, height);
+    if (set == NULL || set->cover == NULL) {
+        ui->overlay_bg->buf = NULL;
+        ui->login_bg->buf = NULL;
+        return;
+    }
 
-            float r, g, b;
-            r = g = b = 0.0f;
+    // Setup for drawing the picture on the overlay, in logical pixels
+    const gdouble scale = gdk_monitor_get_scale_factor(primary);
+    ui->overlay_bg->buf = set->cover;
+    ui->overlay_bg->scale = 1 / scale;
+
+    ui->login_bg->buf = set->blurred;
+    ui->login_bg->scale = set->blurred_scale / scale;
+    if (set->blurred == NULL) {
+        // The login page is hidden behind the cover, so blurring can wait
+        scheduler_add(ui->scheduler, "login-background",
+                      SCHEDULER_PRIORITY_HIGH, &blur_login_background, ui);
+    }
+}
 
-            for (int k = -radius; k < radius; k++) {
-                int src_y = y + k;
-                if (src_y < 0) {
-                    src_y = -src_y + 1;
-                } else if (src_y >= height) {
-                    src_y = height - (height - src_y);
-                }
+/* Blur the visible part of the cover image for the login page's background.
+ *
+ * Until this runs, the login page is drawn with the background color.
+ */
+static void blur_login_background(gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    GdkMonitor *primary = get_primary_monitor();
+    gint width, height;
+    get_monitor_pixel_size(primary, &width, &height);
+    BackgroundSet *set = background_cache_get(ui->background_cache, ui->background_path,
+                                              width, height);
+    if (set == NULL) {
+        return;
+    }
+
+    background_set_blur(ui->background_cache, set);
+    ui->login_bg->buf = set->blurred;
+    ui->login_bg->scale = set->blurred_scale / (gdouble) gdk_monitor_get_scale_factor(primary);
+    if (ui->layout != NULL) {
+        gtk_widget_queue_draw(GTK_WIDGET(ui->layout));
+    }
+}
 
-                    float kernel_value = kernel[k + radius];
-                    guchar *src_pixel = dst_data + (src_y * stride) + (x * num_channels);
 
-                    r += src_pixel[0] * kernel_value;
-                    g += src_pixel[1] * kernel_value;
-                    b += src_pixel[2] * kernel_value;
-            }
+/* Render the next wallpaper on a worker thread, for the primary monitor with
+ * the login page's blur, & for every other monitor that shows the image.
+ */
+static void prepare_next_background(gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    ui->next_background_ready = FALSE;
+    if (ui->is_idle) {
+        // Prepared again by ui_set_idle once someone is at the screen
+        return;
+    }
 
-            dst_pixel[0] = (guchar) r;
-            dst_pixel[1] = (guchar) g;
-            dst_pixel[2] = (guchar) b;
+    GArray *requests = g_array_new(FALSE, FALSE, sizeof(BackgroundRequest));
+    GdkMonitor *primary = get_primary_monitor();
+    add_background_request(requests, primary, TRUE);
+    if (ui->config->show_image_on_all_monitors) {
+        GHashTableIter iter;
+        gpointer monitor;
+        g_hash_table_iter_init(&iter, ui->background_windows);
+        while (g_hash_table_iter_next(&iter, &monitor, NULL)) {
+            add_background_request(requests, GDK_MONITOR(monitor), FALSE);
         }
     }
-    
-   g_object_unref(dest);
+
+    background_cache_prepare(ui->background_cache, wallpapers_peek_next(ui->wallpapers),
+                             requests, &handle_next_background_ready, ui);
+    g_array_unref(requests);
 }
 
-static gboolean draw_overlay_background(GtkWidget *widget, cairo_t *cr, gpointer data)
+/* Request a monitor's size in device pixels, unless an earlier monitor has
+ * the same one
+ */
+static void add_background_request(GArray *requests, GdkMonitor *monitor, gboolean blur)
 {
-    struct BackgroundPixbuf* bg = (struct BackgroundPixbuf*) data;
-    if (bg->buf == NULL) {
-        gdk_cairo_set_source_rgba(cr, bg->default_color);
-    } else {
-        gdk_cairo_set_source_pixbuf(cr, bg->buf, bg->x, bg->y);
+    gint width, height;
+    get_monitor_pixel_size(monitor, &width, &height);
+    for (guint r = 0; r < requests->len; r++) {
+        BackgroundRequest *request = &g_array_index(requests, BackgroundRequest, r);
+        if (request->width == width && request->height == height) {
+            request->blur = request->blur || blur;
+            return;
+        }
     }
-    cairo_paint(cr);
+    BackgroundRequest request = { width, height, blur };
+    g_array_append_val(requests, request);
+}
 
-    // overlay the gradient
-    GtkAllocation rect = {0};
-    gtk_widget_get_allocation(widget, &rect);
+static void handle_next_background_ready(const gchar *path, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    if (strcmp(path, wallpapers_peek_next(ui->wallpapers)) != 0) {
+        // The next image changed while this one was being prepared
+        prepare_next_background(ui);
+        return;
+    }
+    ui->next_background_ready = TRUE;
+    trim_background_cache(ui);
+    if (ui->rotate_background_pending && !ui->is_idle) {
+        rotate_background(ui);
+    }
+}
 
-    cairo_pattern_t* gradient = cairo_pattern_create_linear(0, 0, 0, rect.height);
+static gboolean handle_background_rotate_timer(gpointer user_data)
+{
+    rotate_background((UI *) user_data);
+    return G_SOURCE_CONTINUE;
+}
 
-    cairo_pattern_add_color_stop_rgba(gradient, 0, 0, 0, 0, 0);
-    cairo_pattern_add_color_stop_rgba(gradient, 0.5, 0, 0, 0, 0);
-    cairo_pattern_add_color_stop_rgba(gradient, 0.8, 0, 0, 0, 0.4);
+static void handle_background_rotate_tick(gpointer user_data)
+{
+    rotate_background((UI *) user_data);
+}
 
-    cairo_rectangle(cr, 0, 0, rect.width, rect.height);
-    cairo_set_source(cr, gradient);
-    cairo_fill(cr);
+/* Crossfade to the next wallpaper, or show it as soon as it is prepared */
+static void rotate_background(UI *ui)
+{
+    if (!ui->next_background_ready) {
+        ui->rotate_background_pending = TRUE;
+        return;
+    }
+    if (ui->background_fade_id != 0) {
+        gtk_widget_remove_tick_callback(GTK_WIDGET(ui->main_window), ui->background_fade_id);
+        finish_background_fade(ui);
+    }
+    ui->rotate_background_pending = FALSE;
+    ui->next_background_ready = FALSE;
+
+    // Keep the current image around to fade out from
+    ui->previous_background_path = ui->background_path;
+    wallpapers_advance(ui->wallpapers);
+    ui->background_path = g_strdup(wallpapers_current(ui->wallpapers));
+    ui->overlay_bg->previous = ui->overlay_bg->buf;
+    ui->overlay_bg->previous_scale = ui->overlay_bg->scale;
+    ui->login_bg->previous = ui->login_bg->buf;
+    ui->login_bg->previous_scale = ui->login_bg->scale;
+    update_main_window_backgrounds(ui);
+
+    set_background_fade(ui, 0.0);
+    ui->background_fade_start = 0;
+    ui->background_fade_id = gtk_widget_add_tick_callback(
+        GTK_WIDGET(ui->main_window), &handle_background_fade, ui, NULL);
+}
 
-    cairo_pattern_destroy(gradient);
+static gboolean handle_background_fade(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    gint64 now = gdk_frame_clock_get_frame_time(clock);
+    if (ui->background_fade_start == 0) {
+        ui->background_fade_start = now;
+    }
 
-    return FALSE;
+    gdouble fade = (gdouble) (now - ui->background_fade_start) /
+        (gdouble) UI_BACKGROUND_FADE_USEC;
+    if (fade >= 1.0) {
+        finish_background_fade(ui);
+        return G_SOURCE_REMOVE;
+    }
+    set_background_fade(ui, fade);
+    return G_SOURCE_CONTINUE;
 }
 
-static gboolean draw_blurred_background(GtkWidget *widget, cairo_t *cr, gpointer data)
+/* Set how far the current wallpaper has faded in & redraw every window */
+static void set_background_fade(UI *ui, gdouble fade)
 {
-    struct BackgroundPixbuf* bg = (struct BackgroundPixbuf*) data;
-    if (bg->buf == NULL) {
-        gdk_cairo_set_source_rgba(cr, bg->default_color);
-    } else {
-        gdk_cairo_set_source_pixbuf(cr, bg->buf, bg->x, bg->y);
+    ui->background_fade = fade;
+    ui->overlay_bg->fade = fade;
+    ui->login_bg->fade = fade;
+    redraw_backgrounds(ui);
+}
+
+/* Redraw the main window & every background window */
+static void redraw_backgrounds(UI *ui)
+{
+    gtk_widget_queue_draw(GTK_WIDGET(ui->main_window));
+    GHashTableIter iter;
+    gpointer background_window;
+    g_hash_table_iter_init(&iter, ui->background_windows);
+    while (g_hash_table_iter_next(&iter, NULL, &background_window)) {
+        gtk_widget_queue_draw(GTK_WIDGET(background_window));
     }
-    cairo_paint(cr);
+}
 
-    cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+/* Drop the faded out wallpaper & start preparing the one after the new one */
+static void finish_background_fade(UI *ui)
+{
+    ui->background_fade_id = 0;
+    ui->overlay_bg->previous = NULL;
+    ui->login_bg->previous = NULL;
+    g_clear_pointer(&ui->previous_background_path, g_free);
+    set_background_fade(ui, 1.0);
+
+    trim_background_cache(ui);
+    scheduler_add(ui->scheduler, "next-background", SCHEDULER_PRIORITY_LOW,
+                  &prepare_next_background, ui);
+    scheduler_add(ui->scheduler, "memory-budget", SCHEDULER_PRIORITY_LOW,
+                  &check_memory_budget, ui);
+}
 
-    cairo_paint(cr);
+/* Keep the cache within its budget, without dropping the images that are
+ * shown, fading out, or prepared to be shown next.
+ */
+static void trim_background_cache(UI *ui)
+{
+    const gchar *keep_paths[4] = { NULL, NULL, NULL, NULL };
+    int kept = 0;
+    if (ui->background_path == NULL) {
+        return;
+    }
+    keep_paths[kept++] = ui->background_path;
+    if (ui->wallpapers != NULL) {
+        keep_paths[kept++] = wallpapers_peek_next(ui->wallpapers);
+    }
+    if (ui->previous_background_path != NULL) {
+        keep_paths[kept++] = ui->previous_background_path;
+    }
+    background_cache_trim(ui->background_cache, keep_paths);
+}
 
-    return FALSE;
+
+/* Free the animation's frames & every wallpaper but the shown one. The next
+ * wallpaper is prepared again after waking up.
+ */
+static void release_idle_memory(UI *ui)
+{
+    if (ui->animation != NULL) {
+        animation_release_frames(ui->animation);
+    }
+    if (ui->background_path != NULL) {
+        const gchar *keep_paths[] = { ui->background_path, NULL };
+        background_cache_release(ui->background_cache, keep_paths);
+        ui->next_background_ready = FALSE;
+    }
+    memory_usage_trim();
+    memory_usage_log("going idle");
 }
 
-static void init_background_image(UI* ui, Config* config)
+
+/* Play the `background-animation` on the cover page.
+ *
+ * Playback pauses while the login page is shown, & while the main window is
+ * fully covered, e.g. by the X screen saver blanking the screen.
+ */
+static void init_background_animation(UI *ui, Config *config)
 {
-    ui->login_bg = malloc(sizeof(struct BackgroundPixbuf));
-    ui->login_bg->default_color = config->background_color;
-    ui->login_bg->buf = NULL;
-    ui->login_bg->x = 0;
-    ui->login_bg->y = 0;
+    if (config->background_animation == NULL) {
+        return;
+    }
+    ui->animation = initialize_animation(config->background_animation,
+                                         config->background_animation_fps,
+                                         GTK_WIDGET(ui->overlay_container));
+    gint width, height;
+    get_monitor_pixel_size(get_primary_monitor(), &width, &height);
+    animation_set_geometry(ui->animation, width, height);
+
+    gtk_widget_add_events(GTK_WIDGET(ui->main_window), GDK_VISIBILITY_NOTIFY_MASK);
+    g_signal_connect(ui->main_window, "visibility-notify-event",
+                     G_CALLBACK(handle_main_window_visibility), ui);
+}
 
-    ui->overlay_bg = malloc(sizeof(struct BackgroundPixbuf));
-    ui->overlay_bg->default_color = config->background_color;
-    ui->overlay_bg->buf = NULL;
-    ui->overlay_bg->x = 0;
-    ui->overlay_bg->y = 0;
+static gboolean handle_main_window_visibility(GtkWidget *widget, GdkEventVisibility *event,
+                                              gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    if (event->state == GDK_VISIBILITY_FULLY_OBSCURED) {
+        animation_pause(ui->animation, ANIMATION_PAUSE_HIDDEN);
+    } else {
+        animation_resume(ui->animation, ANIMATION_PAUSE_HIDDEN);
+    }
+    return FALSE;
+}
 
-    char *bg_url = strndup(config->background_image + 1, strlen(config->background_image) - 2);
-    if (strlen(bg_url) > 0) {
-        int window_width, window_height;
-        gtk_window_get_size(ui->main_window, &window_width, &window_height);
-
-        GError* error = NULL;
-        GdkPixbuf* buf = load_image_to_cover(bg_url, (guint) window_width, (guint) window_height, &error);
-
-        if (error == NULL) {
-            // Offset to center the image
-            gdouble bg_x_offset = -((gdk_pixbuf_get_width(buf) / 2) - (window_width / 2));
-            gdouble bg_y_offset = -((gdk_pixbuf_get_height(buf) / 2) - (window_height / 2));
-            fprintf(stderr, "[GREETER] copying: (%f, %f) %d x %d\n", bg_x_offset, bg_y_offset, window_width, window_height);
-            fprintf(stderr, "[GREETER] from: %d x %d\n", 
-                gdk_pixbuf_get_width(buf), gdk_pixbuf_get_height(buf));
-
-            // Setup for drawing the picture on the overlay
-            ui->overlay_bg->buf = buf;
-            ui->overlay_bg->x = bg_x_offset;
-            ui->overlay_bg->y = bg_y_offset;
-            
-            // Blurred Background
-            GdkPixbuf *blurred_buf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, window_width, window_height);
-            gdk_pixbuf_copy_area(buf, (int)-bg_x_offset, (int)-bg_y_offset, window_width, window_height, blurred_buf, 0, 0);
-            blur_pixbuf(blurred_buf, 25);
-
-            ui->login_bg->buf = blurred_buf;
-        } else {
-            g_warning("[GREETER] error loading background: %s\n", error->message);
+
+/* Log what memory is used for, & shrink what we can if the process is over
+ * the `memory-budget`: every cached wallpaper that is not shown or next is
+ * dropped, covers are cropped to the screen, blurred images are kept at a
+ * fraction of their size, & freed heap memory is returned to the system.
+ */
+static void check_memory_budget(gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+    gsize budget = (gsize) ui->config->memory_budget * 1024 * 1024;
+    if (budget > 0 && memory_usage_get_rss() > budget) {
+        if (ui->background_fade_id != 0) {
+            // The faded out image is still drawn, check again once it is done
+            return;
+        }
+        if (!ui->background_cache->compact) {
+            g_message("Over the memory-budget of %dMiB, compacting backgrounds",
+                      ui->config->memory_budget);
+            background_cache_compact(ui->background_cache);
+            update_main_window_backgrounds(ui);
+            redraw_backgrounds(ui);
         }
+        trim_background_cache(ui);
+        memory_usage_trim();
     }
-    free(bg_url);
+    memory_usage_log(ui->background_fade_start == 0 ? "startup" : "rotating the background");
 }
 
 /* Add a Layout Container for The login Widgets */
@@ -485,8 +1166,10 @@ static void create_and_attach_layout_container(UI *ui)
 }
 
 /* Add the power menu */
-static void create_and_attach_power_menu(UI* ui)
+static void create_and_attach_power_menu(gpointer user_data)
 {
+    UI *ui = (UI *) user_data;
+
     ui->power_button = GTK_WIDGET(gtk_menu_button_new());
     gtk_widget_set_name(ui->power_button, "power-button");
     gtk_widget_set_vexpand(ui->power_button, FALSE);
@@ -494,11 +1177,8 @@ static void create_and_attach_power_menu(UI* ui)
     gtk_button_set_relief(GTK_BUTTON(ui->power_button), GTK_RELIEF_NONE);
     gtk_menu_button_set_direction(GTK_MENU_BUTTON(ui->power_button), GTK_ARROW_UP);
 
-    GdkPixbuf* icon = icon_shutdown(27);
-    GtkWidget* icon_image = gtk_image_new_from_pixbuf(icon);
-    g_object_unref(icon);
     gtk_container_add(GTK_CONTAINER(ui->power_button),
-                    GTK_WIDGET(icon_image));
+                    icon_widget_new(ICON_SHUTDOWN));
 
 
     ui->power_menu = GTK_MENU(gtk_menu_new());
@@ -526,6 +1206,7 @@ static void create_and_attach_power_menu(UI* ui)
     gtk_widget_show(GTK_WIDGET(ui->power_suspend));
 
     gtk_box_pack_end(ui->layout, GTK_WIDGET(ui->power_button), FALSE, FALSE, 0);
+    gtk_widget_show_all(ui->power_button);
 }
 
 
@@ -537,7 +1218,7 @@ static void create_and_attach_overlay_container(UI *ui)
     gtk_grid_set_row_spacing(ui->overlay_container, 5);
     gtk_widget_set_name(GTK_WIDGET(ui->overlay_container), "overlay");
 
-    g_signal_connect(G_OBJECT(ui->overlay_container), "draw", G_CALLBACK(draw_overlay_background), ui->overlay_bg);
+    g_signal_connect(G_OBJECT(ui->overlay_container), "draw", G_CALLBACK(draw_overlay_background), ui);
 
     // time: filled out by callback
     ui->time_label = gtk_label_new("Time");
@@ -555,31 +1236,56 @@ static void create_and_attach_overlay_container(UI *ui)
         ui->overlay_container, GTK_WIDGET(ui->time_label), 0, 0, 1, 1);
     gtk_grid_attach(
         ui->overlay_container, GTK_WIDGET(ui->date_label), 0, 1, 1, 1);
-    
+
+    // battery & network widgets: attached once the first frame is drawn
+    scheduler_add(ui->scheduler, "status-icons", SCHEDULER_PRIORITY_NORMAL,
+                  &create_and_attach_status_icons, ui);
+
+    gtk_stack_add_named(GTK_STACK(ui->layout_stack),
+                      GTK_WIDGET(ui->overlay_container),
+                      UI_STACK_OVERLAY);
+}
+
+/* Add the battery & network icons to the bottom-right of the overlay.
+ *
+ * Columns 1 & 2 are left empty to space the icons away from the date.
+ */
+static void create_and_attach_status_icons(gpointer user_data)
+{
+    UI *ui = (UI *) user_data;
+
     // battery widget
     ui->battery_display = battery_widget();
     gtk_widget_set_hexpand(GTK_WIDGET(ui->battery_display), TRUE);
     gtk_widget_set_halign(GTK_WIDGET(ui->battery_display), GTK_ALIGN_END);
 
     // network widget
-    ui->network_display = init_network_widget();
+    ui->network_display = init_network_widget(ui->wall_clock);
 
     gtk_grid_attach(
-        ui->overlay_container, GTK_WIDGET(ui->battery_display), 2, 1, 1, 1);
+        ui->overlay_container, GTK_WIDGET(ui->battery_display), 3, 1, 1, 1);
     gtk_grid_attach(
-        ui->overlay_container, GTK_WIDGET(ui->network_display), 3, 1, 1, 1);
+        ui->overlay_container, GTK_WIDGET(ui->network_display), 4, 1, 1, 1);
 
-    gtk_grid_insert_column(ui->overlay_container, 2);
-
-    gtk_stack_add_named(GTK_STACK(ui->layout_stack),
-                      GTK_WIDGET(ui->overlay_container),
-                      UI_STACK_OVERLAY);
+    gtk_widget_show_all(ui->battery_display);
+    gtk_widget_show_all(ui->network_display);
 }
 
-/* Attach a style provider to the screen, using color options from config */
+/* Attach the compiled stylesheet to the screen, along with a small provider
+ * of the values it uses from the config.
+ *
+ * The values are given a higher priority, so they must not set properties
+ * the stylesheet sets on the same widgets.
+ */
 static void attach_config_colors_to_screen(Config* config)
 {
-    GtkCssProvider* provider = gtk_css_provider_new();
+    GdkScreen *screen = gdk_screen_get_default();
+
+    GtkCssProvider* stylesheet = gtk_css_provider_new();
+    gtk_css_provider_load_from_resource(stylesheet, UI_STYLESHEET_RESOURCE);
+    gtk_style_context_add_provider_for_screen(
+        screen, GTK_STYLE_PROVIDER(stylesheet), GTK_STYLE_PROVIDER_PRIORITY_USER + 1);
+    g_object_unref(stylesheet);
 
     GdkRGBA* caret_color;
     if (config->show_input_cursor) {
@@ -588,185 +1294,39 @@ static void attach_config_colors_to_screen(Config* config)
         caret_color = config->password_background_color;
     }
 
-    char* css;
-    int css_string_length = asprintf(&css,
-        "* {\n"
-            "font-family: %s;\n"
-            "font-family: \"Ubuntu\", \"Sans\";\n"
-            "font-weight: 500;"
-            "font-size: %s;\n"
-            "color: #f1f1f1;\n"
-        "}\n"
-        "#time-info {\n"
-            "padding-left: 1rem;\n"
-            "font-size: 8em;\n"
-            "font-weight: 300;"
-        "\n}"
-        "#date-info {\n"
-            "padding-right: 0.7rem;\n"
-            "font-size: 2em;\n"
-            "font-weight: 200;"
-        "\n}"
-        "label {\n"
-            "color: %s;\n"
-        "}\n"
-        "label#error {\n"
-            "color: %s;\n"
-        "}\n"
-        "#background {\n"
-            "background-color: %s;\n"
-        "}\n"
-        "#background.with-image {\n"
-            "background-image: image(url(%s), %s);\n"
-            "background-repeat: no-repeat;\n"
-            "background-size: cover;\n"
-            "background-position: center;\n"
-        "}\n"
-        "#main, #password {\n"
-            "border-width: %s;\n"
-            "border-color: %s;\n"
-            "border-style: solid;\n"
-        "}\n"
-        "#main {\n"
-            // "background-color: %s;\n"
-        "}\n"
-        "#overlay {\n"
-            "padding: 5em 3em;\n"
-        "}\n"
-        "#password {\n"
-            "color: %s;\n"
-            "caret-color: %s;\n"
-            "background-color: %s;\n"
-            "border-width: %s;\n"
-            "border-width: 0.1rem;\n"
-            "border-color: %s;\n"
-            "border-radius: 0;\n"
-            "background-image: none;\n"
-            "box-shadow: none;\n"
-            "border-image-width: 0;\n"
-        "}\n"
-        "#password *:disabled {\n"
-            "border-color: #cccccc;\n"
-        "}\n"
-        "#login-button {\n"
-            "border-radius: 0px;\n"
-            "color: white;\n"
-            "background: #f1f1f1;\n"
-            "border-color: #f1f1f1;\n"
-            "border-width: 0.1rem;\n"
-        "}\n"
-        "#login-button:hover {\n"
-            "background: #c7d1d1;\n"
-        "}\n"
-        "#login-button *:disabled {\n"
-            "background: #cccccc;\n"
-        "}\n"
-        "#current-user-image {\n"
-            "border-radius: 100%%;\n"
-            "padding: 1em;\n"
-            "border: 0.1em solid #f1f1f1;\n"
-            "background-color: #1b1d1e;\n"
-        "}\n"
-        "#current-user {\n"
-            "font-family: \"Ubuntu\", %s;\n"
-            "font-size: 1.5em;\n"
-            "color: %s;\n"
-            "margin-bottom: 0.8em;\n"
-            "margin-top: 0.2em;\n"
-        "}\n"
-        "#power-button {\n"
-            "background: none;\n"
-            "border: none;\n"
-            "margin: 1em 1em 1.5em 0em;\n"
-        "}\n"
-        "#power-button:active {\n"
-            "border: none;\n"
-            "border-image: none;\n"
-        "}\n"
-        "#power-menu {\n"
-            "background: #1b1d1e;\n"
-            "border: 0.1em solid #f1f1f1;\n"
-            "padding: 0.4em 0.1em 0.5em 0.1em;\n"
-            "margin: 0em 1em 2em 0em;\n"
-        "}\n"
-        "#power-menu * {\n"
-            "font-family: \"Ubuntu\", \"Sans\";\n"
-            "font-size: 1.1em;\n"
-            "background: #1b1d1e;\n"
-            "padding: 0.4em 0em;\n"
-        "}\n"
-        "#power-menu *:hover, #power-menu *:hover * {\n"
-            "background: #2f3333;\n"
-        "}\n"
-
-        // *
-        , config->font
-        , config->font_size
-        // label
-        , gdk_rgba_to_string(config->text_color)
-        // label#error
-        , gdk_rgba_to_string(config->error_color)
-        // #background
-        , gdk_rgba_to_string(config->background_color)
-        // #background.image-background
-        , config->background_image
-        , gdk_rgba_to_string(config->background_color)
-        // #main, #password
-        , config->border_width
-        , gdk_rgba_to_string(config->border_color)
-        // #main
-        // , gdk_rgba_to_string(config->window_color)
-        // #overlay
-        //, gdk_rgba_to_string(config->background_color)
-        // , config->background_image
-        // #password
-        , gdk_rgba_to_string(config->password_color)
-        , gdk_rgba_to_string(caret_color)
-        , gdk_rgba_to_string(config->password_background_color)
-        , config->password_border_width
-        , gdk_rgba_to_string(config->password_border_color)
-        // #info label
-        , config->sys_info_font
-        , gdk_rgba_to_string(config->sys_info_color)
-    );
-
-    if (css_string_length >= 0) {
-        gtk_css_provider_load_from_data(provider, css, -1, NULL);
-
-        GdkScreen *screen = gdk_screen_get_default();
+    GString *css = g_string_new(NULL);
+    append_color_definition(css, "text_color", config->text_color);
+    append_color_definition(css, "error_color", config->error_color);
+    append_color_definition(css, "background_color", config->background_color);
+    append_color_definition(css, "border_color", config->border_color);
+    append_color_definition(css, "password_color", config->password_color);
+    append_color_definition(css, "caret_color", caret_color);
+    append_color_definition(css, "password_background_color",
+                            config->password_background_color);
+    append_color_definition(css, "password_border_color", config->password_border_color);
+    append_color_definition(css, "sys_info_color", config->sys_info_color);
+    g_string_append_printf(css, "window { font-size: %s; }\n", config->font_size);
+    g_string_append_printf(css, "#main { border-width: %s; }\n", config->border_width);
+    g_string_append_printf(css, "#current-user { font-family: \"Ubuntu\", %s; }\n",
+                           config->sys_info_font);
+
+    GtkCssProvider* values = gtk_css_provider_new();
+    GError *error = NULL;
+    if (gtk_css_provider_load_from_data(values, css->str, (gssize) css->len, &error)) {
         gtk_style_context_add_provider_for_screen(
-            screen, GTK_STYLE_PROVIDER(provider),
-            GTK_STYLE_PROVIDER_PRIORITY_USER + 1);
+            screen, GTK_STYLE_PROVIDER(values), GTK_STYLE_PROVIDER_PRIORITY_USER + 2);
+    } else {
+        g_warning("Could not use the greeter-theme options: %s", error->message);
+        g_error_free(error);
     }
-
-
-    g_object_unref(provider);
+    g_object_unref(values);
+    g_string_free(css, TRUE);
 }
 
-static GdkPixbuf* icon_shutdown(int size)
+/* Define a named color for the stylesheet */
+static void append_color_definition(GString *css, const gchar *name, const GdkRGBA *color)
 {
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-
-    const double line_width = size / 10;
-    const double center = size / 2;
-    const double radius = (size / 2) - (line_width / 2);
-
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, line_width);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-
-    cairo_arc(cr, center, center, radius, -G_PI_4, G_PI + G_PI_4);
-    cairo_stroke(cr);
-
-    cairo_move_to(cr, center, line_width);
-    cairo_line_to(cr, center, center);
-    cairo_stroke(cr);
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
-
-    return dest;
-}
\ No newline at end of file
+    gchar *color_string = gdk_rgba_to_string(color);
+    g_string_append_printf(css, "@define-color %s %s;\n", name, color_string);
+    g_free(color_string);
+}
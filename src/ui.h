@@ -4,20 +4,37 @@
 #include <gtk/gtk.h>
 #include "ui_login.h"
 #include "config.h"
+#include "scheduler.h"
+#include "animation.h"
+#include "background.h"
+#include "user_picker.h"
+#include "wall_clock.h"
+#include "wallpaper.h"
 
 #define OVERLAY_DEBUG 0
 
 struct BackgroundPixbuf {
-    GdkPixbuf* buf;
+    // Owned by the BackgroundCache
+    cairo_surface_t* buf;
     GdkRGBA* default_color;
-    gdouble x;
-    gdouble y;
+    // How much `buf` is scaled when drawn, below 1 for images rendered at a
+    // HiDPI screen's device pixels
+    gdouble scale;
+    // The image being faded out, & how far `buf` has faded in over it
+    cairo_surface_t* previous;
+    gdouble previous_scale;
+    gdouble fade;
 };
 
 
 typedef struct UI_ {
-    GtkWindow**  background_windows;
-    int          monitor_count;
+    Config*      config;
+
+    // GdkMonitor* -> the GtkWindow* covering it
+    GHashTable*  background_windows;
+    // Connected to every background window's "key-press-event"
+    GCallback    background_key_handler;
+    gpointer     background_key_data;
     GtkWindow*   main_window;
     GtkStack*    layout_stack;
 
@@ -35,16 +52,48 @@ typedef struct UI_ {
     GtkMenuItem* power_shutdown;
     GtkMenuItem* power_restart;
     GtkMenuItem* power_suspend;
+    // NULL unless `user-picker` is enabled
+    UserPicker*  user_picker;
 
     LoginUI*     login_ui;
 
     struct BackgroundPixbuf* overlay_bg;
     struct BackgroundPixbuf* login_bg;
+    // The image being shown, or NULL if `background-image` is not set
+    gchar*       background_path;
+    // The image being faded out, or NULL
+    gchar*       previous_background_path;
+    gdouble      background_fade;
+    guint        background_fade_id;
+    gint64       background_fade_start;
+    // Whether the next image has been prepared, & whether to show it as
+    // soon as it is
+    gboolean     next_background_ready;
+    gboolean     rotate_background_pending;
+    // Rotates intervals under a minute, which the WallClock doesn't
+    guint        background_rotate_id;
+    Wallpapers*  wallpapers;
+    // Wallpapers, rendered for every monitor geometry seen so far
+    BackgroundCache* background_cache;
+    // Played on the cover page over the wallpaper, or NULL if
+    // `background-animation` is not set
+    Animation*   animation;
+
+    Scheduler*   scheduler;
+    WallClock*   wall_clock;
+    // Whether nobody is at the screen, see ui_set_idle
+    gboolean     is_idle;
 } UI;
 
 
-UI *initialize_ui(Config *config);
+UI *initialize_ui(Config *config, Scheduler *scheduler, WallClock *wall_clock);
+void destroy_ui(UI *ui);
 void ui_cover(UI* ui);
 void ui_uncover(UI* ui);
+void ui_show_background_windows(UI* ui);
+void ui_connect_background_key_handler(UI* ui, GCallback handler, gpointer data);
+void ui_publish_root_background(UI* ui, gboolean use_login_background);
+void ui_attach_user_picker(UI* ui, UserPickerFunc func, gpointer data);
+void ui_set_idle(UI* ui, gboolean is_idle);
 
 #endif
@@ -1,23 +1,28 @@
 #define _GNU_SOURCE
 #include "ui_login.h"
+#include "avatar.h"
+#include "display_name.h"
+#include "icons.h"
 #include "utils.h"
+#include "memory_usage.h"
 #include <lightdm.h>
 #include <stdio.h>
 #include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <sys/mman.h>
 
 
 static LoginUI* new_login_ui(void);
 static void create_login_container(LoginUI* ui);
 static void load_and_attach_user_image(LoginUI* ui, Config* config);
+static void show_user_image(LoginUI* ui, const gchar* username);
+static void handle_user_image_scale(GObject* user_image, GParamSpec* pspec, gpointer data);
+static void handle_user_image_loaded(const gchar* username, GdkPixbuf* avatar, gpointer data);
+static void set_user_image(LoginUI* ui, GdkPixbuf* image);
 static void create_and_attach_username_label(Config* config, LoginUI* ui);
 static void create_and_attach_password_field(Config* config, LoginUI* ui);
 static void create_and_attach_feedback_label(LoginUI* ui);
-static char* user_get_pretty_name(const char* username);
+static void show_user_name(LoginUI* ui, const gchar* username);
+static void handle_user_name_found(const gchar* username, const gchar* display_name,
+                                   gpointer data);
 
 LoginUI* initialize_login_ui(Config *config)
 {
@@ -33,6 +38,13 @@ LoginUI* initialize_login_ui(Config *config)
     return ui;
 }
 
+/* Show another user's name & image */
+void login_ui_set_user(LoginUI* ui, const gchar* username)
+{
+    show_user_name(ui, username);
+    show_user_image(ui, username);
+}
+
 /* Create the container for the login to live in */
 static void create_login_container(LoginUI* ui)
 {
@@ -46,9 +58,8 @@ static void create_login_container(LoginUI* ui)
  */
 static void create_and_attach_username_label(Config* config, LoginUI* ui)
 {
-    char* username = user_get_pretty_name(config->login_user);
-    ui->username_label = gtk_label_new(username);
-    free(username);
+    ui->username_label = gtk_label_new(NULL);
+    show_user_name(ui, config->login_user);
 
     gtk_label_set_xalign(GTK_LABEL(ui->username_label), 0.5f);
     gtk_widget_set_name(GTK_WIDGET(ui->username_label), "current-user");
@@ -57,6 +68,29 @@ static void create_and_attach_username_label(Config* config, LoginUI* ui)
                     GTK_WIDGET(ui->username_label));
 }
 
+/* Show the name found for a user on an earlier start, or their login name,
+ * while their current name is looked up on a worker thread.
+ */
+static void show_user_name(LoginUI* ui, const gchar* username)
+{
+    if (ui->user_name_lookup != NULL) {
+        g_cancellable_cancel(ui->user_name_lookup);
+        g_object_unref(ui->user_name_lookup);
+    }
+    gchar* display_name = display_name_get_cached(username);
+    gtk_label_set_text(GTK_LABEL(ui->username_label), display_name);
+    ui->user_name_lookup = display_name_lookup_async(username, display_name,
+                                                     &handle_user_name_found, ui);
+    g_free(display_name);
+}
+
+static void handle_user_name_found(const gchar* username, const gchar* display_name,
+                                   gpointer data)
+{
+    LoginUI* ui = (LoginUI*) data;
+    gtk_label_set_text(GTK_LABEL(ui->username_label), display_name);
+}
+
 
 /* Add a label & entry field for the user's password.
  *
@@ -88,19 +122,7 @@ static void create_and_attach_password_field(Config* config, LoginUI* ui)
 
     gtk_widget_set_name(GTK_WIDGET(ui->login_button), "login-button");
     gtk_button_set_relief(GTK_BUTTON(ui->login_button), GTK_RELIEF_NONE);
-    GdkPixbuf* icon = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
-                            "go-next",
-                            15,
-                            GTK_ICON_LOOKUP_FORCE_SYMBOLIC,
-                            NULL);
-    if (!icon) {
-        g_warning("[GREETER] icon not found!\n");
-    }
-
-    GtkImage* icon_image = GTK_IMAGE(gtk_image_new_from_pixbuf(icon));
-    g_object_unref(icon);
-
-    gtk_button_set_image(GTK_BUTTON(ui->login_button), GTK_WIDGET(icon_image));
+    gtk_button_set_image(GTK_BUTTON(ui->login_button), icon_arrow_new());
     
     gtk_container_add(GTK_CONTAINER(ui->password_line),
                     GTK_WIDGET(ui->login_button));
@@ -124,91 +146,77 @@ static void create_and_attach_feedback_label(LoginUI *ui)
                     GTK_WIDGET(ui->feedback_label));
 }
 
-static GdkPixbuf* round_user_image(GdkPixbuf* source, int size)
+static void load_and_attach_user_image(LoginUI* ui, Config* config)
 {
-    const double tau = 2 * G_PI;
-    
-    const int center = size / 2;
-    const int source_width = gdk_pixbuf_get_width(source);
-    const int source_height = gdk_pixbuf_get_height(source);
-
-    GdkPixbuf* dest = NULL;
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t* cr = cairo_create(surface);
-    
-    // draw the background color
-    cairo_set_source_rgb(cr, 0.106, 0.113, 0.117);
-    cairo_arc(cr, center, center, center, 0, tau);
-    cairo_fill(cr);
-
-    // draw the image
-    gdk_cairo_set_source_pixbuf(cr, source, center - (source_width / 2), center - (source_height / 2));
-
-    cairo_arc(cr, center, center, center, 0, tau);
-    cairo_fill(cr);
-
-    // draw the outline
-    cairo_arc(cr, center, center, center - 0.6, 0, tau);
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_set_line_width(cr, 1.6);
-
-    cairo_stroke(cr);
-
-    dest = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
-    cairo_surface_destroy(surface);
-    cairo_destroy(cr);
+    ui->user_image = GTK_IMAGE(gtk_image_new());
+    gtk_widget_set_halign(GTK_WIDGET(ui->user_image), GTK_ALIGN_CENTER);
+    show_user_image(ui, config->login_user);
+    g_signal_connect(ui->user_image, "notify::scale-factor",
+                     G_CALLBACK(handle_user_image_scale), ui);
 
-    return dest;
+    gtk_container_add(GTK_CONTAINER(ui->login_container),
+                    GTK_WIDGET(ui->user_image));
 }
 
-static void load_and_attach_user_image(LoginUI* ui, Config* config)
+/* Show the image cached for a user on an earlier start, or the default image,
+ * & load their current image on a worker thread. Both are at the widget's
+ * device scale.
+ */
+static void show_user_image(LoginUI* ui, const gchar* username)
 {
-    // User face
-    GdkPixbuf* image;
-    GError* error = NULL;
-
-    gchar user_face[100] = {0};
-    int printed = 0;
-    printed = snprintf(user_face, 100, "/home/%s/.face", config->login_user);
-    if (printed) {
-        image = load_image_to_cover(user_face, 130, 130, &error);
+    if (ui->user_image_load != NULL) {
+        g_cancellable_cancel(ui->user_image_load);
+        g_object_unref(ui->user_image_load);
     }
-
-    if (error != NULL) {
-        g_warning("[GREETER] error loading image %s\n", error->message);
+    // `username` may be the name being replaced
+    gchar* shown_name = g_strdup(username);
+    g_free(ui->user_image_name);
+    ui->user_image_name = shown_name;
+
+    const gint scale = gtk_widget_get_scale_factor(GTK_WIDGET(ui->user_image));
+    GdkPixbuf* placeholder = avatar_load_cached(shown_name, scale);
+    set_user_image(ui, placeholder);
+    if (placeholder != NULL) {
+        g_object_unref(placeholder);
     }
+    ui->user_image_load = avatar_load_async(shown_name, scale, &handle_user_image_loaded, ui);
+}
 
-    if (!printed || error != NULL) {
-        error = NULL;
-        printed = snprintf(user_face, 100, "/usr/share/lightdm/users/%s", config->login_user);
-        if (printed) {
-            image = load_image_to_cover(user_face, 130, 130, &error);
-        }
-    }
-    if (error != NULL) {
-        g_warning("[GREETER] error loading image %s\n", error->message);
-    }
-    // Default image
-    if (!printed || error != NULL) {
-        error = NULL;
-        image = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
-                                        "avatar-default",
-                                        100,
-                                        GTK_ICON_LOOKUP_FORCE_SIZE,
-                                        &error);
-    }
-    if (error != NULL) {
-        g_warning("[GREETER] icon 'avatar-default' not found: %s\n", error->message);
-        image = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE,  8, 130, 130);
-    }
+/* Reload the shown image for a screen with another scale */
+static void handle_user_image_scale(GObject* user_image, GParamSpec* pspec, gpointer data)
+{
+    LoginUI* ui = (LoginUI*) data;
+    show_user_image(ui, ui->user_image_name);
+}
 
-    GdkPixbuf* framed_image = round_user_image(image, 130);
-    ui->user_image = GTK_IMAGE(gtk_image_new_from_pixbuf(framed_image));
-    gtk_widget_set_halign(GTK_WIDGET(ui->user_image), GTK_ALIGN_CENTER);
-    g_object_unref(G_OBJECT(image));
+static void handle_user_image_loaded(const gchar* username, GdkPixbuf* avatar, gpointer data)
+{
+    set_user_image((LoginUI*) data, avatar);
+}
 
-    gtk_container_add(GTK_CONTAINER(ui->login_container),
-                    GTK_WIDGET(ui->user_image));
+/* Replace the shown image, or show the default image if `image` is NULL.
+ * Images are rendered at the widget's device scale, so they are shown as a
+ * surface with that scale rather than a pixbuf GTK would scale up.
+ */
+static void set_user_image(LoginUI* ui, GdkPixbuf* image)
+{
+    const gint scale = gtk_widget_get_scale_factor(GTK_WIDGET(ui->user_image));
+    GdkPixbuf* framed_image = image == NULL ? avatar_render_default(scale)
+                                            : g_object_ref(image);
+    cairo_surface_t* surface = gdk_cairo_surface_create_from_pixbuf(framed_image, scale, NULL);
+    gtk_image_set_from_surface(ui->user_image, surface);
+    g_object_unref(G_OBJECT(framed_image));
+
+    if (ui->user_image_surface != NULL) {
+        memory_usage_remove_bytes(MEMORY_OWNER_USER_IMAGE,
+                                  (gsize) cairo_image_surface_get_stride(ui->user_image_surface) *
+                                  (gsize) cairo_image_surface_get_height(ui->user_image_surface));
+        cairo_surface_destroy(ui->user_image_surface);
+    }
+    ui->user_image_surface = surface;
+    memory_usage_add_bytes(MEMORY_OWNER_USER_IMAGE,
+                           (gsize) cairo_image_surface_get_stride(surface) *
+                           (gsize) cairo_image_surface_get_height(surface));
 }
 
 /* Create a new UI with all values initialized to NULL */
@@ -220,54 +228,10 @@ static LoginUI* new_login_ui(void)
     }
     ui->password_input = NULL;
     ui->feedback_label = NULL;
+    ui->user_image_name = NULL;
+    ui->user_image_surface = NULL;
+    ui->user_image_load = NULL;
+    ui->user_name_lookup = NULL;
 
     return ui;
 }
-
-static char* user_get_pretty_name(const char* username)
-{
-
-    int file_descriptor = open("/etc/passwd", O_RDONLY);
-    if (file_descriptor < 0)
-        return strdup(username);
-
-    struct stat passwd_stat;
-    int stat_error = fstat(file_descriptor, &passwd_stat);
-    if (stat_error < 0) {
-        return strdup(username);
-    }
-    char* contents = mmap(NULL, (size_t) passwd_stat.st_size,
-        PROT_READ, MAP_PRIVATE,
-        file_descriptor, 0);
-    
-    char* read_head = contents;
-    size_t username_length = strlen(username);
-
-    char* current_user = strndup(read_head, username_length);
-    char* pretty_name = strdup(username);
-
-    while ((read_head - contents) < passwd_stat.st_size - 1) {
-        if (strcmp(username, current_user) == 0) {
-            // find name
-            for (int col = 0; col < 4; col++) {
-                read_head += strcspn(read_head, ":") + 1;
-            }
-            size_t name_length = strcspn(read_head, ",:");
-            if (name_length > 0)
-                pretty_name = strndup(read_head, name_length);
-            break;
-        }
-        size_t line_length = strcspn(read_head, "\n") + 1;
-        if ((read_head + line_length) >= (contents + passwd_stat.st_size-1)) {
-            break;
-        }
-        read_head += line_length;
-        strncpy(current_user, read_head, username_length);
-    }
-
-    munmap(contents, (size_t) passwd_stat.st_size);
-    free(current_user);
-
-    return pretty_name;
-    
-}
\ No newline at end of file
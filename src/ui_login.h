@@ -7,8 +7,16 @@
 typedef struct LoginUI {
     GtkBox*      login_container;
     GtkImage*    user_image;
+    // The user whose image is shown, to reload it when the scale changes
+    gchar*       user_image_name;
+    // The shown image at the widget's device scale
+    cairo_surface_t* user_image_surface;
+    // Loads the shown user's image, NULL before the first one is started
+    GCancellable* user_image_load;
 
     GtkWidget*   username_label;
+    // Looks up the shown user's display name
+    GCancellable* user_name_lookup;
 
     GtkBox*      password_line;
     GtkWidget*   password_input;
@@ -19,5 +27,6 @@ typedef struct LoginUI {
 
 
 LoginUI *initialize_login_ui(Config *config);
+void login_ui_set_user(LoginUI *ui, const gchar *username);
 
 #endif // LOGIN_UI_H
\ No newline at end of file
@@ -0,0 +1,371 @@
+/* List LightDM's Users & Find Them by Prefix */
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <lightdm.h>
+
+#include "user_picker.h"
+
+enum {
+    USER_PICKER_COLUMN_NAME,
+    USER_PICKER_COLUMN_DISPLAY_NAME,
+    USER_PICKER_COLUMN_SORT_KEY,
+    USER_PICKER_COLUMN_COUNT,
+};
+
+// The height of the list, in pixels
+#define USER_PICKER_LIST_HEIGHT 240
+#define USER_PICKER_LIST_WIDTH 220
+
+
+/* A casefolded string a user can be found by, e.g. their login name */
+struct UserPickerKey {
+    gchar *key;
+    gchar *name;
+    gchar *sort_key;
+};
+
+
+static gpointer ref_user(gconstpointer user, gpointer data);
+static gboolean load_user_batch(gpointer user_data);
+static void add_user(UserPicker *picker, LightDMUser *user);
+static void add_index_key(UserPicker *picker, const gchar *text, const gchar *name,
+                          const gchar *sort_key);
+static void remove_index_keys(UserPicker *picker, const gchar *name);
+static gchar *get_sort_key(LightDMUser *user);
+static gboolean find_user_row(UserPicker *picker, const gchar *sort_key, const gchar *name,
+                              gint *position);
+static gint compare_users(const gchar *sort_key_a, const gchar *name_a,
+                          const gchar *sort_key_b, const gchar *name_b);
+static const struct UserPickerKey *find_prefix(UserPicker *picker, const gchar *prefix);
+static gint compare_index_keys(gconstpointer a, gconstpointer b);
+static void clear_index_key(gpointer data);
+static void handle_user_added(LightDMUserList *user_list, LightDMUser *user, gpointer user_data);
+static void handle_user_removed(LightDMUserList *user_list, LightDMUser *user, gpointer user_data);
+static void handle_search_changed(GtkEditable *editable, gpointer user_data);
+static void handle_search_activate(GtkEntry *entry, gpointer user_data);
+static void handle_row_activated(GtkTreeView *view, GtkTreePath *path,
+                                 GtkTreeViewColumn *column, gpointer user_data);
+
+
+/* Build an empty picker. `func` is called with the login name of the user
+ * that is clicked, or picked by pressing Enter.
+ */
+UserPicker *initialize_user_picker(UserPickerFunc func, gpointer data)
+{
+    UserPicker *picker = malloc(sizeof(UserPicker));
+    if (picker == NULL) {
+        g_error("Could not allocate memory for UserPicker");
+    }
+    picker->func = func;
+    picker->data = data;
+    picker->index = g_array_new(FALSE, FALSE, sizeof(struct UserPickerKey));
+    g_array_set_clear_func(picker->index, &clear_index_key);
+    picker->index_sorted = TRUE;
+    picker->pending = NULL;
+    picker->load_id = 0;
+
+    picker->store = gtk_list_store_new(USER_PICKER_COLUMN_COUNT,
+                                       G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    picker->view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(GTK_TREE_MODEL(picker->store)));
+    gtk_tree_view_set_headers_visible(picker->view, FALSE);
+    // The prefix index replaces the tree view's own search, which walks every row
+    gtk_tree_view_set_enable_search(picker->view, FALSE);
+    gtk_tree_view_set_activate_on_single_click(picker->view, TRUE);
+
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+    GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(
+        "User", renderer, "text", USER_PICKER_COLUMN_DISPLAY_NAME, NULL);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(column, USER_PICKER_LIST_WIDTH);
+    gtk_tree_view_append_column(picker->view, column);
+    gtk_tree_view_set_fixed_height_mode(picker->view, TRUE);
+    g_signal_connect(picker->view, "row-activated", G_CALLBACK(handle_row_activated), picker);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                   GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrolled_window),
+                                               USER_PICKER_LIST_HEIGHT);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), GTK_WIDGET(picker->view));
+
+    // Not a GtkSearchEntry, whose find & clear icons would load the icon theme
+    picker->search_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(picker->search_entry), "Other user");
+    g_signal_connect(picker->search_entry, "changed",
+                     G_CALLBACK(handle_search_changed), picker);
+    g_signal_connect(picker->search_entry, "activate",
+                     G_CALLBACK(handle_search_activate), picker);
+
+    picker->container = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_name(picker->container, "user-picker");
+    gtk_widget_set_valign(picker->container, GTK_ALIGN_END);
+    gtk_box_pack_start(GTK_BOX(picker->container), picker->search_entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(picker->container), scrolled_window, FALSE, FALSE, 0);
+
+    return picker;
+}
+
+void destroy_user_picker(UserPicker *picker)
+{
+    if (picker->load_id != 0) {
+        g_source_remove(picker->load_id);
+    }
+    g_signal_handlers_disconnect_by_data(lightdm_user_list_get_instance(), picker);
+    g_list_free_full(picker->pending, &g_object_unref);
+    g_array_unref(picker->index);
+    g_object_unref(picker->store);
+    free(picker);
+}
+
+/* Start adding LightDM's users to the list, a batch at a time, & follow
+ * users being added or removed.
+ */
+void user_picker_load(UserPicker *picker)
+{
+    LightDMUserList *user_list = lightdm_user_list_get_instance();
+    picker->pending = g_list_copy_deep(lightdm_user_list_get_users(user_list), &ref_user, NULL);
+    g_signal_connect(user_list, "user-added", G_CALLBACK(handle_user_added), picker);
+    g_signal_connect(user_list, "user-removed", G_CALLBACK(handle_user_removed), picker);
+    picker->load_id = g_idle_add_full(G_PRIORITY_LOW, &load_user_batch, picker, NULL);
+}
+
+
+static gpointer ref_user(gconstpointer user, gpointer data)
+{
+    return g_object_ref((gpointer) user);
+}
+
+static gboolean load_user_batch(gpointer user_data)
+{
+    UserPicker *picker = (UserPicker *) user_data;
+    for (int u = 0; u < USER_PICKER_BATCH_SIZE && picker->pending != NULL; u++) {
+        LightDMUser *user = LIGHTDM_USER(picker->pending->data);
+        picker->pending = g_list_delete_link(picker->pending, picker->pending);
+        add_user(picker, user);
+        g_object_unref(user);
+    }
+    if (picker->pending != NULL) {
+        return G_SOURCE_CONTINUE;
+    }
+    g_message("Loaded %d users into the user picker",
+              gtk_tree_model_iter_n_children(GTK_TREE_MODEL(picker->store), NULL));
+    picker->load_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+/* Insert a user at its sorted position & index its names */
+static void add_user(UserPicker *picker, LightDMUser *user)
+{
+    const gchar *name = lightdm_user_get_name(user);
+    const gchar *display_name = lightdm_user_get_display_name(user);
+    gchar *sort_key = get_sort_key(user);
+    gint position;
+    if (find_user_row(picker, sort_key, name, &position)) {
+        // Added by "user-added" before its batch got to it
+        g_free(sort_key);
+        return;
+    }
+    gtk_list_store_insert_with_values(picker->store, NULL, position,
+                                      USER_PICKER_COLUMN_NAME, name,
+                                      USER_PICKER_COLUMN_DISPLAY_NAME, display_name,
+                                      USER_PICKER_COLUMN_SORT_KEY, sort_key,
+                                      -1);
+
+    add_index_key(picker, name, name, sort_key);
+    if (g_strcmp0(display_name, name) != 0) {
+        // Index every word of the name onwards, so "smi" finds "John Smith"
+        for (const gchar *word = display_name; word != NULL; word = strchr(word, ' ')) {
+            while (*word == ' ') {
+                word++;
+            }
+            if (*word != '\0') {
+                add_index_key(picker, word, name, sort_key);
+            }
+        }
+    }
+    g_free(sort_key);
+}
+
+/* Add a key to the index. It is sorted again before the next search. */
+static void add_index_key(UserPicker *picker, const gchar *text, const gchar *name,
+                          const gchar *sort_key)
+{
+    struct UserPickerKey key = {
+        g_utf8_casefold(text, -1), g_strdup(name), g_strdup(sort_key)
+    };
+    g_array_append_val(picker->index, key);
+    picker->index_sorted = FALSE;
+}
+
+static void remove_index_keys(UserPicker *picker, const gchar *name)
+{
+    for (guint k = picker->index->len; k > 0; k--) {
+        if (strcmp(g_array_index(picker->index, struct UserPickerKey, k - 1).name, name) == 0) {
+            // Keep the order, so a sorted index stays sorted
+            g_array_remove_index(picker->index, k - 1);
+        }
+    }
+}
+
+static gchar *get_sort_key(LightDMUser *user)
+{
+    return g_utf8_casefold(lightdm_user_get_display_name(user), -1);
+}
+
+/* Binary search the list for a user. Returns whether it is in the list, &
+ * sets `position` to its row, or the row it would be inserted at.
+ */
+static gboolean find_user_row(UserPicker *picker, const gchar *sort_key, const gchar *name,
+                              gint *position)
+{
+    GtkTreeModel *model = GTK_TREE_MODEL(picker->store);
+    gint low = 0;
+    gint high = gtk_tree_model_iter_n_children(model, NULL);
+    while (low < high) {
+        gint middle = low + (high - low) / 2;
+        GtkTreeIter iter;
+        gtk_tree_model_iter_nth_child(model, &iter, NULL, middle);
+        gchar *row_name, *row_sort_key;
+        gtk_tree_model_get(model, &iter, USER_PICKER_COLUMN_NAME, &row_name,
+                           USER_PICKER_COLUMN_SORT_KEY, &row_sort_key, -1);
+        gint order = compare_users(row_sort_key, row_name, sort_key, name);
+        g_free(row_name);
+        g_free(row_sort_key);
+        if (order == 0) {
+            *position = middle;
+            return TRUE;
+        } else if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *position = low;
+    return FALSE;
+}
+
+static gint compare_users(const gchar *sort_key_a, const gchar *name_a,
+                          const gchar *sort_key_b, const gchar *name_b)
+{
+    gint order = strcmp(sort_key_a, sort_key_b);
+    return order != 0 ? order : strcmp(name_a, name_b);
+}
+
+/* Find the first key starting with a prefix, by binary search */
+static const struct UserPickerKey *find_prefix(UserPicker *picker, const gchar *prefix)
+{
+    if (!picker->index_sorted) {
+        g_array_sort(picker->index, &compare_index_keys);
+        picker->index_sorted = TRUE;
+    }
+    gchar *folded_prefix = g_utf8_casefold(prefix, -1);
+    guint low = 0;
+    guint high = picker->index->len;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (strcmp(g_array_index(picker->index, struct UserPickerKey, middle).key,
+                   folded_prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const struct UserPickerKey *found = NULL;
+    if (low < picker->index->len &&
+            g_str_has_prefix(g_array_index(picker->index, struct UserPickerKey, low).key,
+                             folded_prefix)) {
+        found = &g_array_index(picker->index, struct UserPickerKey, low);
+    }
+    g_free(folded_prefix);
+    return found;
+}
+
+static gint compare_index_keys(gconstpointer a, gconstpointer b)
+{
+    const struct UserPickerKey *key_a = a;
+    const struct UserPickerKey *key_b = b;
+    gint order = strcmp(key_a->key, key_b->key);
+    return order != 0 ? order : compare_users(key_a->sort_key, key_a->name,
+                                               key_b->sort_key, key_b->name);
+}
+
+static void clear_index_key(gpointer data)
+{
+    struct UserPickerKey *key = data;
+    g_free(key->key);
+    g_free(key->name);
+    g_free(key->sort_key);
+}
+
+
+static void handle_user_added(LightDMUserList *user_list, LightDMUser *user, gpointer user_data)
+{
+    add_user((UserPicker *) user_data, user);
+}
+
+static void handle_user_removed(LightDMUserList *user_list, LightDMUser *user, gpointer user_data)
+{
+    UserPicker *picker = (UserPicker *) user_data;
+    const gchar *name = lightdm_user_get_name(user);
+    gchar *sort_key = get_sort_key(user);
+    gint position;
+    if (find_user_row(picker, sort_key, name, &position)) {
+        GtkTreeIter iter;
+        gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(picker->store), &iter, NULL, position);
+        gtk_list_store_remove(picker->store, &iter);
+        remove_index_keys(picker, name);
+    }
+    g_free(sort_key);
+}
+
+/* Select & scroll to the first user matching the search */
+static void handle_search_changed(GtkEditable *editable, gpointer user_data)
+{
+    UserPicker *picker = (UserPicker *) user_data;
+    const gchar *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(picker->view);
+    const struct UserPickerKey *key = text[0] == '\0' ? NULL : find_prefix(picker, text);
+    gint position;
+    if (key == NULL || !find_user_row(picker, key->sort_key, key->name, &position)) {
+        gtk_tree_selection_unselect_all(selection);
+        return;
+    }
+    GtkTreePath *path = gtk_tree_path_new_from_indices(position, -1);
+    gtk_tree_selection_select_path(selection, path);
+    gtk_tree_view_scroll_to_cell(picker->view, path, NULL, TRUE, 0.5f, 0.0f);
+    gtk_tree_path_free(path);
+}
+
+/* Pick the user the search selected */
+static void handle_search_activate(GtkEntry *entry, gpointer user_data)
+{
+    UserPicker *picker = (UserPicker *) user_data;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    if (!gtk_tree_selection_get_selected(gtk_tree_view_get_selection(picker->view),
+                                         &model, &iter)) {
+        return;
+    }
+    gchar *name;
+    gtk_tree_model_get(model, &iter, USER_PICKER_COLUMN_NAME, &name, -1);
+    gtk_entry_set_text(entry, "");
+    picker->func(name, picker->data);
+    g_free(name);
+}
+
+static void handle_row_activated(GtkTreeView *view, GtkTreePath *path,
+                                 GtkTreeViewColumn *column, gpointer user_data)
+{
+    UserPicker *picker = (UserPicker *) user_data;
+    GtkTreeIter iter;
+    if (!gtk_tree_model_get_iter(GTK_TREE_MODEL(picker->store), &iter, path)) {
+        return;
+    }
+    gchar *name;
+    gtk_tree_model_get(GTK_TREE_MODEL(picker->store), &iter, USER_PICKER_COLUMN_NAME, &name, -1);
+    picker->func(name, picker->data);
+    g_free(name);
+}
@@ -0,0 +1,43 @@
+#ifndef USER_PICKER_H
+#define USER_PICKER_H
+
+#include <gtk/gtk.h>
+
+// How many users are added to the list per idle callback
+#define USER_PICKER_BATCH_SIZE 200
+
+
+typedef void (*UserPickerFunc)(const gchar *username, gpointer data);
+
+/* A searchable list of every user LightDM knows about.
+ *
+ * The list is a GtkTreeView in fixed height mode, so only the visible rows
+ * are measured & drawn no matter how many users there are. Users are added in
+ * batches while the main loop is idle, & typing in the search entry jumps to
+ * the first user whose login, name, or last name starts with the text.
+ */
+typedef struct UserPicker_ {
+    GtkWidget      *container;
+    GtkWidget      *search_entry;
+    GtkTreeView    *view;
+    // Sorted by the casefolded display name, then the login name
+    GtkListStore   *store;
+
+    // struct UserPickerKey, sorted by key when `index_sorted` is TRUE
+    GArray         *index;
+    gboolean        index_sorted;
+
+    // Users that are not in the list yet, & the idle source adding them
+    GList          *pending;
+    guint           load_id;
+
+    UserPickerFunc  func;
+    gpointer        data;
+} UserPicker;
+
+
+UserPicker *initialize_user_picker(UserPickerFunc func, gpointer data);
+void destroy_user_picker(UserPicker *picker);
+void user_picker_load(UserPicker *picker);
+
+#endif
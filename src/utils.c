@@ -7,6 +7,8 @@
 #include "lightdm/session.h"
 #include "utils.h"
 #include "focus_ring.h"
+#include "prefetch.h"
+#include "startup_profile.h"
 
 static gchar *get_session_key(gconstpointer data);
 
@@ -22,16 +24,18 @@ gboolean connect_to_lightdm_daemon(LightDMGreeter *greeter)
 }
 
 
-/* Begin authentication as the default user, or exit with an error */
-void begin_authentication_as_default_user(App *app)
+/* Begin authentication as the selected user, or exit with an error.
+ *
+ * The selected user is the configured `user`, until another one is picked.
+ */
+void begin_authentication_as_current_user(App *app)
 {
-    const gchar *default_user = APP_LOGIN_USER(app);
-    if (g_strcmp0(default_user, NULL) == 0) {
+    const gchar *current_user = app->current_user;
+    if (g_strcmp0(current_user, NULL) == 0) {
         g_critical("A default user has not been not set");
     } else {
-        g_message("Beginning authentication as the default user: %s",
-                  default_user);
-        compat_greeter_authenticate(app->greeter, default_user, NULL);
+        g_message("Beginning authentication as the user: %s", current_user);
+        compat_greeter_authenticate(app->greeter, current_user, NULL);
     }
 }
 
@@ -48,6 +52,24 @@ void remove_char(char *str, char garbage) {
 }
 
 
+/* Build the path to a file in the greeter's cache directory, creating the
+ * directory if it does not exist yet.
+ *
+ * The cache lives in the greeter user's XDG cache directory, which is usually
+ * `/var/lib/lightdm/.cache/lightdm-win-greeter`.
+ */
+gchar *get_cache_path(const gchar *filename)
+{
+    gchar *cache_dir = g_build_filename(g_get_user_cache_dir(), "lightdm-win-greeter", NULL);
+    if (g_mkdir_with_parents(cache_dir, 0700) != 0) {
+        g_warning("Could not create cache directory: %s", cache_dir);
+    }
+    gchar *cache_path = g_build_filename(cache_dir, filename, NULL);
+    g_free(cache_dir);
+    return cache_path;
+}
+
+
 /* Get Sessions & Build the Focus Ring */
 void make_session_focus_ring(App *app)
 {
@@ -62,6 +84,29 @@ void make_session_focus_ring(App *app)
     g_message("Initial session set to: %s", focus_ring_get_value(session_ring));
 
     app->session_ring = session_ring;
+    update_session_prefetch(app);
+}
+
+
+/* Restart the session prefetch for the currently selected session.
+ *
+ * Any running prefetch is cancelled. A new one is only started if it is
+ * enabled & the login page is showing, since that is when the user is about
+ * to authenticate.
+ */
+void update_session_prefetch(App *app)
+{
+    if (app->session_prefetch != NULL) {
+        g_cancellable_cancel(app->session_prefetch);
+        g_object_unref(app->session_prefetch);
+        app->session_prefetch = NULL;
+    }
+    if (!app->config->prefetch_session || app->state != APP_LOGIN ||
+            app->session_ring == NULL) {
+        return;
+    }
+    app->session_prefetch = prefetch_session(
+        focus_ring_get_value(app->session_ring), app->config->prefetch_paths);
 }
 /* Retrieves the `key` field of a session, used to pull current session out of
  * a FocusRing.
@@ -101,6 +146,7 @@ GdkPixbuf* load_image_to_cover(gchar* filename, guint min_width, guint min_heigh
     guint container_size[2] = { min_width, min_height };
 
     fprintf(stderr, "[GREETER] loading %s\n", filename);
+    startup_profile_track_file(filename);
     GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
     // set the correct size during loading
     g_signal_connect(loader, "size-prepared",
@@ -110,17 +156,29 @@ GdkPixbuf* load_image_to_cover(gchar* filename, guint min_width, guint min_heigh
     gchar* file_buffer;
     gsize read_bytes;
     g_file_get_contents(filename, &file_buffer, &read_bytes, error);
-    if (error != NULL && *error != NULL)
+    if (error != NULL && *error != NULL) {
+        g_object_unref(loader);
         return NULL;
+    }
 
     gdk_pixbuf_loader_write(loader, (guchar*)file_buffer, read_bytes, error);
-    if (error != NULL && *error != NULL) return NULL;
-
     g_free(file_buffer);
     gdk_pixbuf_loader_close(loader, NULL);
-    if (error != NULL && *error != NULL) return NULL;
+    if (error != NULL && *error != NULL) {
+        g_object_unref(loader);
+        return NULL;
+    }
 
-    GdkPixbuf* intermediate_result = gdk_pixbuf_loader_get_pixbuf(loader);
+    GdkPixbuf* loaded = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (loaded == NULL) {
+        g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED,
+                    "Could not decode %s", filename);
+        g_object_unref(loader);
+        return NULL;
+    }
+    // Keep the image, not the loader, so callers own what is returned
+    GdkPixbuf* intermediate_result = g_object_ref(loaded);
+    g_object_unref(loader);
 
     guint width = (guint) gdk_pixbuf_get_width(intermediate_result);
     guint height = (guint) gdk_pixbuf_get_height(intermediate_result);
@@ -9,8 +9,10 @@
 
 gboolean connect_to_lightdm_daemon(LightDMGreeter *greeter);
 void make_session_focus_ring(App *app);
-void begin_authentication_as_default_user(App *app);
+void begin_authentication_as_current_user(App *app);
+void update_session_prefetch(App *app);
 void remove_char(char *str, char garbage);
+gchar *get_cache_path(const gchar *filename);
 GdkPixbuf* load_image_to_cover(gchar* filename, guint min_width, guint min_height, GError** error);
 
 #endif
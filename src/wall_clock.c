@@ -0,0 +1,320 @@
+/* Run Periodic Work Together, On the Minute, From a Single Wakeup */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "wall_clock.h"
+
+#define SECONDS_PER_MINUTE 60
+// Counted by the kernel each time the main thread sleeps & is woken again
+#define WAKEUPS_FIELD "voluntary_ctxt_switches:"
+
+
+struct WallClockEntry {
+    guint          id;
+    const gchar   *name;
+    guint          minutes;
+    WallClockFunc  func;
+    gpointer       data;
+    // Counted since the last report
+    guint          runs;
+};
+
+static gboolean arm_timer(WallClock *wall_clock);
+static gboolean handle_timer(gint fd, GIOCondition condition, gpointer user_data);
+static void schedule_fallback_tick(WallClock *wall_clock);
+static gboolean handle_fallback_tick(gpointer user_data);
+static void run_entries(WallClock *wall_clock, gboolean clock_was_set);
+static void prune_entries(WallClock *wall_clock);
+static void report_wakeups(WallClock *wall_clock);
+static guint64 get_wakeups(void);
+
+
+/* Start ticking on the next minute */
+WallClock *initialize_wall_clock(void)
+{
+    WallClock *wall_clock = malloc(sizeof(WallClock));
+    if (wall_clock == NULL) {
+        g_error("Could not allocate memory for WallClock");
+    }
+    wall_clock->entries = NULL;
+    wall_clock->next_id = 1;
+    wall_clock->running = FALSE;
+    wall_clock->watch_id = 0;
+    wall_clock->fallback_id = 0;
+    wall_clock->paused = FALSE;
+    wall_clock->ticks = 0;
+    wall_clock->report_switches = get_wakeups();
+    wall_clock->report_start = g_get_monotonic_time();
+
+    wall_clock->timer = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wall_clock->timer >= 0 && arm_timer(wall_clock)) {
+        wall_clock->watch_id = g_unix_fd_add(wall_clock->timer, G_IO_IN,
+                                             &handle_timer, wall_clock);
+    } else {
+        g_warning("Could not create a timer for the clock: %s", g_strerror(errno));
+        if (wall_clock->timer >= 0) {
+            close(wall_clock->timer);
+            wall_clock->timer = -1;
+        }
+        schedule_fallback_tick(wall_clock);
+    }
+
+    return wall_clock;
+}
+
+/* Stop ticking & drop all registered work */
+void destroy_wall_clock(WallClock *wall_clock)
+{
+    if (wall_clock->watch_id != 0) {
+        g_source_remove(wall_clock->watch_id);
+    }
+    if (wall_clock->fallback_id != 0) {
+        g_source_remove(wall_clock->fallback_id);
+    }
+    if (wall_clock->timer >= 0) {
+        close(wall_clock->timer);
+    }
+    g_list_free_full(wall_clock->entries, free);
+    free(wall_clock);
+}
+
+
+/* Stop ticking until `wall_clock_resume`. Nothing runs in the meantime, not
+ * even when the clock is set.
+ */
+void wall_clock_pause(WallClock *wall_clock)
+{
+    if (wall_clock->paused) {
+        return;
+    }
+    wall_clock->paused = TRUE;
+    if (wall_clock->watch_id != 0) {
+        const struct itimerspec disarmed = { { 0, 0 }, { 0, 0 } };
+        timerfd_settime(wall_clock->timer, 0, &disarmed, NULL);
+    }
+    if (wall_clock->fallback_id != 0) {
+        g_source_remove(wall_clock->fallback_id);
+        wall_clock->fallback_id = 0;
+    }
+}
+
+/* Tick again from the next minute, & run the work done every minute right
+ * away, so e.g. the shown time catches up before the next frame.
+ */
+void wall_clock_resume(WallClock *wall_clock)
+{
+    if (!wall_clock->paused) {
+        return;
+    }
+    wall_clock->paused = FALSE;
+    if (wall_clock->watch_id != 0 && arm_timer(wall_clock)) {
+        run_entries(wall_clock, TRUE);
+        return;
+    }
+    if (wall_clock->watch_id != 0) {
+        g_warning("Could not re-arm the clock's timer: %s", g_strerror(errno));
+        g_source_remove(wall_clock->watch_id);
+        wall_clock->watch_id = 0;
+    }
+    schedule_fallback_tick(wall_clock);
+    run_entries(wall_clock, TRUE);
+}
+
+
+/* Run a function every `minutes` minutes, at the start of a minute whose
+ * number since the epoch divides by `minutes`, so work with related intervals
+ * shares wakeups. Work run every minute also runs when the clock is set.
+ * The `name` must outlive the entry; it labels the work in the hourly report.
+ *
+ * Returns an ID for `wall_clock_remove`.
+ */
+guint wall_clock_add(WallClock *wall_clock, const gchar *name, guint minutes,
+                     WallClockFunc func, gpointer data)
+{
+    struct WallClockEntry *entry = malloc(sizeof(struct WallClockEntry));
+    if (entry == NULL) {
+        g_error("Could not allocate memory for WallClockEntry");
+    }
+    entry->id = wall_clock->next_id++;
+    entry->name = name;
+    entry->minutes = MAX(minutes, 1);
+    entry->func = func;
+    entry->data = data;
+    entry->runs = 0;
+    wall_clock->entries = g_list_append(wall_clock->entries, entry);
+    return entry->id;
+}
+
+/* Stop running the work added with this ID. Safe to call from the work. */
+void wall_clock_remove(WallClock *wall_clock, guint id)
+{
+    for (GList *node = wall_clock->entries; node != NULL; node = node->next) {
+        struct WallClockEntry *entry = (struct WallClockEntry *) node->data;
+        if (entry->id == id) {
+            entry->func = NULL;
+            break;
+        }
+    }
+    if (!wall_clock->running) {
+        prune_entries(wall_clock);
+    }
+}
+
+
+/* Fire at every following minute boundary, & right away when the clock is
+ * set, which moves the boundaries.
+ */
+static gboolean arm_timer(WallClock *wall_clock)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const time_t next_minute = now.tv_sec - now.tv_sec % SECONDS_PER_MINUTE + SECONDS_PER_MINUTE;
+    struct itimerspec ticks = {
+        .it_interval = { .tv_sec = SECONDS_PER_MINUTE, .tv_nsec = 0 },
+        .it_value = { .tv_sec = next_minute, .tv_nsec = 0 },
+    };
+    return timerfd_settime(wall_clock->timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                           &ticks, NULL) == 0;
+}
+
+static gboolean handle_timer(gint fd, GIOCondition condition, gpointer user_data)
+{
+    WallClock *wall_clock = (WallClock *) user_data;
+    // Minutes missed while suspended are run once, not caught up on
+    guint64 expirations;
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        run_entries(wall_clock, FALSE);
+    } else if (errno == ECANCELED) {
+        if (!arm_timer(wall_clock)) {
+            g_warning("Could not re-arm the clock's timer: %s", g_strerror(errno));
+        }
+        run_entries(wall_clock, TRUE);
+    } else if (errno != EAGAIN && errno != EINTR) {
+        g_warning("Could not read the clock's timer: %s", g_strerror(errno));
+        wall_clock->watch_id = 0;
+        schedule_fallback_tick(wall_clock);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* Without a timerfd, sleep until the next minute as GLib sees it. Setting
+ * the clock is only noticed on the next tick.
+ */
+static void schedule_fallback_tick(WallClock *wall_clock)
+{
+    const gint64 now_ms = g_get_real_time() / 1000;
+    const guint delay = (guint) (SECONDS_PER_MINUTE * 1000 - now_ms % (SECONDS_PER_MINUTE * 1000));
+    wall_clock->fallback_id = g_timeout_add(delay, &handle_fallback_tick, wall_clock);
+}
+
+static gboolean handle_fallback_tick(gpointer user_data)
+{
+    WallClock *wall_clock = (WallClock *) user_data;
+    wall_clock->fallback_id = 0;
+    run_entries(wall_clock, FALSE);
+    schedule_fallback_tick(wall_clock);
+    return G_SOURCE_REMOVE;
+}
+
+/* Run the work that is due this minute. Work added by other work waits for
+ * the next tick.
+ */
+static void run_entries(WallClock *wall_clock, gboolean clock_was_set)
+{
+    wall_clock->ticks++;
+    // Rounded, since a GLib timeout may fire a little early
+    const gint64 minute = (g_get_real_time() / G_USEC_PER_SEC + SECONDS_PER_MINUTE / 2) /
+                          SECONDS_PER_MINUTE;
+    const guint last_id = wall_clock->next_id;
+    wall_clock->running = TRUE;
+    for (GList *node = wall_clock->entries; node != NULL; node = node->next) {
+        struct WallClockEntry *entry = (struct WallClockEntry *) node->data;
+        if (entry->func == NULL || entry->id >= last_id) {
+            continue;
+        }
+        if (clock_was_set ? entry->minutes == 1 : minute % entry->minutes == 0) {
+            entry->func(entry->data);
+            entry->runs++;
+        }
+    }
+    wall_clock->running = FALSE;
+    prune_entries(wall_clock);
+    report_wakeups(wall_clock);
+}
+
+/* Free the entries removed while they were running */
+static void prune_entries(WallClock *wall_clock)
+{
+    GList *node = wall_clock->entries;
+    while (node != NULL) {
+        GList *next = node->next;
+        struct WallClockEntry *entry = (struct WallClockEntry *) node->data;
+        if (entry->func == NULL) {
+            free(entry);
+            wall_clock->entries = g_list_delete_link(wall_clock->entries, node);
+        }
+        node = next;
+    }
+}
+
+/* Log how often the greeter woke up over the last WALL_CLOCK_REPORT_MINUTES,
+ * counting every wakeup of the main thread, not only the clock's, & how often
+ * each piece of work ran.
+ */
+static void report_wakeups(WallClock *wall_clock)
+{
+    const gint64 now = g_get_monotonic_time();
+    const gdouble minutes = (gdouble) (now - wall_clock->report_start) /
+                            (G_USEC_PER_SEC * SECONDS_PER_MINUTE);
+    if (minutes < WALL_CLOCK_REPORT_MINUTES) {
+        return;
+    }
+    const guint64 switches = get_wakeups();
+    const guint64 wakeups = switches - MIN(switches, wall_clock->report_switches);
+    GString *runs = g_string_new(NULL);
+    for (GList *node = wall_clock->entries; node != NULL; node = node->next) {
+        struct WallClockEntry *entry = (struct WallClockEntry *) node->data;
+        g_string_append_printf(runs, "%s%s ran %u times", runs->len == 0 ? "" : ", ",
+                               entry->name, entry->runs);
+        entry->runs = 0;
+    }
+    g_message("Wakeups over the last %.0f minutes: %.1f per minute, %.1f of them "
+              "for the clock (%s)", minutes, (gdouble) wakeups / minutes,
+              wall_clock->ticks / minutes, runs->len == 0 ? "no work" : runs->str);
+    g_string_free(runs, TRUE);
+    wall_clock->ticks = 0;
+    wall_clock->report_switches = switches;
+    wall_clock->report_start = now;
+}
+
+/* The number of times the main thread has slept & been woken, from
+ * /proc/self/status, or 0 if it can't be read
+ */
+static guint64 get_wakeups(void)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        return 0;
+    }
+    guint64 wakeups = 0;
+    gsize field_length = strlen(WAKEUPS_FIELD);
+    char line[256];
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, WAKEUPS_FIELD, field_length) == 0) {
+            wakeups = g_ascii_strtoull(line + field_length, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return wakeups;
+}
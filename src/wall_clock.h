@@ -0,0 +1,47 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <glib.h>
+
+// How often the wakeup counts are logged, in minutes
+#define WALL_CLOCK_REPORT_MINUTES 60
+
+
+typedef void (*WallClockFunc)(gpointer data);
+
+/* A timer that fires at the start of every minute of the wall clock & runs
+ * all periodic work from that single wakeup. Setting the system clock fires it
+ * right away, so the shown time is never a minute off.
+ */
+typedef struct WallClock_ {
+    /* Registered work, in the order it was added */
+    GList   *entries;
+    guint    next_id;
+    // Set while entries run, so removed ones are only freed afterwards
+    gboolean running;
+
+    // A timerfd on CLOCK_REALTIME, or -1 if one could not be created
+    int      timer;
+    guint    watch_id;
+    // A GLib timeout to the next minute, used when there is no timerfd
+    guint    fallback_id;
+    // Whether ticking is stopped, e.g. while nobody is at the screen
+    gboolean paused;
+
+    // Counted since the last report
+    guint    ticks;
+    guint64  report_switches;
+    gint64   report_start;
+} WallClock;
+
+
+WallClock *initialize_wall_clock(void);
+void destroy_wall_clock(WallClock *wall_clock);
+void wall_clock_pause(WallClock *wall_clock);
+void wall_clock_resume(WallClock *wall_clock);
+
+guint wall_clock_add(WallClock *wall_clock, const gchar *name, guint minutes,
+                     WallClockFunc func, gpointer data);
+void wall_clock_remove(WallClock *wall_clock, guint id);
+
+#endif
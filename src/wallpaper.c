@@ -0,0 +1,567 @@
+/* Expand the Background Image Setting into a Rotating List of Images
+ *
+ * Directories are described by an index file in the cache directory, holding
+ * the name, mtime, dimensions & format of every image. It is only rebuilt
+ * when the directory's mtime changes, & only images that changed have their
+ * headers read, so picking an image that fits the screen never decodes
+ * anything.
+ */
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+#include "utils.h"
+#include "wallpaper.h"
+
+#define INDEX_MAGIC "LWGI"
+#define INDEX_VERSION 1
+
+// Images whose aspect ratio is within this fraction of the screen's fit it
+#define WALLPAPER_ASPECT_TOLERANCE 0.1
+
+
+/* The index is this header, `entry_count` entries sorted by file name, & a
+ * block of NUL-terminated strings that starts with the directory's path.
+ */
+struct WallpaperIndexHeader {
+    char    magic[4];
+    guint32 version;
+    gint64  directory_mtime;
+    guint32 entry_count;
+    guint32 strings_size;
+};
+
+struct WallpaperIndexEntry {
+    gint64  mtime;
+    /* Offsets into the string block */
+    guint32 name_offset;
+    guint32 format_offset;
+    /* 0 if the image's header could not be read */
+    gint32  width;
+    gint32  height;
+};
+
+
+static gboolean load_directory(Wallpapers *wallpapers, const gchar *directory);
+static GBytes *map_index(const gchar *index_path);
+static gboolean index_is_valid(GBytes *index);
+static gboolean index_is_current(GBytes *index, const gchar *directory, gint64 mtime);
+static GBytes *build_index(const gchar *directory, gint64 directory_mtime, GBytes *old_index);
+static guint32 add_index_string(GByteArray *strings, const gchar *string);
+static const struct WallpaperIndexEntry *find_index_entry(GBytes *index, const gchar *name);
+static const gchar *get_index_strings(GBytes *index);
+static gint64 get_mtime_nsec(const gchar *path, gboolean *is_regular);
+static void add_playlist_images(GPtrArray *paths, const gchar *playlist);
+static gboolean has_image_extension(const gchar *path);
+static gint compare_names(gconstpointer a, gconstpointer b);
+static gchar *get_wallpaper_path(Wallpapers *wallpapers, guint position);
+static gboolean wallpaper_fits(Wallpapers *wallpapers, guint position);
+static guint find_fitting_wallpaper(Wallpapers *wallpapers, guint start);
+static void update_positions(Wallpapers *wallpapers, guint current);
+static guint find_start_position(Wallpapers *wallpapers);
+static void save_position(Wallpapers *wallpapers);
+
+
+/* Collect the images for a `background-image` value, picking images that fit
+ * a `fit_width` x `fit_height` screen.
+ *
+ * A directory expands to every image inside it, sorted by name. A file that
+ * gdk-pixbuf has no loader for is read as a playlist with one path per line;
+ * relative paths are resolved against the playlist's directory, & empty lines
+ * or lines starting with `#` are skipped. Anything else is a single image.
+ */
+Wallpapers *initialize_wallpapers(const gchar *source, gint fit_width, gint fit_height)
+{
+    Wallpapers *wallpapers = malloc(sizeof(Wallpapers));
+    if (wallpapers == NULL) {
+        g_error("Could not allocate memory for Wallpapers");
+    }
+    wallpapers->count = 0;
+    wallpapers->paths = NULL;
+    wallpapers->directory = NULL;
+    wallpapers->index = NULL;
+    wallpapers->entries = NULL;
+    wallpapers->strings = NULL;
+    wallpapers->fit_width = fit_width;
+    wallpapers->fit_height = fit_height;
+    wallpapers->current_path = NULL;
+    wallpapers->next_path = NULL;
+
+    gboolean is_directory = g_file_test(source, G_FILE_TEST_IS_DIR);
+    if (!is_directory || !load_directory(wallpapers, source)) {
+        wallpapers->paths = g_ptr_array_new_with_free_func(g_free);
+        if (!is_directory && !has_image_extension(source) &&
+                g_file_test(source, G_FILE_TEST_IS_REGULAR)) {
+            add_playlist_images(wallpapers->paths, source);
+        }
+        if (wallpapers->paths->len == 0) {
+            if (is_directory || !has_image_extension(source)) {
+                g_warning("No images found in background-image: %s", source);
+            }
+            g_ptr_array_add(wallpapers->paths, g_strdup(source));
+        }
+        wallpapers->count = wallpapers->paths->len;
+    }
+
+    update_positions(wallpapers, find_start_position(wallpapers));
+    save_position(wallpapers);
+    return wallpapers;
+}
+
+void destroy_wallpapers(Wallpapers *wallpapers)
+{
+    if (wallpapers->paths != NULL) {
+        g_ptr_array_free(wallpapers->paths, TRUE);
+    }
+    if (wallpapers->index != NULL) {
+        g_bytes_unref(wallpapers->index);
+    }
+    g_free(wallpapers->directory);
+    g_free(wallpapers->current_path);
+    g_free(wallpapers->next_path);
+    free(wallpapers);
+}
+
+
+const gchar *wallpapers_current(Wallpapers *wallpapers)
+{
+    return wallpapers->current_path;
+}
+
+/* The image that wallpapers_advance will move to. This is the current image
+ * if no other image fits the screen.
+ */
+const gchar *wallpapers_peek_next(Wallpapers *wallpapers)
+{
+    return wallpapers->next_path;
+}
+
+void wallpapers_advance(Wallpapers *wallpapers)
+{
+    update_positions(wallpapers, wallpapers->next);
+    save_position(wallpapers);
+}
+
+/* Pick the following images for a new screen geometry. The current image is
+ * kept, since it is already being shown.
+ */
+void wallpapers_set_geometry(Wallpapers *wallpapers, gint fit_width, gint fit_height)
+{
+    wallpapers->fit_width = fit_width;
+    wallpapers->fit_height = fit_height;
+    update_positions(wallpapers, wallpapers->current);
+}
+
+
+/* Map the directory's index, rebuilding it first if the directory changed.
+ *
+ * If the cache directory is not writable the index is only kept in memory.
+ */
+static gboolean load_directory(Wallpapers *wallpapers, const gchar *directory)
+{
+    gint64 directory_mtime = get_mtime_nsec(directory, NULL);
+    gchar *index_path = get_cache_path(WALLPAPER_INDEX_FILE);
+    GBytes *index = map_index(index_path);
+
+    if (index == NULL || !index_is_current(index, directory, directory_mtime)) {
+        // Unchanged images of the same directory keep their dimensions
+        gboolean same_directory = index != NULL &&
+            strcmp(get_index_strings(index), directory) == 0;
+        GBytes *rebuilt = build_index(directory, directory_mtime,
+                                      same_directory ? index : NULL);
+        if (index != NULL) {
+            g_bytes_unref(index);
+        }
+        gsize rebuilt_size;
+        gconstpointer rebuilt_data = g_bytes_get_data(rebuilt, &rebuilt_size);
+        GError *error = NULL;
+        if (g_file_set_contents(index_path, rebuilt_data, (gssize) rebuilt_size, &error)) {
+            index = map_index(index_path);
+        } else {
+            g_message("Could not save the wallpaper index: %s", error->message);
+            g_error_free(error);
+            index = NULL;
+        }
+        if (index == NULL) {
+            index = g_bytes_ref(rebuilt);
+        }
+        g_bytes_unref(rebuilt);
+    }
+    g_free(index_path);
+
+    const struct WallpaperIndexHeader *header = g_bytes_get_data(index, NULL);
+    if (header->entry_count == 0) {
+        g_bytes_unref(index);
+        return FALSE;
+    }
+    wallpapers->index = index;
+    wallpapers->directory = g_strdup(directory);
+    wallpapers->count = header->entry_count;
+    wallpapers->entries = (const struct WallpaperIndexEntry *) (header + 1);
+    wallpapers->strings = (const gchar *) (wallpapers->entries + header->entry_count);
+    return TRUE;
+}
+
+static GBytes *map_index(const gchar *index_path)
+{
+    GMappedFile *mapped = g_mapped_file_new(index_path, FALSE, NULL);
+    if (mapped == NULL) {
+        return NULL;
+    }
+    GBytes *index = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+    if (!index_is_valid(index)) {
+        g_bytes_unref(index);
+        return NULL;
+    }
+    return index;
+}
+
+/* Check that every offset in the index points inside it */
+static gboolean index_is_valid(GBytes *index)
+{
+    gsize size;
+    const guint8 *data = g_bytes_get_data(index, &size);
+    if (data == NULL || size < sizeof(struct WallpaperIndexHeader)) {
+        return FALSE;
+    }
+    const struct WallpaperIndexHeader *header = (const struct WallpaperIndexHeader *) data;
+    if (memcmp(header->magic, INDEX_MAGIC, 4) != 0 || header->version != INDEX_VERSION) {
+        return FALSE;
+    }
+    guint64 expected_size = sizeof(struct WallpaperIndexHeader) +
+        (guint64) header->entry_count * sizeof(struct WallpaperIndexEntry) +
+        header->strings_size;
+    if (expected_size != size || header->strings_size == 0) {
+        return FALSE;
+    }
+
+    const struct WallpaperIndexEntry *entries = (const struct WallpaperIndexEntry *) (header + 1);
+    const gchar *strings = (const gchar *) (entries + header->entry_count);
+    if (strings[header->strings_size - 1] != '\0') {
+        return FALSE;
+    }
+    for (guint32 e = 0; e < header->entry_count; e++) {
+        if (entries[e].name_offset >= header->strings_size ||
+                entries[e].format_offset >= header->strings_size) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean index_is_current(GBytes *index, const gchar *directory, gint64 mtime)
+{
+    const struct WallpaperIndexHeader *header = g_bytes_get_data(index, NULL);
+    return header->directory_mtime == mtime &&
+        strcmp(get_index_strings(index), directory) == 0;
+}
+
+/* Describe every image in a directory, reading the headers of images that
+ * are not in `old_index` with the same mtime.
+ */
+static GBytes *build_index(const gchar *directory, gint64 directory_mtime, GBytes *old_index)
+{
+    GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (dir != NULL) {
+        const gchar *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (name[0] != '.' && has_image_extension(name)) {
+                g_ptr_array_add(names, g_strdup(name));
+            }
+        }
+        g_dir_close(dir);
+    }
+    g_ptr_array_sort(names, &compare_names);
+
+    GArray *entries = g_array_sized_new(FALSE, FALSE, sizeof(struct WallpaperIndexEntry), names->len);
+    GByteArray *strings = g_byte_array_new();
+    GHashTable *format_offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    add_index_string(strings, directory);
+    guint read_headers = 0;
+
+    for (guint n = 0; n < names->len; n++) {
+        const gchar *name = g_ptr_array_index(names, n);
+        gchar *path = g_build_filename(directory, name, NULL);
+        gboolean is_regular = FALSE;
+        struct WallpaperIndexEntry entry = { 0 };
+        entry.mtime = get_mtime_nsec(path, &is_regular);
+        if (!is_regular) {
+            g_free(path);
+            continue;
+        }
+        entry.name_offset = add_index_string(strings, name);
+
+        const gchar *format_name = "";
+        gchar *new_format_name = NULL;
+        const struct WallpaperIndexEntry *old_entry =
+            old_index == NULL ? NULL : find_index_entry(old_index, name);
+        if (old_entry != NULL && old_entry->mtime == entry.mtime) {
+            entry.width = old_entry->width;
+            entry.height = old_entry->height;
+            format_name = get_index_strings(old_index) + old_entry->format_offset;
+        } else {
+            gint width = 0, height = 0;
+            GdkPixbufFormat *format = gdk_pixbuf_get_file_info(path, &width, &height);
+            if (format != NULL) {
+                entry.width = width;
+                entry.height = height;
+                new_format_name = gdk_pixbuf_format_get_name(format);
+                format_name = new_format_name;
+            }
+            read_headers++;
+        }
+
+        gpointer format_offset;
+        if (g_hash_table_lookup_extended(format_offsets, format_name, NULL, &format_offset)) {
+            entry.format_offset = GPOINTER_TO_UINT(format_offset);
+        } else {
+            entry.format_offset = add_index_string(strings, format_name);
+            g_hash_table_insert(format_offsets, g_strdup(format_name),
+                                GUINT_TO_POINTER(entry.format_offset));
+        }
+        g_free(new_format_name);
+        g_free(path);
+        g_array_append_val(entries, entry);
+    }
+    g_message("Indexed %u wallpapers in %s, read %u image headers",
+              entries->len, directory, read_headers);
+
+    struct WallpaperIndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.version = INDEX_VERSION;
+    header.directory_mtime = directory_mtime;
+    header.entry_count = entries->len;
+    header.strings_size = strings->len;
+
+    GByteArray *index = g_byte_array_sized_new(
+        (guint) (sizeof(header) + entries->len * sizeof(struct WallpaperIndexEntry) + strings->len));
+    g_byte_array_append(index, (const guint8 *) &header, sizeof(header));
+    g_byte_array_append(index, (const guint8 *) entries->data,
+                        (guint) (entries->len * sizeof(struct WallpaperIndexEntry)));
+    g_byte_array_append(index, strings->data, strings->len);
+
+    g_hash_table_destroy(format_offsets);
+    g_byte_array_free(strings, TRUE);
+    g_array_free(entries, TRUE);
+    g_ptr_array_free(names, TRUE);
+    return g_byte_array_free_to_bytes(index);
+}
+
+/* Append a NUL-terminated string, returning its offset */
+static guint32 add_index_string(GByteArray *strings, const gchar *string)
+{
+    guint32 offset = strings->len;
+    g_byte_array_append(strings, (const guint8 *) string, (guint) strlen(string) + 1);
+    return offset;
+}
+
+/* Binary search the index's entries for a file name */
+static const struct WallpaperIndexEntry *find_index_entry(GBytes *index, const gchar *name)
+{
+    const struct WallpaperIndexHeader *header = g_bytes_get_data(index, NULL);
+    const struct WallpaperIndexEntry *entries = (const struct WallpaperIndexEntry *) (header + 1);
+    const gchar *strings = get_index_strings(index);
+
+    guint32 low = 0, high = header->entry_count;
+    while (low < high) {
+        guint32 middle = low + (high - low) / 2;
+        int comparison = strcmp(strings + entries[middle].name_offset, name);
+        if (comparison == 0) {
+            return &entries[middle];
+        } else if (comparison < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+/* The string block follows the header & entries */
+static const gchar *get_index_strings(GBytes *index)
+{
+    const struct WallpaperIndexHeader *header = g_bytes_get_data(index, NULL);
+    const struct WallpaperIndexEntry *entries = (const struct WallpaperIndexEntry *) (header + 1);
+    return (const gchar *) (entries + header->entry_count);
+}
+
+/* Get a file's modification time in nanoseconds, or 0 if it can't be read */
+static gint64 get_mtime_nsec(const gchar *path, gboolean *is_regular)
+{
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0) {
+        return 0;
+    }
+    if (is_regular != NULL) {
+        *is_regular = S_ISREG(file_stat.st_mode);
+    }
+    return (gint64) file_stat.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+        (gint64) file_stat.st_mtim.tv_nsec;
+}
+
+
+static void add_playlist_images(GPtrArray *paths, const gchar *playlist)
+{
+    gchar *contents = NULL;
+    if (!g_file_get_contents(playlist, &contents, NULL, NULL)) {
+        return;
+    }
+    gchar *playlist_dir = g_path_get_dirname(playlist);
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (gchar **line = lines; *line != NULL; line++) {
+        gchar *entry = g_strstrip(*line);
+        if (entry[0] == '\0' || entry[0] == '#') {
+            continue;
+        }
+        if (g_path_is_absolute(entry)) {
+            g_ptr_array_add(paths, g_strdup(entry));
+        } else {
+            g_ptr_array_add(paths, g_build_filename(playlist_dir, entry, NULL));
+        }
+    }
+    g_strfreev(lines);
+    g_free(playlist_dir);
+    g_free(contents);
+}
+
+/* Determine if any gdk-pixbuf loader claims the path's file extension */
+static gboolean has_image_extension(const gchar *path)
+{
+    const gchar *extension = strrchr(path, '.');
+    if (extension == NULL || strchr(extension, '/') != NULL) {
+        return FALSE;
+    }
+    extension++;
+
+    gboolean found = FALSE;
+    GSList *formats = gdk_pixbuf_get_formats();
+    for (GSList *format = formats; format != NULL && !found; format = format->next) {
+        gchar **extensions = gdk_pixbuf_format_get_extensions(format->data);
+        for (gchar **known = extensions; *known != NULL; known++) {
+            if (g_ascii_strcasecmp(*known, extension) == 0) {
+                found = TRUE;
+                break;
+            }
+        }
+        g_strfreev(extensions);
+    }
+    g_slist_free(formats);
+    return found;
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+static gchar *get_wallpaper_path(Wallpapers *wallpapers, guint position)
+{
+    if (wallpapers->paths != NULL) {
+        return g_strdup(g_ptr_array_index(wallpapers->paths, position));
+    }
+    return g_build_filename(wallpapers->directory,
+                            wallpapers->strings + wallpapers->entries[position].name_offset,
+                            NULL);
+}
+
+/* Determine if an image's shape is close to the screen's, & it is at least
+ * half the screen's size. Images without known dimensions always fit.
+ */
+static gboolean wallpaper_fits(Wallpapers *wallpapers, guint position)
+{
+    if (wallpapers->entries == NULL || wallpapers->fit_width <= 0 || wallpapers->fit_height <= 0) {
+        return TRUE;
+    }
+    const struct WallpaperIndexEntry *entry = &wallpapers->entries[position];
+    if (entry->width <= 0 || entry->height <= 0) {
+        return TRUE;
+    }
+    if (entry->width < wallpapers->fit_width / 2 || entry->height < wallpapers->fit_height / 2) {
+        return FALSE;
+    }
+    gdouble image_aspect = (gdouble) entry->width / (gdouble) entry->height;
+    gdouble screen_aspect = (gdouble) wallpapers->fit_width / (gdouble) wallpapers->fit_height;
+    return fabs(image_aspect / screen_aspect - 1.0) <= WALLPAPER_ASPECT_TOLERANCE;
+}
+
+/* Find the first image at or after `start` that fits the screen. If none do,
+ * images are not skipped at all.
+ */
+static guint find_fitting_wallpaper(Wallpapers *wallpapers, guint start)
+{
+    for (guint offset = 0; offset < wallpapers->count; offset++) {
+        guint position = (start + offset) % wallpapers->count;
+        if (wallpaper_fits(wallpapers, position)) {
+            return position;
+        }
+    }
+    return start % wallpapers->count;
+}
+
+static void update_positions(Wallpapers *wallpapers, guint current)
+{
+    wallpapers->current = current;
+    wallpapers->next = find_fitting_wallpaper(wallpapers, current + 1);
+
+    g_free(wallpapers->current_path);
+    g_free(wallpapers->next_path);
+    wallpapers->current_path = get_wallpaper_path(wallpapers, wallpapers->current);
+    wallpapers->next_path = get_wallpaper_path(wallpapers, wallpapers->next);
+}
+
+
+/* Start after the image shown last time, or at a random image if it is no
+ * longer in the list.
+ */
+static guint find_start_position(Wallpapers *wallpapers)
+{
+    gchar *state_path = get_cache_path(WALLPAPER_STATE_FILE);
+    gchar *last_shown = NULL;
+    g_file_get_contents(state_path, &last_shown, NULL, NULL);
+    g_free(state_path);
+
+    guint start = (guint) g_random_int_range(0, (gint32) wallpapers->count);
+    if (last_shown != NULL) {
+        g_strchomp(last_shown);
+        if (wallpapers->paths != NULL) {
+            for (guint p = 0; p < wallpapers->paths->len; p++) {
+                if (strcmp(g_ptr_array_index(wallpapers->paths, p), last_shown) == 0) {
+                    start = p + 1;
+                    break;
+                }
+            }
+        } else {
+            gchar *last_directory = g_path_get_dirname(last_shown);
+            gchar *last_name = g_path_get_basename(last_shown);
+            const struct WallpaperIndexEntry *entry =
+                find_index_entry(wallpapers->index, last_name);
+            if (entry != NULL && strcmp(last_directory, wallpapers->directory) == 0) {
+                start = (guint) (entry - wallpapers->entries) + 1;
+            }
+            g_free(last_name);
+            g_free(last_directory);
+        }
+        g_free(last_shown);
+    }
+    return find_fitting_wallpaper(wallpapers, start);
+}
+
+static void save_position(Wallpapers *wallpapers)
+{
+    if (wallpapers->count < 2) {
+        return;
+    }
+    gchar *state_path = get_cache_path(WALLPAPER_STATE_FILE);
+    if (!g_file_set_contents(state_path, wallpapers->current_path, -1, NULL)) {
+        g_message("Could not save the wallpaper position to %s", state_path);
+    }
+    g_free(state_path);
+}
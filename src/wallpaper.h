@@ -0,0 +1,46 @@
+#ifndef WALLPAPER_H
+#define WALLPAPER_H
+
+#include <glib.h>
+
+#define WALLPAPER_STATE_FILE "wallpaper.state"
+#define WALLPAPER_INDEX_FILE "wallpaper.index"
+
+
+/* The images a `background-image` file, directory, or playlist expands to.
+ *
+ * The position is saved, so each start of the greeter, like every lock,
+ * shows the image after the one shown last time. Images whose shape does not
+ * fit the screen are skipped, when their dimensions are known.
+ */
+typedef struct Wallpapers_ {
+    guint        count;
+    guint        current;
+    guint        next;
+
+    /* Absolute paths of a playlist or single image. NULL for directories. */
+    GPtrArray   *paths;
+
+    /* The memory-mapped index of a directory's images */
+    gchar       *directory;
+    GBytes      *index;
+    const struct WallpaperIndexEntry *entries;
+    const gchar *strings;
+
+    /* The geometry images are picked for */
+    gint         fit_width;
+    gint         fit_height;
+
+    gchar       *current_path;
+    gchar       *next_path;
+} Wallpapers;
+
+
+Wallpapers *initialize_wallpapers(const gchar *source, gint fit_width, gint fit_height);
+void destroy_wallpapers(Wallpapers *wallpapers);
+const gchar *wallpapers_current(Wallpapers *wallpapers);
+const gchar *wallpapers_peek_next(Wallpapers *wallpapers);
+void wallpapers_advance(Wallpapers *wallpapers);
+void wallpapers_set_geometry(Wallpapers *wallpapers, gint fit_width, gint fit_height);
+
+#endif
@@ -0,0 +1,376 @@
+/* Follow a Wireless Link's Signal Strength Through nl80211 Events */
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+
+#include <glib-unix.h>
+
+#include "netlink.h"
+#include "wireless.h"
+
+
+// The weakest signal, in dBm, that lights each arc past the first
+static const gint32 level_thresholds[WIRELESS_LEVEL_MAX] = { -78, -67, -55 };
+
+
+static gboolean open_generic_netlink(WirelessMonitor* monitor);
+static gboolean resolve_nl80211(WirelessMonitor* monitor);
+static gboolean read_family(WirelessMonitor* monitor, const struct nlmsghdr* header,
+                            guint32* mlme_group);
+static struct nlmsghdr* start_request(WirelessMonitor* monitor, NetlinkRequest* request,
+                                      guint16 type, guint16 flags, guint8 command);
+static gboolean send_request(WirelessMonitor* monitor, const NetlinkRequest* request);
+static const void* generic_attributes(const struct nlmsghdr* header, gsize* length);
+static void request_refresh(WirelessMonitor* monitor);
+static gboolean handle_refresh(gpointer user_data);
+static void handle_refresh_tick(gpointer user_data);
+static gboolean handle_nl80211_messages(gint fd, GIOCondition condition, gpointer user_data);
+static void handle_nl80211_message(WirelessMonitor* monitor, const struct nlmsghdr* header);
+static void read_station(WirelessMonitor* monitor, const struct nlattr* station_info);
+static gint quantize_signal(gint dbm, gint level);
+static void stop_refreshing(WirelessMonitor* monitor);
+
+
+/* Connect to nl80211. Without it, e.g. on a kernel without cfg80211, the
+ * level stays unknown.
+ */
+WirelessMonitor* initialize_wireless_monitor(WallClock* wall_clock, WirelessSignalFunc func,
+                                             gpointer data)
+{
+    WirelessMonitor* monitor = g_new0(WirelessMonitor, 1);
+    monitor->socket = -1;
+    monitor->wall_clock = wall_clock;
+    monitor->level = WIRELESS_LEVEL_UNKNOWN;
+    monitor->func = func;
+    monitor->data = data;
+
+    if (!open_generic_netlink(monitor) || !resolve_nl80211(monitor)) {
+        if (monitor->socket != -1) {
+            close(monitor->socket);
+            monitor->socket = -1;
+        }
+        return monitor;
+    }
+    monitor->watch_id = g_unix_fd_add(monitor->socket, G_IO_IN,
+                                      &handle_nl80211_messages, monitor);
+    return monitor;
+}
+
+void destroy_wireless_monitor(WirelessMonitor* monitor)
+{
+    stop_refreshing(monitor);
+    if (monitor->watch_id != 0) {
+        g_source_remove(monitor->watch_id);
+    }
+    if (monitor->socket != -1) {
+        close(monitor->socket);
+    }
+    g_free(monitor);
+}
+
+/* Follow the signal of another interface, or of none with an index of 0 */
+void wireless_monitor_set_interface(WirelessMonitor* monitor, gint ifindex)
+{
+    if (ifindex == monitor->ifindex) {
+        return;
+    }
+    stop_refreshing(monitor);
+    monitor->ifindex = ifindex;
+    monitor->level = WIRELESS_LEVEL_UNKNOWN;
+    if (ifindex == 0 || monitor->watch_id == 0) {
+        return;
+    }
+    monitor->tick_id = wall_clock_add(monitor->wall_clock, "wireless-signal",
+                                      WIRELESS_REFRESH_MINUTES, &handle_refresh_tick, monitor);
+    request_refresh(monitor);
+}
+
+
+static gboolean open_generic_netlink(WirelessMonitor* monitor)
+{
+    monitor->socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (monitor->socket == -1) {
+        g_warning("Could not open a generic netlink socket: %s", g_strerror(errno));
+        return FALSE;
+    }
+    struct sockaddr_nl address = { .nl_family = AF_NETLINK };
+    if (bind(monitor->socket, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        g_warning("Could not bind the generic netlink socket: %s", g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Look up nl80211's family & join its MLME group, which carries (re)connects
+ * & connection quality events. The kernel answers right away, so this
+ * blocks.
+ */
+static gboolean resolve_nl80211(WirelessMonitor* monitor)
+{
+    NetlinkRequest request;
+    start_request(monitor, &request, GENL_ID_CTRL, NLM_F_REQUEST, CTRL_CMD_GETFAMILY);
+    netlink_request_add(&request, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME,
+                        sizeof(NL80211_GENL_NAME));
+    if (!send_request(monitor, &request)) {
+        return FALSE;
+    }
+
+    guint32 mlme_group = 0;
+    gboolean answered = FALSE;
+    while (!answered) {
+        guint32 buffer[NETLINK_BUFFER_SIZE / sizeof(guint32)];
+        ssize_t received = recv(monitor->socket, buffer, sizeof(buffer), 0);
+        if (received == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            g_warning("Could not look up nl80211: %s", g_strerror(errno));
+            return FALSE;
+        }
+        gsize offset = 0;
+        const struct nlmsghdr* header;
+        while ((header = netlink_next_message(buffer, (gsize) received, &offset)) != NULL) {
+            if (header->nlmsg_seq != monitor->sequence) {
+                continue;
+            }
+            answered = TRUE;
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                g_message("nl80211 is not available, not showing the wireless signal");
+                return FALSE;
+            }
+            if (!read_family(monitor, header, &mlme_group)) {
+                return FALSE;
+            }
+        }
+    }
+
+    if (setsockopt(monitor->socket, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                   &mlme_group, sizeof(mlme_group)) == -1) {
+        g_warning("Could not join nl80211's %s group: %s", NL80211_MULTICAST_GROUP_MLME,
+                  g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Read nl80211's family ID & the ID of its MLME group from the controller */
+static gboolean read_family(WirelessMonitor* monitor, const struct nlmsghdr* header,
+                            guint32* mlme_group)
+{
+    gsize length;
+    const void* attributes = generic_attributes(header, &length);
+    const struct nlattr* family_id = netlink_find_attribute(attributes, length,
+                                                            CTRL_ATTR_FAMILY_ID);
+    const struct nlattr* groups = netlink_find_attribute(attributes, length,
+                                                         CTRL_ATTR_MCAST_GROUPS);
+    if (family_id == NULL || netlink_attribute_length(family_id) < sizeof(guint16) ||
+            groups == NULL) {
+        g_warning("The kernel's description of nl80211 is incomplete");
+        return FALSE;
+    }
+    memcpy(&monitor->family_id, netlink_attribute_data(family_id), sizeof(guint16));
+
+    gsize offset = 0;
+    const struct nlattr* group;
+    while ((group = netlink_next_attribute(netlink_attribute_data(groups),
+                                           netlink_attribute_length(groups), &offset)) != NULL) {
+        const void* group_attributes = netlink_attribute_data(group);
+        const gsize group_length = netlink_attribute_length(group);
+        const struct nlattr* name = netlink_find_attribute(group_attributes, group_length,
+                                                           CTRL_ATTR_MCAST_GRP_NAME);
+        const struct nlattr* id = netlink_find_attribute(group_attributes, group_length,
+                                                         CTRL_ATTR_MCAST_GRP_ID);
+        if (name != NULL && id != NULL && netlink_attribute_length(id) >= sizeof(guint32) &&
+                strncmp(netlink_attribute_data(name), NL80211_MULTICAST_GROUP_MLME,
+                        netlink_attribute_length(name)) == 0) {
+            memcpy(mlme_group, netlink_attribute_data(id), sizeof(guint32));
+            return TRUE;
+        }
+    }
+    g_warning("nl80211 has no %s group", NL80211_MULTICAST_GROUP_MLME);
+    return FALSE;
+}
+
+static struct nlmsghdr* start_request(WirelessMonitor* monitor, NetlinkRequest* request,
+                                      guint16 type, guint16 flags, guint8 command)
+{
+    struct nlmsghdr* header = netlink_request_start(request, type, flags, ++monitor->sequence,
+                                                    sizeof(struct genlmsghdr));
+    struct genlmsghdr* generic_header = NLMSG_DATA(header);
+    generic_header->cmd = command;
+    generic_header->version = 1;
+    return header;
+}
+
+static gboolean send_request(WirelessMonitor* monitor, const NetlinkRequest* request)
+{
+    if (send(monitor->socket, request->data, request->length, 0) == -1) {
+        g_warning("Could not send an nl80211 request: %s", g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* The attributes after a generic netlink message's headers */
+static const void* generic_attributes(const struct nlmsghdr* header, gsize* length)
+{
+    const gsize headers_length = NLMSG_LENGTH(GENL_HDRLEN);
+    *length = header->nlmsg_len < headers_length ? 0 : header->nlmsg_len - headers_length;
+    return (const guint8*) header + headers_length;
+}
+
+/* Query the station's signal, no sooner than WIRELESS_MIN_REFRESH_MS after
+ * the last query. Requests in between are merged.
+ */
+static void request_refresh(WirelessMonitor* monitor)
+{
+    if (monitor->refresh_id != 0 || monitor->ifindex == 0) {
+        return;
+    }
+    const gint64 now = g_get_monotonic_time();
+    const gint64 next_refresh = monitor->last_refresh + WIRELESS_MIN_REFRESH_MS * 1000;
+    const guint delay = now >= next_refresh ? 0 : (guint) ((next_refresh - now) / 1000);
+    monitor->refresh_id = g_timeout_add(delay, &handle_refresh, monitor);
+}
+
+static gboolean handle_refresh(gpointer user_data)
+{
+    WirelessMonitor* monitor = (WirelessMonitor*) user_data;
+    monitor->refresh_id = 0;
+    monitor->last_refresh = g_get_monotonic_time();
+
+    NetlinkRequest request;
+    start_request(monitor, &request, monitor->family_id, NLM_F_REQUEST | NLM_F_DUMP,
+                  NL80211_CMD_GET_STATION);
+    const guint32 ifindex = (guint32) monitor->ifindex;
+    netlink_request_add(&request, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+    send_request(monitor, &request);
+    return G_SOURCE_REMOVE;
+}
+
+static void handle_refresh_tick(gpointer user_data)
+{
+    request_refresh((WirelessMonitor*) user_data);
+}
+
+/* Runs whenever nl80211 sends an event or a reply */
+static gboolean handle_nl80211_messages(gint fd, GIOCondition condition, gpointer user_data)
+{
+    WirelessMonitor* monitor = (WirelessMonitor*) user_data;
+    guint32 buffer[NETLINK_BUFFER_SIZE / sizeof(guint32)];
+    ssize_t received;
+    while ((received = recv(monitor->socket, buffer, sizeof(buffer), MSG_DONTWAIT)) != -1) {
+        gsize offset = 0;
+        const struct nlmsghdr* header;
+        while ((header = netlink_next_message(buffer, (gsize) received, &offset)) != NULL) {
+            handle_nl80211_message(monitor, header);
+        }
+    }
+    if (errno == ENOBUFS) {
+        // Events were dropped, so the shown level may be stale
+        request_refresh(monitor);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        g_warning("Stopped following the wireless signal: %s", g_strerror(errno));
+        monitor->watch_id = 0;
+        stop_refreshing(monitor);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void handle_nl80211_message(WirelessMonitor* monitor, const struct nlmsghdr* header)
+{
+    if (header->nlmsg_type != monitor->family_id) {
+        return;
+    }
+
+    gsize length;
+    const void* attributes = generic_attributes(header, &length);
+    const struct nlattr* ifindex = netlink_find_attribute(attributes, length,
+                                                          NL80211_ATTR_IFINDEX);
+    guint32 message_ifindex = 0;
+    if (ifindex != NULL && netlink_attribute_length(ifindex) >= sizeof(guint32)) {
+        memcpy(&message_ifindex, netlink_attribute_data(ifindex), sizeof(guint32));
+    }
+    if (monitor->ifindex == 0 || message_ifindex != (guint32) monitor->ifindex) {
+        return;
+    }
+
+    const struct genlmsghdr* generic_header = NLMSG_DATA(header);
+    switch (generic_header->cmd) {
+        case NL80211_CMD_NOTIFY_CQM:
+        case NL80211_CMD_CONNECT:
+        case NL80211_CMD_ROAM:
+            request_refresh(monitor);
+            break;
+        case NL80211_CMD_NEW_STATION:
+            read_station(monitor, netlink_find_attribute(attributes, length,
+                                                         NL80211_ATTR_STA_INFO));
+            break;
+        default:
+            break;
+    }
+}
+
+/* Update the level from a station's averaged signal, or its last signal */
+static void read_station(WirelessMonitor* monitor, const struct nlattr* station_info)
+{
+    if (station_info == NULL) {
+        return;
+    }
+    const void* info = netlink_attribute_data(station_info);
+    const gsize info_length = netlink_attribute_length(station_info);
+    const struct nlattr* signal = netlink_find_attribute(info, info_length,
+                                                         NL80211_STA_INFO_SIGNAL_AVG);
+    if (signal == NULL) {
+        signal = netlink_find_attribute(info, info_length, NL80211_STA_INFO_SIGNAL);
+    }
+    if (signal == NULL || netlink_attribute_length(signal) < 1) {
+        return;
+    }
+    const gint dbm = (gint8) *(const guint8*) netlink_attribute_data(signal);
+    const gint level = quantize_signal(dbm, monitor->level);
+    if (level != monitor->level) {
+        monitor->level = level;
+        monitor->func(level, monitor->data);
+    }
+}
+
+/* The level for a signal, which only moves once the signal is
+ * WIRELESS_HYSTERESIS_DBM past a boundary, so it doesn't flicker around one.
+ */
+static gint quantize_signal(gint dbm, gint level)
+{
+    if (level == WIRELESS_LEVEL_UNKNOWN) {
+        level = 0;
+        while (level < WIRELESS_LEVEL_MAX && dbm >= level_thresholds[level]) {
+            level++;
+        }
+        return level;
+    }
+    // The signal, moved against the direction it has to go to change levels
+    const gint rising = dbm - WIRELESS_HYSTERESIS_DBM;
+    const gint falling = dbm + WIRELESS_HYSTERESIS_DBM;
+    while (level < WIRELESS_LEVEL_MAX && rising >= level_thresholds[level]) {
+        level++;
+    }
+    while (level > 0 && falling < level_thresholds[level - 1]) {
+        level--;
+    }
+    return level;
+}
+
+static void stop_refreshing(WirelessMonitor* monitor)
+{
+    if (monitor->refresh_id != 0) {
+        g_source_remove(monitor->refresh_id);
+        monitor->refresh_id = 0;
+    }
+    if (monitor->tick_id != 0) {
+        wall_clock_remove(monitor->wall_clock, monitor->tick_id);
+        monitor->tick_id = 0;
+    }
+}
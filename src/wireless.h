@@ -0,0 +1,56 @@
+#ifndef WIRELESS_H
+#define WIRELESS_H
+
+#include <glib.h>
+
+#include "wall_clock.h"
+
+// Signal levels, as the number of lit arcs on the wireless icon
+#define WIRELESS_LEVEL_UNKNOWN -1
+#define WIRELESS_LEVEL_MAX 3
+// How far past a level's boundary the signal must go to change the level
+#define WIRELESS_HYSTERESIS_DBM 3
+// The shortest time between two station queries
+#define WIRELESS_MIN_REFRESH_MS 2000
+// How often to query the signal between nl80211 events
+#define WIRELESS_REFRESH_MINUTES 1
+
+
+/* Called when the quantized signal level of the followed interface changes */
+typedef void (*WirelessSignalFunc)(gint level, gpointer data);
+
+/* Follows the signal strength of a wireless link over nl80211.
+ *
+ * The station's signal is queried after a (re)connect or a connection quality
+ * event, & on the WallClock's ticks every WIRELESS_REFRESH_MINUTES, but at
+ * most once every WIRELESS_MIN_REFRESH_MS.
+ *
+ * Quality events only arrive for thresholds someone else, like
+ * wpa_supplicant's bgscan, has set. Setting them takes CAP_NET_ADMIN & would
+ * replace theirs, so the greeter never does.
+ */
+typedef struct WirelessMonitor_ {
+    int                socket;
+    guint              watch_id;
+    guint32            sequence;
+    guint16            family_id;
+
+    gint               ifindex;
+    // Queries the signal on the WallClock's ticks while following a link
+    WallClock*         wall_clock;
+    guint              tick_id;
+    guint              refresh_id;
+    gint64             last_refresh;
+
+    gint               level;
+    WirelessSignalFunc func;
+    gpointer           data;
+} WirelessMonitor;
+
+
+WirelessMonitor* initialize_wireless_monitor(WallClock* wall_clock, WirelessSignalFunc func,
+                                             gpointer data);
+void destroy_wireless_monitor(WirelessMonitor* monitor);
+void wireless_monitor_set_interface(WirelessMonitor* monitor, gint ifindex);
+
+#endif
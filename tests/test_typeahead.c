@@ -0,0 +1,47 @@
+/* Tests for Buffering Keystrokes Before the Password Input is Ready */
+#include <gtk/gtk.h>
+
+#include "typeahead.h"
+
+
+static void test_enter_alone_does_not_submit(void)
+{
+    TypeAhead *typeahead = initialize_typeahead();
+    g_assert_true(typeahead_add_key(typeahead, GDK_KEY_Return, 0));
+    g_assert_false(typeahead->submit);
+    g_assert_true(typeahead_is_empty(typeahead));
+    destroy_typeahead(typeahead);
+}
+
+static void test_enter_after_characters_submits(void)
+{
+    TypeAhead *typeahead = initialize_typeahead();
+    typeahead_add_key(typeahead, GDK_KEY_a, 0);
+    typeahead_add_key(typeahead, GDK_KEY_KP_Enter, 0);
+    g_assert_true(typeahead->submit);
+    g_assert_false(typeahead_is_empty(typeahead));
+    destroy_typeahead(typeahead);
+}
+
+static void test_enter_after_erasing_does_not_submit(void)
+{
+    TypeAhead *typeahead = initialize_typeahead();
+    typeahead_add_key(typeahead, GDK_KEY_a, 0);
+    typeahead_add_key(typeahead, GDK_KEY_BackSpace, 0);
+    typeahead_add_key(typeahead, GDK_KEY_Return, 0);
+    g_assert_true(typeahead_is_empty(typeahead));
+    destroy_typeahead(typeahead);
+}
+
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/typeahead/enter-alone-does-not-submit",
+                    &test_enter_alone_does_not_submit);
+    g_test_add_func("/typeahead/enter-after-characters-submits",
+                    &test_enter_after_characters_submits);
+    g_test_add_func("/typeahead/enter-after-erasing-does-not-submit",
+                    &test_enter_after_erasing_does_not_submit);
+    return g_test_run();
+}